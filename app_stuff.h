@@ -6,17 +6,42 @@
 //
 
 #include <chrono>
+#include <csignal>
 #include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 #include "prague_cc.h"
+#include "pkt_format.h"
 #include "json_writer.h"
+#include "hdr_histogram.h"
+#include "prague_trace.h"
+#include "prague_snapshot.h"
+#include "prague_metrics.h"
+#include "fec.h"
+#include "frame_deadline.h"
 
 // to avoid int64 printf incompatibility between platforms:
 #define C_STR(i) std::to_string(i).c_str()
 #define REPT_PERIOD 1000000
 #define RFC8888_ACKPERIOD 25000
+#define RLE_ATO_SHIFT 10
 #define FRAME_PER_SECOND 60
 #define FRAME_DURATION 10000
+#define MAX_TIMEOUTS 2
 #define PORT 8080
+#define WAKE_MISS 50        // a sender wakeup later than this after its deadline (us) is a deadline miss
+#define ZEROCOPY_MIN 10240  // payload size from which zero-copy sends usually pay off (Linux msg_zerocopy docs: ~10 KB),
+                            // measure the crossover of a path with zerocopy_bench
+
+// set by SIGINT/SIGTERM, the main loops stop and the exit summary is printed
+static volatile sig_atomic_t app_stop = 0;
+static void app_stop_handler(int) { app_stop = 1; }
 
 // app related stuff collected in this object to avoid obfuscation of the main Prague loop
 struct AppStuff
@@ -46,9 +71,59 @@ struct AppStuff
     count_tp prev_pkts;     // prev packets received
     count_tp prev_marks;    // prev marks received
     count_tp prev_losts;    // prev losts received
+    count_tp reordered;     // packets delivered after a later sent packet
+    count_tp prev_reordered;
+    count_tp spurious;      // packets found lost, but delivered later
+    count_tp prev_spurious;
+    time_tp reo_wnd;        // current reorder window of the loss detection
+    time_tp srtt;           // latest smoothed RTT, RTT variation, windowed min RTT and queueing delay of PragueCC
+    time_tp rttvar;
+    time_tp min_rtt;
+    time_tp qdelay;
+    // latency distributions per report interval (merged in the totals for the exit summary), in us:
+    // sender: RTT samples (also per packet of RFC8888 feedback), their queueing delay above the min RTT,
+    //         gaps between the bursts and feedback inter-arrival times
+    // receiver: RTT samples (per-packet ACKs only), data inter-arrival and feedback inter-departure times
+    HdrHistogram hist_rtt, hist_qdelay, hist_gap, hist_ack;
+    HdrHistogram total_rtt, total_qdelay, total_gap, total_ack;
+    time_tp gap_tm;         // previous burst sent (sender) or data packet received (receiver), 0 if none yet
+    time_tp fb_tm;          // previous feedback received (sender) or sent (receiver), 0 if none yet
+    time_tp start_tm;       // first and last time a latency sample was taken, for the exit summary
+    time_tp last_tm;
+    // sender wakeups without feedback: how late after the pacing or timeout deadline, and the misses beyond WAKE_MISS
+    HdrHistogram hist_wake, total_wake;
+    count_tp wake_miss, total_wake_miss;
+    int64_t cpu_start, wall_start;  // process CPU time and wall time (us) at the start and at the last report
+    int64_t cpu_rept, wall_rept;
+    uint32_t timer_slack;   // Linux timer slack in ns (0 keeps the default)
     bool rfc8888_ack;       // RFC8888 ACK (Block ACK)
     uint32_t rfc8888_ackperiod; // RFC8888 ACK period
+    bool rle_ack;           // Run-length compressed RFC8888 ACK
+    uint8_t ato_shift;      // Run-length compressed ACK arrival time offset resolution (2^ato_shift us)
+    bool ack_freq;          // Request ACK thinning (per-packet ACK) or an adaptive feedback period (RFC8888 ACK)
+    count_tp acks_per_rtt;  // Targeted number of ACKs or RFC8888 feedback packets per RTT
+    bool rack;              // Reordering-tolerant (RACK-style) time-based loss detection at the sender
+    uint32_t max_timeouts;  // Consecutive retransmission timeouts (window collapses) before the sender stops, 0 never stops
+    const char *shm_name;   // Shared-memory segment to publish PragueCC state snapshots in (NULL if none)
+    const char *metrics_addr; // OpenMetrics endpoint: loopback TCP port or unix:<path> (NULL if none)
+    SnapshotShm shm;
+    prague_snapshot_t *snapshot; // lock-free PragueCC state snapshots for monitoring threads and processes (NULL if none)
+    prague_snapshot_t local_snapshot;
+    prague_metrics_t metrics;
+#ifndef _WIN32
+    MetricsServer metrics_server;
+#endif
+    const char *trace_file; // Binary per-packet trace file (NULL if none)
+    uint64_t trace_size;    // Binary trace ring size in records
+    TraceRing trace;
+    const char *record_file;  // PragueCC input recording for udp_prague_replay (NULL if none, sender only)
+    bool zerocopy;          // MSG_ZEROCOPY sends of the payloads (sender only, Linux)
+    size_tp zerocopy_min;   // smallest payload sent with zero-copy
+    const char *file_name;  // File to transfer reliably (sender), or to write it to (receiver), NULL if none
     bool rt_mode;           // Frame-based sender
+    uint8_t fec;            // FEC of the frames, FEC_NONE, FEC_XOR or FEC_RS (RT mode sender)
+    uint32_t fec_parity;    // parity share of the packets of a frame in %
+    time_tp rt_deadline;    // latency budget of a frame from its capture until it is complete, 0 if none (RT mode)
     fps_tp rt_fps;          // Frame-based FPS
     uint32_t rt_frameduration;  // Frame-based frame duration
 
@@ -56,6 +131,8 @@ struct AppStuff
     {
         if (stop) {
             perror(reason);
+            PrintSummary(last_tm);
+            jw.close();  // write the pending json lines
             exit(1);
         }
     }
@@ -75,18 +152,46 @@ struct AppStuff
         }
         return 1;
     }
+    // a file path given as option value (directories allowed), not empty and not a missing value followed by an option
+    int valid_path(const char *path)
+    {
+        if (path == NULL || path[0] == '\0' || path[0] == '-')
+            return 0;
+        return 1;
+    }
 
     AppStuff(bool sender, int argc, char **argv):
         sender_role(sender), verbose(false), quiet(false), rcv_addr("0.0.0.0"), rcv_port(PORT), connect(false),
         json_output(false), max_pkt(PRAGUE_INITMTU), max_rate(PRAGUE_MAXRATE), data_tm(1), ack_tm(1),
         rept_tm(REPT_PERIOD), rept_int(REPT_PERIOD), rept_name(""),
         acc_bytes_sent(0), acc_bytes_rcvd(0), acc_rtts(0), count_rtts(0), prev_pkts(0), prev_marks(0), prev_losts(0),
-        rfc8888_ack(false), rfc8888_ackperiod(RFC8888_ACKPERIOD),
-        rt_mode(false), rt_fps(FRAME_PER_SECOND), rt_frameduration(FRAME_DURATION)
+        reordered(0), prev_reordered(0), spurious(0), prev_spurious(0), reo_wnd(0),
+        srtt(0), rttvar(0), min_rtt(0), qdelay(0), gap_tm(0), fb_tm(0), start_tm(0), last_tm(0),
+        wake_miss(0), total_wake_miss(0), timer_slack(0),
+        rfc8888_ack(false), rfc8888_ackperiod(RFC8888_ACKPERIOD), rle_ack(false), ato_shift(RLE_ATO_SHIFT), ack_freq(false),
+        acks_per_rtt(PRAGUE_ACKSPERRTT), rack(false), max_timeouts(MAX_TIMEOUTS), shm_name(NULL), metrics_addr(NULL), snapshot(NULL),
+        trace_file(NULL), trace_size(TRACE_SIZE), record_file(NULL),
+        zerocopy(false), zerocopy_min(ZEROCOPY_MIN), file_name(NULL),
+        rt_mode(false), fec(FEC_NONE), fec_parity(FEC_PARITY), rt_deadline(0), rt_fps(FRAME_PER_SECOND), rt_frameduration(FRAME_DURATION)
     {
+        CpuClock(cpu_start, wall_start);
+        cpu_rept = cpu_start;
+        wall_rept = wall_start;
         parseArgs(argc, argv);
         printInfo();
+#ifndef _WIN32
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = app_stop_handler;  // no SA_RESTART, a blocking receive returns
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+#else
+        signal(SIGINT, app_stop_handler);
+        signal(SIGTERM, app_stop_handler);
+#endif
     }
+    bool Stopped() const { return app_stop != 0; }
     void parseArgs(int argc, char** argv)
     {
         const char *def_rcv_addr = rcv_addr;
@@ -107,7 +212,9 @@ struct AppStuff
             } else if (arg == "-m" && i + 1 < argc) {
                 char *p;
                 max_pkt = strtoull(argv[++i], &p, 10);
-                ExitIf(errno != 0 || *p != '\0', "Error during converting max packet size");
+                // data packets can be as large as a datagram, ACKs must fit the feedback buffers
+                ExitIf(errno != 0 || *p != '\0' || max_pkt < PRAGUE_MINMTU ||
+                       max_pkt > (sender_role ? MAX_DGRAM_SIZE : BUFFER_SIZE), "Error during converting max packet size");
             } else if (arg == "-i" && i + 1 < argc) {
                 char *p;
                 rept_int = strtoul(argv[++i], &p, 10);
@@ -122,7 +229,7 @@ struct AppStuff
                 char *filename = argv[++i];
                 ExitIf(valid_filename(filename) != 1, "Error during converting json filename");
                 json_output = true;
-                jw.init(filename, false); // Aappend file (true) or Overwrite file (false)
+                ExitIf(jw.init(filename, false) != 0, "Error opening json file"); // Append file (true) or Overwrite file (false)
             } else if (arg == "--name" && i + 1 < argc) {
                 char *name = argv[++i];
                 rept_name = name;
@@ -132,8 +239,67 @@ struct AppStuff
                 char *p;
                 rfc8888_ackperiod = strtoul(argv[++i], &p, 10);
                 ExitIf(errno != 0 || *p != '\0', "Error during converting RFC8888 ACK period");
+            } else if (arg == "--rfc8888rle") {
+                rfc8888_ack = true;
+                rle_ack = true;
+            } else if (arg == "--atoshift" && i + 1 < argc) {
+                char *p;
+                ato_shift = uint8_t(strtoul(argv[++i], &p, 10));
+                ExitIf(errno != 0 || *p != '\0' || ato_shift > RLE_MAX_ATO_SHIFT, "Error during converting ATO shift");
+            } else if (arg == "--ackfreq") {
+                ack_freq = true;
+            } else if (arg == "--acksperrtt" && i + 1 < argc && sender_role) {
+                char *p;
+                acks_per_rtt = strtoul(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0' || acks_per_rtt < 1, "Error during converting ACKs per RTT");
+            } else if (arg == "--rack") {
+                rack = true;
+            } else if (arg == "--maxtimeouts" && i + 1 < argc) {
+                char *p;
+                max_timeouts = strtoul(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0', "Error during converting max timeouts");
+            } else if (arg == "--shm" && i + 1 < argc) {
+                shm_name = argv[++i];
+                ExitIf(valid_filename(shm_name) != 1, "Error during converting shared memory name");
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                metrics_addr = argv[++i];
+            } else if (arg == "--trace" && i + 1 < argc) {
+                trace_file = argv[++i];
+                ExitIf(valid_path(trace_file) != 1, "Error during converting trace filename");
+            } else if (arg == "--tracesize" && i + 1 < argc) {
+                char *p;
+                trace_size = strtoull(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0' || trace_size < 1, "Error during converting trace size");
+            } else if (arg == "--record" && i + 1 < argc && sender_role) {
+                record_file = argv[++i];
+                ExitIf(valid_path(record_file) != 1, "Error during converting record filename");
+            } else if (arg == "--zerocopy" && sender_role) {
+                zerocopy = true;
+            } else if (arg == "--zerocopymin" && i + 1 < argc && sender_role) {
+                char *p;
+                zerocopy_min = strtoull(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0' || zerocopy_min < 1, "Error during converting zero-copy min size");
+            } else if (arg == "--file" && i + 1 < argc) {
+                file_name = argv[++i];
+                ExitIf(valid_path(file_name) != 1, "Error during converting file name");
+            } else if (arg == "--timerslack" && i + 1 < argc) {
+                char *p;
+                timer_slack = strtoul(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0', "Error during converting timer slack");
             } else if (arg == "--rtmode") {
                 rt_mode = true;
+            } else if (arg == "--fec" && i + 1 < argc && sender_role) {
+                std::string scheme = argv[++i];
+                fec = (scheme == "xor") ? FEC_XOR : (scheme == "rs") ? FEC_RS : FEC_NONE;
+                ExitIf(fec == FEC_NONE, "Error during converting FEC scheme");
+            } else if (arg == "--fecparity" && i + 1 < argc && sender_role) {
+                char *p;
+                fec_parity = strtoul(argv[++i], &p, 10);
+                ExitIf(errno != 0 || *p != '\0' || fec_parity < 1 || fec_parity > 90, "Error during converting FEC parity share");
+            } else if (arg == "--deadline" && i + 1 < argc) {
+                char *p;
+                rt_deadline = time_tp(strtol(argv[++i], &p, 10));
+                ExitIf(errno != 0 || *p != '\0' || rt_deadline < 0, "Error during converting RT mode frame deadline");
             } else if (arg == "--fps" && i + 1 < argc) {
                 char *p;
                 rt_fps = strtoul(argv[++i], &p, 10);
@@ -148,7 +314,7 @@ struct AppStuff
                        "    -p <server port, def: %s>\n"
                        "    -c (connect first as a client, otherwise bind and wait for connection)\n"
                        "    -b <sender specific max bitrate, def: %s kbps>\n"
-                       "    -m <max packet/ACK size, def: %s B>\n"
+                       "    -m <max packet/ACK size, up to 65507 B data (sender) or 8192 B ACKs (receiver), def: %s B>\n"
                        "    -v (for verbose prints)\n"
                        "    -i <report interval, def: %s us>"
                        "    -j <json_filename, otherwise use stdout>\n"
@@ -156,13 +322,31 @@ struct AppStuff
                        "    -q (quiet)\n"
                        "    --rfc8888 (RFC8888 feddback)\n"
                        "    --rfc8888ackperiod <RFC8888 ACK period, def %s us>\n"
+                       "    --rfc8888rle (run-length compressed RFC8888 feedback)\n"
+                       "    --atoshift <run-length compressed ATO resolution of 2^n us, def %s>\n"
+                       "    --ackfreq (sender requests ACK thinning or an adaptive RFC8888 period based on its window, rate and RTT)\n"
+                       "    --acksperrtt <sender targets these ACKs or RFC8888 feedback packets per RTT with --ackfreq, def %s>\n"
+                       "    --rack (sender finds losses time-based, tolerating reordering, and reports the reordering)\n"
+                       "    --maxtimeouts <consecutive retransmission timeouts before the sender stops, 0 never stops, def %s>\n"
+                       "    --shm <publish lock-free PragueCC state snapshots in this shared-memory segment>\n"
+                       "    --metrics <OpenMetrics endpoint on this loopback TCP port, or unix:<socket path>>\n"
+                       "    --trace <binary per-packet trace file, convert with udp_prague_trace>\n"
+                       "    --tracesize <binary trace ring size, def %s records>\n"
+                       "    --record <sender PragueCC input recording (and <file>.golden), replay with udp_prague_replay>\n"
+                       "    --zerocopy (sender sends large payloads with MSG_ZEROCOPY (Linux))\n"
+                       "    --zerocopymin <smallest payload sent with --zerocopy, def %s B>\n"
+                       "    --file <sender transfers this file reliably, the receiver writes it to this file>\n"
+                       "    --timerslack <timer slack of the sleeps in ns, def: the system default (Linux)>\n"
                        "    --rtmode (Real-Time mode)\n"
+                       "    --fec <xor|rs, sender protects the frames with XOR or Reed-Solomon parity packets (Real-Time mode)>\n"
+                       "    --fecparity <parity share of the packets of a frame with --fec, def %s%%>\n"
+                       "    --deadline <latency budget of a frame in us, the sender drops and the receiver skips late frames (Real-Time mode), def: none>\n"
                        "    --fps <Frame-per-second, def %s fps>\n"
                        "    --frameduration <Frame duration, def %s us>\n",
                        sender_role ? "sender" : "receiver", C_STR(PORT),
                        C_STR(PRAGUE_MAXRATE / 125), C_STR(PRAGUE_INITMTU), C_STR(REPT_PERIOD),
                        sender_role ? "sender" : "receiver",
-                       C_STR(RFC8888_ACKPERIOD), C_STR(FRAME_PER_SECOND), C_STR(FRAME_DURATION));
+                       C_STR(RFC8888_ACKPERIOD), C_STR(RLE_ATO_SHIFT), C_STR(PRAGUE_ACKSPERRTT), C_STR(MAX_TIMEOUTS), C_STR(TRACE_SIZE), C_STR(ZEROCOPY_MIN), C_STR(FEC_PARITY), C_STR(FRAME_PER_SECOND), C_STR(FRAME_DURATION));
                 exit(1);
             }
         }
@@ -174,6 +358,36 @@ struct AppStuff
             rept_name = sender_role ? "sender" : "receiver";
         if (rt_mode && rt_fps * rt_frameduration > 1000000)
             rt_frameduration = 1000000 / rt_fps;
+        ExitIf(rt_mode && file_name && sender_role, "A file transfer is not supported in Real-Time mode");
+        ExitIf(fec && !rt_mode, "FEC is only supported in Real-Time mode");
+        ExitIf(rt_deadline && !rt_mode && sender_role, "Frame deadlines are only supported in Real-Time mode");
+        // a frame is paced out over its frame duration
+        ExitIf(rt_deadline && sender_role && rt_deadline <= time_tp(rt_frameduration),
+               "The frame deadline must be longer than the frame duration");
+        if (timer_slack) {
+#ifdef __linux__
+            ExitIf(prctl(PR_SET_TIMERSLACK, (unsigned long)timer_slack, 0, 0, 0) < 0, "Error setting the timer slack");
+#else
+            ExitIf(true, "The timer slack is only supported on Linux");
+#endif
+        }
+        if (trace_file)
+            trace.Create(trace_file, trace_size, sender_role, rt_mode, rfc8888_ack);
+        if (shm_name)
+            snapshot = shm.Create(shm_name);
+        if (metrics_addr) {
+#ifndef _WIN32
+            if (!snapshot) {
+                local_snapshot.init();
+                snapshot = &local_snapshot;
+            }
+            metrics.init();
+            metrics_server.Start(metrics_addr, (rept_name && *rept_name) ? rept_name : (sender_role ? "sender" : "receiver"),
+                                 sender_role, snapshot, &metrics);
+#else
+            ExitIf(true, "The metrics endpoint is not supported on Windows");
+#endif
+        }
     }
     void printInfo()
     {
@@ -211,6 +425,15 @@ struct AppStuff
     void LogSendData(time_tp now, time_tp timestamp, time_tp echoed_timestamp, count_tp seqnr, size_tp pkt_size, rate_tp pacing_rate,
                      count_tp pkt_window, count_tp pkt_burst, count_tp pkt_inflight, count_tp pkt_inburst, time_tp nextSend)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_send, now, rt_mode);
+            rec.u = pacing_rate;
+            rec.v[0] = timestamp; rec.v[1] = echoed_timestamp; rec.v[2] = seqnr; rec.v[3] = int32_t(pkt_size);
+            rec.v[4] = pkt_window; rec.v[5] = pkt_burst; rec.v[6] = pkt_inflight; rec.v[7] = pkt_inburst;
+            rec.v[8] = nextSend - now;
+        }
+        if (!pkt_inburst)
+            LogGap(now);
         if (verbose) {
             // "s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size,,,,, "
             // "pacing_rate, packet_window, packet_burst, packet_inflight, packet_inburst, nextSend"
@@ -225,6 +448,15 @@ struct AppStuff
                           rate_tp pacing_rate, count_tp frm_window, count_tp frm_size, count_tp pkt_burst,
                           count_tp frm_inflight, count_tp frm_sent, count_tp pkt_inburst, time_tp nextSend)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_send_frame, now, rt_mode);
+            rec.u = pacing_rate;
+            rec.v[0] = timestamp; rec.v[1] = echoed_timestamp; rec.v[2] = seqnr; rec.v[3] = int32_t(pkt_size);
+            rec.v[4] = frm_window; rec.v[5] = frm_size; rec.v[6] = pkt_burst; rec.v[7] = frm_inflight;
+            rec.v[8] = frm_sent; rec.v[9] = pkt_inburst; rec.v[10] = nextSend - now;
+        }
+        if (!pkt_inburst)
+            LogGap(now);
         if (verbose) {
             // "s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size,,,,, "
             // "pacing_rate, frame_window, frame_size, packet_burst, frame_inflight, frame_sent, packet_inburst, nextSend"
@@ -241,6 +473,15 @@ struct AppStuff
                     count_tp frm_window = 0, count_tp frm_inflight = 0, bool frm_sending = false, count_tp sent_frm = 0,
                     count_tp lost_frm = 0, count_tp recv_frm = 0)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_recv_ack, now, rt_mode);
+            rec.u = bytes_received;
+            rec.v[0] = timestamp; rec.v[1] = echoed_timestamp;
+            TraceFeedback(rec, seqnr, pkts_received, pkts_CE, pkts_lost, error_L4S, pkt_inflight, pkt_inburst, nextSend - now,
+                          frm_inflight, frm_sending, sent_frm, lost_frm, recv_frm);
+        }
+        LogFeedback(now);
+        LogLatency(now - echoed_timestamp, true);
         if (verbose) {
             if (!rt_mode) {
                 // "r: time, timestamp, echoed_timestamp, time_diff, seqnr, bytes_received, pkts_received, pkts_CE, "
@@ -273,6 +514,16 @@ struct AppStuff
                            count_tp pkt_inburst, time_tp nextSend, count_tp frm_window = 0, count_tp frm_inflight = 0,
                            bool frm_sending = false, count_tp sent_frm = 0, count_tp lost_frm = 0, count_tp recv_frm = 0)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_recv_rfc8888, now, rt_mode);
+            rec.u = bytes_received;
+            rec.v[0] = begin_seq; rec.v[1] = num_reports;
+            TraceFeedback(rec, seqnr, pkts_received, pkts_CE, pkts_lost, error_L4S, pkt_inflight, pkt_inburst, nextSend - now,
+                          frm_inflight, frm_sending, sent_frm, lost_frm, recv_frm);
+        }
+        LogFeedback(now);
+        for (uint16_t i = 0; i < num_rtt; i++)
+            LogLatency(pkts_rtt[i], true);
         if (verbose) {
             if (!rt_mode) {
                 // "r: time, begin_seq, num_reports, time_diff, seqnr, bytes_received, pkts_received, pkts_CE, pkts_lost, "
@@ -301,6 +552,102 @@ struct AppStuff
                             pkt_inburst, frm_window, frm_inflight);
         }
     }
+    void TraceFeedback(trace_rec_t &rec, count_tp seqnr, count_tp pkts_received, count_tp pkts_CE, count_tp pkts_lost,
+                       bool error_L4S, count_tp pkt_inflight, count_tp pkt_inburst, time_tp next, count_tp frm_inflight,
+                       bool frm_sending, count_tp sent_frm, count_tp lost_frm, count_tp recv_frm)
+    {
+        rec.v[2] = seqnr; rec.v[3] = pkts_received; rec.v[4] = pkts_CE; rec.v[5] = pkts_lost; rec.v[6] = error_L4S;
+        if (!rt_mode) {
+            rec.v[7] = pkt_inflight; rec.v[8] = pkt_inburst; rec.v[9] = next;
+        } else {
+            rec.v[7] = frm_inflight; rec.v[8] = frm_sending; rec.v[9] = sent_frm; rec.v[10] = lost_frm;
+            rec.v[11] = recv_frm; rec.v[12] = next;
+        }
+    }
+    void LogCCState(time_tp now, const PragueState &state)
+    {
+        if (snapshot) {
+            snapshot->publish(state, now);
+            if (metrics_addr)
+                metrics.observe(state, sender_role);
+        }
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_cc_state, now, rt_mode);
+            rec.u = state.m_pacing_rate;
+            rec.v[0] = state.m_packet_window; rec.v[1] = state.m_packet_burst; rec.v[2] = int32_t(state.m_packet_size);
+            rec.v[3] = state.m_srtt; rec.v[4] = state.m_rttvar; rec.v[5] = state.m_min_rtt; rec.v[6] = state.m_qdelay;
+            rec.v[7] = int32_t(state.m_alpha); rec.v[8] = state.m_cc_state; rec.v[9] = state.m_cca_mode;
+            rec.v[10] = state.m_packets_sent; rec.v[11] = state.m_packets_received; rec.v[12] = state.m_packets_CE;
+            rec.v[13] = state.m_packets_lost;
+        }
+    }
+    void LogReordering(count_tp pkts_reordered, count_tp pkts_spurious, time_tp reorder_window)
+    {
+        reordered = pkts_reordered;
+        spurious = pkts_spurious;
+        reo_wnd = reorder_window;
+    }
+    void LogGap(time_tp now)
+    {
+        if (gap_tm)
+            hist_gap.Record(now - gap_tm);
+        else
+            start_tm = now;
+        gap_tm = now;
+        last_tm = now;
+    }
+    void LogFeedback(time_tp now)
+    {
+        if (fb_tm)
+            hist_ack.Record(now - fb_tm);
+        fb_tm = now;
+        last_tm = now;
+    }
+    void LogLatency(time_tp rtt, bool with_qdelay)
+    {
+        hist_rtt.Record(rtt);
+        if (with_qdelay)
+            hist_qdelay.Record(rtt - min_rtt);
+    }
+    void LogWake(time_tp now, time_tp deadline)
+    {
+        hist_wake.Record(now - deadline);
+        if (now - deadline > WAKE_MISS)
+            wake_miss++;
+    }
+    // process CPU time (all threads) and monotonic wall time in us
+    static void CpuClock(int64_t &cpu, int64_t &wall)
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+        cpu = int64_t(((uint64_t(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+                       (uint64_t(user.dwHighDateTime) << 32 | user.dwLowDateTime)) / 10);
+#else
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        cpu = int64_t(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+        wall = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // CPU utilization in % of one core since the last report (or since the start)
+    float CpuUtil(bool since_start)
+    {
+        int64_t cpu, wall;
+        CpuClock(cpu, wall);
+        int64_t d_cpu = cpu - (since_start ? cpu_start : cpu_rept);
+        int64_t d_wall = wall - (since_start ? wall_start : wall_rept);
+        cpu_rept = cpu;
+        wall_rept = wall;
+        return (d_wall > 0) ? 100.0f * d_cpu / d_wall : 0.0f;
+    }
+    void LogRTT(const PragueState &stats)
+    {
+        srtt = stats.m_srtt;
+        rttvar = stats.m_rttvar;
+        min_rtt = stats.m_min_rtt;
+        qdelay = stats.m_qdelay;
+    }
     void PrintSender(time_tp now, count_tp pkts_received, count_tp pkts_CE, count_tp pkts_lost, rate_tp pacing_rate,
                      count_tp pkt_window, count_tp pkt_burst, count_tp pkt_inflight, count_tp pkt_inburst,
                      count_tp frm_window = 0, count_tp frm_inflight = 0)
@@ -315,18 +662,30 @@ struct AppStuff
             if (!rt_mode) {
                 printf("[SENDER]: %.2f sec, Sent: %.3f Mbps, Rcvd: %.3f Mbps, RTT: %.3f ms, Mark: %.2f%%(%d/%d), "
                        "Lost: %.2f%%(%d/%d), Pacing rate: %.3f Mbps, InFlight/W: %d/%d packets, "
-                       "InBurst/B: %d/%d packets\n",
+                       "InBurst/B: %d/%d packets",
                        now / 1000000.0f, rate_sent, rate_rcvd, rtt, mark_prob, pkts_CE - prev_marks, pkts_received - prev_pkts,
                        loss_prob, pkts_lost - prev_losts, pkts_received - prev_pkts, rate_pacing, pkt_inflight, pkt_window,
                        pkt_inburst, pkt_burst);
             } else {
                 printf("[RT-SENDER]: %.2f sec, Sent: %.3f Mbps, Rcvd: %.3f Mbps, RTT: %.3f ms, Mark: %.2f%%(%d/%d), "
                        "Lost: %.2f%%(%d/%d), Pacing rate: %.3f Mbps, FrameInFlight/W: %d/%d frames, "
-                       "InFlight/W: %d/%d packets, InBurst/B: %d/%d packets\n",
+                       "InFlight/W: %d/%d packets, InBurst/B: %d/%d packets",
                        now / 1000000.0f, rate_sent, rate_rcvd, rtt, mark_prob, pkts_CE - prev_marks, pkts_received - prev_pkts,
                        loss_prob, pkts_lost - prev_losts, pkts_received - prev_pkts, rate_pacing, frm_inflight, frm_window,
                        pkt_inflight, pkt_window, pkt_inburst, pkt_burst);
             }
+            printf(", SRTT/Var: %.3f/%.3f ms, MinRTT: %.3f ms, QDelay: %.3f ms", srtt / 1000.0f, rttvar / 1000.0f,
+                   min_rtt / 1000.0f, qdelay / 1000.0f);
+            PrintPercentiles("RTT", hist_rtt);
+            PrintPercentiles("QDelay", hist_qdelay);
+            PrintPercentiles("Gap", hist_gap);
+            PrintPercentiles("ACK gap", hist_ack);
+            PrintPercentiles("Wake late", hist_wake);
+            printf(", Missed: %d, CPU: %.1f%%", wake_miss, CpuUtil(false));
+            if (rack)
+                printf(", Reordered: %d, Spurious: %d, ReoWnd: %.3f ms", reordered - prev_reordered, spurious - prev_spurious,
+                       reo_wnd / 1000.0f);
+            printf("\n");
         } else {
             jw.reset();
             jw.field("name", rept_name);
@@ -338,6 +697,10 @@ struct AppStuff
             jw.field("sent_rate", rate_sent);
             jw.field("rcvd_rate", rate_rcvd);
             jw.field("rtt", rtt);
+            jw.field("srtt", srtt);
+            jw.field("rttvar", rttvar);
+            jw.field("min_rtt", min_rtt);
+            jw.field("qdelay", qdelay);
             jw.field("mark_prob", mark_prob);
             jw.field("loss_prob", loss_prob);
             jw.field("pkt_rcvd", pkts_received - prev_pkts);
@@ -352,6 +715,18 @@ struct AppStuff
             jw.field("pkt_window", pkt_window);
             jw.field("pkt_inburst", pkt_inburst);
             jw.field("pkt_burst", pkt_burst);
+            if (rack) {
+              jw.field("pkt_reordered", reordered - prev_reordered);
+              jw.field("pkt_spurious", spurious - prev_spurious);
+              jw.field("reo_wnd", reo_wnd);
+            }
+            JsonPercentiles("rtt", hist_rtt);
+            JsonPercentiles("qdelay", hist_qdelay);
+            JsonPercentiles("gap", hist_gap);
+            JsonPercentiles("ack", hist_ack);
+            JsonPercentiles("wake", hist_wake);
+            jw.field("wake_miss", wake_miss);
+            jw.field("cpu", CpuUtil(false));
             jw.finalize();
             jw.dump();
         }
@@ -363,9 +738,20 @@ struct AppStuff
         prev_pkts = pkts_received;
         prev_marks = pkts_CE;
         prev_losts = pkts_lost;
+        prev_reordered = reordered;
+        prev_spurious = spurious;
+        NextPercentiles();
     }
     void LogRecvData(time_tp now, time_tp timestamp, time_tp echoed_timestamp, count_tp seqnr, size_tp bytes_received)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_recv_data, now, rt_mode);
+            rec.u = bytes_received;
+            rec.v[0] = timestamp; rec.v[1] = echoed_timestamp; rec.v[2] = seqnr;
+        }
+        LogGap(now);
+        if (echoed_timestamp && !rfc8888_ack)
+            LogLatency(now - echoed_timestamp, false);
         if (verbose) {
             // "r: time, timestamp, echoed_timestamp, time_diff, seqnr, bytes_received"
             printf("r: %d, %d, %d, %d, %d, %s\n",
@@ -383,6 +769,13 @@ struct AppStuff
     void LogSendACK(time_tp now, time_tp timestamp, time_tp echoed_timestamp, count_tp seqnr, size_tp packet_size,
                     count_tp pkts_received, count_tp pkts_CE, count_tp pkts_lost, bool error_L4S)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_send_ack, now, rt_mode);
+            rec.u = packet_size;
+            rec.v[0] = timestamp; rec.v[1] = echoed_timestamp; rec.v[2] = seqnr; rec.v[3] = pkts_received;
+            rec.v[4] = pkts_CE; rec.v[5] = pkts_lost; rec.v[6] = error_L4S;
+        }
+        LogFeedback(now);
         if (verbose) {
             // "s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size, pkts_received, pkts_CE, pkts_lost, error_L4S"
             printf("s: %d, %d, %d, %d, %d, %s, %d, %d, %d, %d\n",
@@ -399,6 +792,12 @@ struct AppStuff
     }
     void LogSendRFC8888ACK(time_tp now, count_tp seqnr, size_tp packet_size, count_tp begin_seq, uint16_t num_reports, uint16_t *report)
     {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_send_rfc8888, now, rt_mode);
+            rec.u = packet_size;
+            rec.v[0] = seqnr; rec.v[1] = begin_seq; rec.v[2] = num_reports;
+        }
+        LogFeedback(now);
         if (verbose) {
             // "s: time, time_diff, seqnr, packet_size, begin_seq, num_reports, pkts_received, pkts_CE, pkts_lost, error_L4S"
             printf("s: %d, %d, %d, %s, %d, %d, \n",
@@ -422,6 +821,33 @@ struct AppStuff
                 PrintReceiver(now, 0, 0, 0);
         }
     }
+    void LogSendRLEACK(time_tp now, count_tp seqnr, size_tp packet_size, count_tp begin_seq, uint16_t num_reports, uint16_t num_runs,
+                       count_tp rcvd, count_tp marks, count_tp losts, rate_tp ato_sum)
+    {
+        if (trace.Active()) {
+            trace_rec_t &rec = trace.Next(trc_send_rle, now, rt_mode);
+            rec.u = packet_size;
+            rec.v[0] = seqnr; rec.v[1] = begin_seq; rec.v[2] = num_reports; rec.v[3] = num_runs;
+        }
+        LogFeedback(now);
+        if (verbose) {
+            // "s: time, time_diff, seqnr, packet_size, begin_seq, num_reports, num_runs"
+            printf("s: %d, %d, %d, %s, %d, %d, %d\n",
+                now, now - ack_tm, seqnr, C_STR(packet_size), begin_seq, num_reports, num_runs);
+            ack_tm = now;
+        }
+        if (!quiet) {
+            // Display receiver side info
+            acc_bytes_sent += packet_size;
+            acc_rtts += ato_sum;
+            count_rtts += rcvd;
+            prev_pkts += rcvd;
+            prev_marks += marks;
+            prev_losts += losts;
+            if (now - rept_tm >= 0)
+                PrintReceiver(now, 0, 0, 0);
+        }
+    }
     void PrintReceiver(time_tp now, count_tp pkts_received = 0, count_tp pkts_CE = 0, count_tp pkts_lost = 0)
     {
         float rate_rcvd = 8.0f * acc_bytes_rcvd / (now - rept_tm + rept_int);
@@ -434,11 +860,16 @@ struct AppStuff
                           ((pkts_received - prev_pkts > 0) ? 100.0f * (pkts_lost - prev_losts) / (pkts_received - prev_pkts) : 0.0f) :
                           ((prev_pkts > 0) ? 100.0f * (prev_losts) / (prev_pkts) : 0.0f);
         if (!json_output) {
-            printf("[RECVER]: %.2f sec, Rcvd: %.3f Mbps, Sent: %.3f Mbps, %s: %.3f ms, Mark: %.2f%%(%d/%d), Lost: %.2f%%(%d/%d)\n",
+            printf("[RECVER]: %.2f sec, Rcvd: %.3f Mbps, Sent: %.3f Mbps, %s: %.3f ms, Mark: %.2f%%(%d/%d), Lost: %.2f%%(%d/%d)",
                    now / 1000000.0f, rate_rcvd, rate_sent, (!rfc8888_ack)? "RTT": "ATO", rtt,
                    mark_prob, (!rfc8888_ack) ? (pkts_CE - prev_marks) : prev_marks,
                    (!rfc8888_ack) ? (pkts_received - prev_pkts) : prev_pkts, loss_prob,
                    (!rfc8888_ack) ? (pkts_lost - prev_losts) : prev_losts, (!rfc8888_ack) ? (pkts_received - prev_pkts) : prev_pkts);
+            if (!rfc8888_ack)
+                PrintPercentiles("RTT", hist_rtt);
+            PrintPercentiles("Gap", hist_gap);
+            PrintPercentiles("ACK gap", hist_ack);
+            printf(", CPU: %.1f%%\n", CpuUtil(false));
         } else {
               jw.reset();
               jw.field("name", rept_name);
@@ -458,6 +889,11 @@ struct AppStuff
                       (!rfc8888_ack) ? (pkts_CE - prev_marks) : prev_marks);
               jw.field("pkt_lost",
                       (!rfc8888_ack) ? (pkts_lost - prev_losts) : prev_losts);
+              if (!rfc8888_ack)
+                JsonPercentiles("rtt", hist_rtt);
+              JsonPercentiles("gap", hist_gap);
+              JsonPercentiles("ack", hist_ack);
+              jw.field("cpu", CpuUtil(false));
               jw.finalize();
               jw.dump();
       }
@@ -469,6 +905,195 @@ struct AppStuff
         prev_pkts = (!rfc8888_ack) ? pkts_received : 0;
         prev_marks = (!rfc8888_ack) ? pkts_CE : 0;
         prev_losts = (!rfc8888_ack) ? pkts_lost : 0;
+        NextPercentiles();
+    }
+    // ", RTT p50/90/99/99.9/max: a/b/c/d/e ms"
+    void PrintPercentiles(const char *name, const HdrHistogram &h)
+    {
+        printf(", %s p50/90/99/99.9/max: %.3f/%.3f/%.3f/%.3f/%.3f ms", name, h.Percentile(50) / 1000.0f,
+               h.Percentile(90) / 1000.0f, h.Percentile(99) / 1000.0f, h.Percentile(99.9) / 1000.0f, h.Max() / 1000.0f);
+    }
+    // "<prefix>_p50", "<prefix>_p90", "<prefix>_p99", "<prefix>_p999" and "<prefix>_max" in us
+    void JsonPercentiles(const std::string &prefix, const HdrHistogram &h)
+    {
+        jw.field((prefix + "_p50").c_str(), h.Percentile(50));
+        jw.field((prefix + "_p90").c_str(), h.Percentile(90));
+        jw.field((prefix + "_p99").c_str(), h.Percentile(99));
+        jw.field((prefix + "_p999").c_str(), h.Percentile(99.9));
+        jw.field((prefix + "_max").c_str(), h.Max());
+    }
+    // merge the interval distributions in the totals and start the next interval
+    void NextPercentiles()
+    {
+        total_rtt.Add(hist_rtt);
+        total_qdelay.Add(hist_qdelay);
+        total_gap.Add(hist_gap);
+        total_ack.Add(hist_ack);
+        total_wake.Add(hist_wake);
+        total_wake_miss += wake_miss;
+        hist_rtt.Reset();
+        hist_qdelay.Reset();
+        hist_gap.Reset();
+        hist_ack.Reset();
+        hist_wake.Reset();
+        wake_miss = 0;
+    }
+    // latency percentiles over the whole run, at exit
+    void PrintSummary(time_tp now)
+    {
+        NextPercentiles();
+        if (!total_rtt.Count() && !total_gap.Count() && !total_ack.Count())
+            return;
+        if (!json_output) {
+            if (verbose)
+                return;  // keep the verbose output CSV only
+            printf("[%s SUMMARY]: %.2f sec", sender_role ? "SENDER" : "RECVER", (now - start_tm) / 1000000.0f);
+            if (sender_role || !rfc8888_ack)
+                PrintPercentiles("RTT", total_rtt);
+            if (sender_role)
+                PrintPercentiles("QDelay", total_qdelay);
+            PrintPercentiles("Gap", total_gap);
+            PrintPercentiles("ACK gap", total_ack);
+            if (sender_role) {
+                PrintPercentiles("Wake late", total_wake);
+                printf(", Missed: %d/%s", total_wake_miss, C_STR(total_wake.Count()));
+            }
+            printf(", CPU: %.1f%%, Samples RTT/Gap/ACK: %s/%s/%s\n", CpuUtil(true), C_STR(total_rtt.Count()),
+                   C_STR(total_gap.Count()), C_STR(total_ack.Count()));
+            fflush(stdout);
+        } else {
+            jw.reset();
+            jw.field("name", rept_name);
+            jw.field("summary", std::string("exit"));
+            jw.field("time",
+                    uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count()));
+            jw.field("time_since_start", now);
+            jw.field("duration", now - start_tm);
+            if (sender_role || !rfc8888_ack)
+              JsonPercentiles("rtt", total_rtt);
+            if (sender_role)
+              JsonPercentiles("qdelay", total_qdelay);
+            JsonPercentiles("gap", total_gap);
+            JsonPercentiles("ack", total_ack);
+            if (sender_role) {
+              JsonPercentiles("wake", total_wake);
+              jw.field("wake_miss", total_wake_miss);
+              jw.field("wake_count", total_wake.Count());
+            }
+            jw.field("cpu", CpuUtil(true));
+            jw.field("rtt_count", total_rtt.Count());
+            jw.field("gap_count", total_gap.Count());
+            jw.field("ack_count", total_ack.Count());
+            jw.field("json_dropped", jw.dropped);  // lines before this one that were lost because the disk was too slow
+            jw.finalize();
+            jw.dump(true);
+            if (jw.dropped)
+                fprintf(stderr, "JSON writer dropped %s lines, the disk could not keep up\n", C_STR(jw.dropped));
+        }
+    }
+    // file transfer result at exit: the goodput counts the file bytes once, the throughput all bytes on the wire
+    // (headers, retransmissions at the sender, duplicates at the receiver)
+    void PrintTransfer(uint64_t file_size, uint64_t wire_bytes, int64_t duration, count_tp chunks, count_tp copies, bool complete)
+    {
+        float secs = duration / 1000000.0f;
+        float goodput = duration ? file_size * 8.0f / duration : 0;
+        float throughput = duration ? wire_bytes * 8.0f / duration : 0;
+        if (!json_output) {
+            if (quiet)
+                return;
+            printf("[%s FILE]: %s B in %.3f sec, %s, Goodput: %.3f Mbps, Throughput: %.3f Mbps, Chunks: %d, %s: %d (%.2f%%)\n",
+                   sender_role ? "SENDER" : "RECVER", C_STR(file_size), secs, complete ? "complete" : "INCOMPLETE",
+                   goodput, throughput, chunks, sender_role ? "Retransmitted" : "Duplicates", copies,
+                   chunks ? copies * 100.0f / chunks : 0.0f);
+            fflush(stdout);
+        } else {
+            jw.reset();
+            jw.field("name", rept_name);
+            jw.field("summary", std::string("file"));
+            jw.field("file_size", file_size);
+            jw.field("wire_bytes", wire_bytes);
+            jw.field("duration", secs);
+            jw.field("complete", int32_t(complete));
+            jw.field("goodput", goodput);
+            jw.field("throughput", throughput);
+            jw.field("chunks", chunks);
+            jw.field(sender_role ? "retransmitted" : "duplicates", copies);
+            jw.finalize();
+            jw.dump(true);
+        }
+    }
+    // frames the receiver repaired with FEC, at exit
+    void PrintFec(const fec_stats_t &fs)
+    {
+        if (!json_output) {
+            if (quiet)
+                return;
+            printf("[RECVER FEC]: Frames: %d, complete: %d, recovered: %d, lost: %d (%.2f%%), Packets recovered: %d, "
+                   "Parity received: %d, Late/duplicate: %d\n", fs.frames, fs.complete, fs.recovered, fs.lost,
+                   fs.frames ? fs.lost * 100.0f / fs.frames : 0.0f, fs.pkts_recovered, fs.parity, fs.late);
+            fflush(stdout);
+        } else {
+            jw.reset();
+            jw.field("name", rept_name);
+            jw.field("summary", std::string("fec"));
+            jw.field("frames", fs.frames);
+            jw.field("frames_complete", fs.complete);
+            jw.field("frames_recovered", fs.recovered);
+            jw.field("frames_lost", fs.lost);
+            jw.field("pkts_recovered", fs.pkts_recovered);
+            jw.field("parity", fs.parity);
+            jw.field("late", fs.late);
+            jw.finalize();
+            jw.dump(true);
+        }
+    }
+    // the frames the receiver released in time, or skipped at their deadline
+    void PrintDeadline(const deadline_stats_t &ds)
+    {
+        if (!json_output) {
+            if (quiet)
+                return;
+            printf("[RECVER DEADLINE]: Frames: %d, on time: %d (%.2f%%), late: %d, dropped: %d, Late packets discarded: %d\n",
+                   ds.frames, ds.ontime, ds.frames ? ds.ontime * 100.0f / ds.frames : 0.0f, ds.late, ds.dropped,
+                   ds.late_pkts);
+            fflush(stdout);
+        } else {
+            jw.reset();
+            jw.field("name", rept_name);
+            jw.field("summary", std::string("deadline"));
+            jw.field("frames", ds.frames);
+            jw.field("frames_ontime", ds.ontime);
+            jw.field("frames_late", ds.late);
+            jw.field("frames_dropped", ds.dropped);
+            jw.field("late_pkts", ds.late_pkts);
+            jw.finalize();
+            jw.dump(true);
+        }
+    }
+    // the frames the sender dropped before they were sent completely
+    void PrintDeadline(const frame_drop_stats_t &ds)
+    {
+        if (!json_output) {
+            if (quiet)
+                return;
+            printf("[SENDER DEADLINE]: Frames: %d, sent: %d, dropped: %d (%.2f%%, partially sent: %d), skipped: %d\n",
+                   ds.frames, ds.sent, ds.dropped, ds.frames ? ds.dropped * 100.0f / ds.frames : 0.0f, ds.partial,
+                   ds.skipped);
+            fflush(stdout);
+        } else {
+            jw.reset();
+            jw.field("name", rept_name);
+            jw.field("summary", std::string("deadline"));
+            jw.field("frames", ds.frames);
+            jw.field("frames_sent", ds.sent);
+            jw.field("frames_dropped", ds.dropped);
+            jw.field("frames_partial", ds.partial);
+            jw.field("frames_skipped", ds.skipped);
+            jw.finalize();
+            jw.dump(true);
+        }
     }
 };
 
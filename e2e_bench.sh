@@ -0,0 +1,201 @@
+#!/bin/bash
+# e2e_bench.sh:
+# End-to-end benchmark of udp_prague_sender/receiver over a veth pair between two network namespaces, for a matrix of
+# bottleneck rates, RTTs, packet sizes, feedback modes and sender modes. The data direction is shaped with htb to the
+# rate, with a DualPI2 or fq_codel AQM (or none) below it, and netem delays the feedback direction by the RTT.
+# Throughput, latency percentiles, CE rate and CPU per Gbps of every run are collected in one JSON report.
+# Needs root (ip netns, tc). Called by "make e2e-bench", the matrix is set with environment (or make) variables:
+#   E2E_RATES     bottleneck rates in Mbps               def: "10 100"
+#   E2E_RTTS      base RTTs in ms                        def: "1 20"
+#   E2E_SIZES     max packet sizes in B                  def: "1400"
+#   E2E_FEEDBACK  ack (per-packet ACKs) and/or rfc8888   def: "ack rfc8888"
+#   E2E_MODES     bulk and/or rt (--rtmode)              def: "bulk rt"
+#   E2E_AQM       dualpi2, fq_codel or none              def: dualpi2
+#   E2E_DURATION  seconds per run                        def: 10
+#   E2E_WARMUP    seconds per run not in the rate stats  def: 2
+#   E2E_DEADLINE  frame latency budget in us of rt runs  def: 0 (none)
+#   E2E_REPORT    JSON report file                       def: e2e_report.json
+#
+
+RATES=${E2E_RATES:-"10 100"}
+RTTS=${E2E_RTTS:-"1 20"}
+SIZES=${E2E_SIZES:-"1400"}
+FEEDBACK=${E2E_FEEDBACK:-"ack rfc8888"}
+MODES=${E2E_MODES:-"bulk rt"}
+AQM=${E2E_AQM:-dualpi2}
+DURATION=${E2E_DURATION:-10}
+WARMUP=${E2E_WARMUP:-2}
+DEADLINE=${E2E_DEADLINE:-0}
+REPORT=${E2E_REPORT:-e2e_report.json}
+
+NS_SND=prague_e2e_snd
+NS_RCV=prague_e2e_rcv
+DEV_SND=e2e_snd
+DEV_RCV=e2e_rcv
+ADDR_SND=10.199.0.1
+ADDR_RCV=10.199.0.2
+PORT=8080
+
+BIN=$(cd "$(dirname "$0")" && pwd)
+CLK_TCK=$(getconf CLK_TCK)
+
+die()
+{
+    echo "e2e_bench: $*" >&2
+    exit 1
+}
+
+cleanup()
+{
+    ip netns del $NS_SND 2>/dev/null
+    ip netns del $NS_RCV 2>/dev/null
+    [ -n "$WORK" ] && rm -rf "$WORK"
+}
+
+[ "$(id -u)" = 0 ] || die "needs root for ip netns and tc"
+[ -x "$BIN/udp_prague_sender" ] && [ -x "$BIN/udp_prague_receiver" ] || die "build udp_prague_sender and udp_prague_receiver first"
+case $AQM in
+dualpi2|fq_codel|none) ;;
+*) die "unknown E2E_AQM $AQM" ;;
+esac
+
+trap cleanup EXIT
+cleanup
+WORK=$(mktemp -d) || die "no temporary directory"
+ip netns add $NS_SND && ip netns add $NS_RCV || die "could not create the network namespaces"
+ip link add $DEV_SND netns $NS_SND type veth peer name $DEV_RCV netns $NS_RCV || die "could not create the veth pair"
+ip -n $NS_SND addr add $ADDR_SND/24 dev $DEV_SND
+ip -n $NS_RCV addr add $ADDR_RCV/24 dev $DEV_RCV
+ip -n $NS_SND link set $DEV_SND up
+ip -n $NS_RCV link set $DEV_RCV up
+ip -n $NS_SND link set lo up
+ip -n $NS_RCV link set lo up
+
+# find out which qdiscs this kernel has, missing ones are reported (and recorded) instead of failing the benchmark
+has_qdisc()
+{
+    ip netns exec $NS_SND tc qdisc replace dev $DEV_SND root "$@" 2>/dev/null && ip netns exec $NS_SND tc qdisc del dev $DEV_SND root
+}
+SHAPED=true
+has_qdisc htb default 1 || { SHAPED=false; echo "e2e_bench: no htb, the rate is limited by the sender (-b) instead" >&2; }
+if [ $AQM != none ] && ! has_qdisc $AQM; then
+    echo "e2e_bench: no $AQM qdisc, running without AQM" >&2
+    AQM=none
+fi
+DELAYED=true
+has_qdisc netem delay 1ms || { DELAYED=false; echo "e2e_bench: no netem, the RTT is not emulated" >&2; }
+
+setup_path()  # rate_mbps rtt_ms packet_size
+{
+    ip netns exec $NS_SND tc qdisc del dev $DEV_SND root 2>/dev/null
+    ip netns exec $NS_RCV tc qdisc del dev $DEV_RCV root 2>/dev/null
+    if $SHAPED; then
+        ip netns exec $NS_SND tc qdisc add dev $DEV_SND root handle 1: htb default 1
+        ip netns exec $NS_SND tc class add dev $DEV_SND parent 1: classid 1:1 htb rate ${1}mbit ceil ${1}mbit quantum $(($3 + 100))
+        [ $AQM != none ] && ip netns exec $NS_SND tc qdisc add dev $DEV_SND parent 1:1 handle 10: $AQM
+    elif [ $AQM != none ]; then
+        ip netns exec $NS_SND tc qdisc add dev $DEV_SND root $AQM
+    fi
+    if $DELAYED && [ "$2" != 0 ]; then
+        ip netns exec $NS_RCV tc qdisc add dev $DEV_RCV root netem delay ${2}ms limit 100000
+    fi
+}
+
+cpu_ticks()  # pid
+{
+    awk '{print $14 + $15}' /proc/$1/stat 2>/dev/null || echo 0
+}
+
+# field values of the JSON lines of the sender and receiver, averaged or summed after the warmup
+# prints: throughput_mbps ce_rate loss_rate intervals
+rate_stats()  # receiver json
+{
+    awk -v warmup=$((WARMUP * 1000000)) '
+    function f(name) { return match($0, "\"" name "\":[-0-9.e]+") ? substr($0, RSTART + length(name) + 3, RLENGTH - length(name) - 3) : 0 }
+    /"summary"/ { next }
+    f("time_since_start") > warmup { n++; rate += f("rcvd_rate"); rcvd += f("pkt_rcvd"); mark += f("pkt_mark"); lost += f("pkt_lost") }
+    END { printf "%.3f %.6f %.6f %d\n", n ? rate / n : 0, rcvd ? mark / rcvd : 0, rcvd + lost ? lost / (rcvd + lost) : 0, n }' "$1"
+}
+
+# the latency percentiles of the exit summary line, as JSON fields
+summary_fields()  # json prefix
+{
+    grep '"summary":"exit"' "$1" | grep -o '"\(rtt\|qdelay\|gap\|ack\)_\(p50\|p90\|p99\|p999\|max\)":[0-9-]*' |
+        sed "s/^\"/\"$2/" | paste -sd, -
+}
+
+# the frame counts of the deadline summary line, as JSON fields
+deadline_fields()  # json prefix
+{
+    grep '"summary":"deadline"' "$1" | grep -o '"\(frames[a-z_]*\|late_pkts\)":[0-9-]*' |
+        sed "s/^\"/\"$2/" | paste -sd, -
+}
+
+FIRST=true
+FAILED=0
+{
+    printf '{"version":1,"kernel":"%s","date":"%s","aqm":"%s","shaped":%s,"delayed":%s,"duration":%s,"warmup":%s,"runs":[\n' \
+        "$(uname -r)" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" $AQM $SHAPED $DELAYED $DURATION $WARMUP
+} > "$REPORT.tmp" || die "could not write $REPORT"
+
+for rate in $RATES; do
+for rtt in $RTTS; do
+for size in $SIZES; do
+for fb in $FEEDBACK; do
+for mode in $MODES; do
+    setup_path $rate $rtt $size
+    opts="-m $size"
+    [ $fb = rfc8888 ] && opts="$opts --rfc8888"
+    snd_opts="$opts"
+    rcv_opts="$opts"
+    [ $mode = rt ] && snd_opts="$snd_opts --rtmode"
+    if [ $mode = rt ] && [ "$DEADLINE" != 0 ]; then
+        snd_opts="$snd_opts --deadline $DEADLINE"
+        rcv_opts="$rcv_opts --deadline $DEADLINE"
+    fi
+    $SHAPED || snd_opts="$snd_opts -b $((rate * 1000))"
+    echo "e2e_bench: $rate Mbps, $rtt ms, $size B, $fb, $mode" >&2
+    rm -f "$WORK"/*.json
+    (cd "$WORK" && exec ip netns exec $NS_RCV "$BIN/udp_prague_receiver" -p $PORT $rcv_opts -j rcv.json >/dev/null) &
+    rcv=$!
+    sleep 0.5
+    (cd "$WORK" && exec ip netns exec $NS_SND "$BIN/udp_prague_sender" -a $ADDR_RCV -c -p $PORT $snd_opts -j snd.json >/dev/null) &
+    snd=$!
+    sleep $DURATION
+    snd_cpu=$(cpu_ticks $snd)
+    rcv_cpu=$(cpu_ticks $rcv)
+    kill -INT $snd 2>/dev/null
+    wait $snd 2>/dev/null
+    sleep 0.2
+    kill -INT $rcv 2>/dev/null
+    wait $rcv 2>/dev/null
+
+    if [ ! -s "$WORK/rcv.json" ] || [ ! -s "$WORK/snd.json" ]; then
+        echo "e2e_bench: no results for this run" >&2
+        FAILED=$((FAILED + 1))
+        continue
+    fi
+    read tput ce loss intervals < <(rate_stats "$WORK/rcv.json")
+    snd_lat=$(summary_fields "$WORK/snd.json" snd_)
+    rcv_lat=$(summary_fields "$WORK/rcv.json" rcv_)
+    snd_dl=$(deadline_fields "$WORK/snd.json" snd_)
+    rcv_dl=$(deadline_fields "$WORK/rcv.json" rcv_)
+    cpu=$(awk -v s=$snd_cpu -v r=$rcv_cpu -v hz=$CLK_TCK -v d=$DURATION -v t=$tput \
+          'BEGIN { c = (s + r) / hz / d; printf "%.4f %.4f %.4f", s / hz / d, r / hz / d, (t > 0) ? c / (t / 1000) : 0 }')
+    read snd_util rcv_util cpu_gbps <<< "$cpu"
+    $FIRST || printf ',\n' >> "$REPORT.tmp"
+    FIRST=false
+    printf '{"rate_mbps":%s,"rtt_ms":%s,"packet_size":%s,"feedback":"%s","mode":"%s","throughput_mbps":%s,"utilization":%s,"ce_rate":%s,"loss_rate":%s,"intervals":%s,"snd_cpu":%s,"rcv_cpu":%s,"cpu_per_gbps":%s%s%s%s%s}' \
+        $rate $rtt $size $fb $mode $tput "$(awk -v t=$tput -v r=$rate 'BEGIN { printf "%.4f", t / r }')" $ce $loss $intervals \
+        $snd_util $rcv_util $cpu_gbps "${snd_lat:+,$snd_lat}" "${rcv_lat:+,$rcv_lat}" \
+        "${snd_dl:+,$snd_dl}" "${rcv_dl:+,$rcv_dl}" >> "$REPORT.tmp"
+done
+done
+done
+done
+done
+
+printf '\n],"failed":%d}\n' $FAILED >> "$REPORT.tmp"
+mv "$REPORT.tmp" "$REPORT"
+echo "e2e_bench: report written to $REPORT" >&2
+[ $FAILED = 0 ]
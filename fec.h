@@ -0,0 +1,552 @@
+#ifndef FEC_H
+#define FEC_H
+
+// fec.h:
+// Forward error correction of RT-mode frames, repairing lost packets without waiting an RTT for a retransmission.
+// A frame is split in blocks of at most FEC_MAX_N packets: k data packets followed by m parity packets, all within the
+// frame size PragueCC gives. FEC_XOR adds one XOR parity per group of data packets (data packet i is in group i % m),
+// repairing one loss per group. FEC_RS adds m Cauchy Reed-Solomon parity packets over GF(2^8), repairing any m losses
+// of the block. The coded symbol of a data packet is its 2-byte payload length followed by the payload, zero-padded
+// to the largest of the block, so the receiver also recovers the length.
+// The GF(2^8) multiply-add uses AVX2, SSSE3 or (AArch64) NEON nibble-table lookups when the compiler targets them,
+// with a scalar fallback (build with -march=native to get them on x86).
+//
+
+#include <vector>
+#include <cstring>
+#include "prague_cc.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FEC_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define FEC_SSSE3
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define FEC_NEON
+#endif
+
+#define FEC_NONE   0
+#define FEC_XOR    1
+#define FEC_RS     2
+#define FEC_MAX_N  255        // packets per block, the Cauchy code needs distinct GF(2^8) elements per packet
+#define FEC_FRAMES 16         // frames the receiver repairs at the same time
+#define FEC_PARITY 20         // default parity share of the packets of a frame, in %
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D)
+struct gf_tables_t {
+    uint8_t exp[512];
+    uint8_t log[256];
+    uint8_t lo[256][16];      // c * x for the low nibble x
+    uint8_t hi[256][16];      // c * (x << 4) for the high nibble x
+
+    gf_tables_t()
+    {
+        uint32_t x = 1;
+        for (uint32_t i = 0; i < 255; i++) {
+            exp[i] = exp[i + 255] = uint8_t(x);
+            log[x] = uint8_t(i);
+            x <<= 1;
+            if (x & 0x100)
+                x ^= 0x11D;
+        }
+        exp[510] = exp[511] = exp[0];
+        log[0] = 0;
+        for (uint32_t c = 0; c < 256; c++) {
+            for (uint32_t n = 0; n < 16; n++) {
+                lo[c][n] = mul(uint8_t(c), uint8_t(n));
+                hi[c][n] = mul(uint8_t(c), uint8_t(n << 4));
+            }
+        }
+    }
+    uint8_t mul(uint8_t a, uint8_t b) const { return (a && b) ? exp[log[a] + log[b]] : 0; }
+    uint8_t inv(uint8_t a) const { return exp[255 - log[a]]; }
+};
+
+inline const gf_tables_t &gf()
+{
+    static const gf_tables_t tables;
+    return tables;
+}
+
+inline const char *fec_simd()
+{
+#if defined(FEC_AVX2)
+    return "AVX2";
+#elif defined(FEC_SSSE3)
+    return "SSSE3";
+#elif defined(FEC_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// dst ^= src
+inline void fec_xor(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {  // vectorized by the compiler
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+// dst ^= c * src in GF(2^8)
+inline void gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    if (c <= 1) {
+        if (c)
+            fec_xor(dst, src, len);
+        return;
+    }
+    const gf_tables_t &t = gf();
+    size_t i = 0;
+#if defined(FEC_AVX2)
+    const __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t.lo[c]));
+    const __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t.hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(s, mask)),
+                                     _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(dst + i)), p));
+    }
+#elif defined(FEC_SSSE3)
+    const __m128i tlo = _mm_loadu_si128((const __m128i *)t.lo[c]);
+    const __m128i thi = _mm_loadu_si128((const __m128i *)t.hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(s, mask)),
+                                  _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + i)), p));
+    }
+#elif defined(FEC_NEON)
+    const uint8x16_t tlo = vld1q_u8(t.lo[c]);
+    const uint8x16_t thi = vld1q_u8(t.hi[c]);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(s, mask)), vqtbl1q_u8(thi, vshrq_n_u8(s, 4)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+#endif
+    for (; i < len; i++)
+        dst[i] ^= t.lo[c][src[i] & 0x0F] ^ t.hi[c][src[i] >> 4];
+}
+
+// Cauchy matrix coefficient of data packet i in parity packet j: 1 / (x_j + y_i) with x_j = 255 - j and y_i = i,
+// distinct as long as k + m <= 256
+inline uint8_t fec_cauchy(uint32_t j, uint32_t i)
+{
+    return gf().inv(uint8_t((255 - j) ^ i));
+}
+
+// one packet of a planned frame
+struct fec_pkt_t {
+    uint8_t block;
+    uint8_t blocks;           // blocks of the frame
+    uint8_t k;
+    uint8_t m;
+    uint8_t index;            // data packet if below k
+    size_tp size;             // packet size, with the header
+};
+
+// Plans the packets of a frame and computes the parity of each block while its data packets are sent
+class FecEncoder {
+public:
+    FecEncoder(): m_scheme(FEC_NONE), m_parity_pct(FEC_PARITY), m_hdr(0), m_data_size(0), m_last_size(0), m_tolerance(0),
+        m_block(0), m_next(0), m_cur(0), m_sym(0) {}
+
+    void Init(uint8_t scheme, uint32_t parity_pct)
+    {
+        m_scheme = scheme;
+        m_parity_pct = parity_pct;
+    }
+    // Split a frame of frame_size bytes in packets of at most packet_size (with a hdr_size header), of which about
+    // the parity share is parity. Returns the frame size of the planned packets.
+    size_tp Plan(size_tp frame_size, size_tp packet_size, size_tp hdr_size)
+    {
+        m_blocks.clear();
+        m_block = m_next = 0;
+        m_hdr = hdr_size;
+        count_tp n = count_tp((frame_size + packet_size - 1) / packet_size);
+        if (n < 1)
+            n = 1;
+        count_tp nb = (n + FEC_MAX_N - 1) / FEC_MAX_N;
+        count_tp parity = 0;
+        m_tolerance = FEC_MAX_N;
+        for (count_tp b = 0; b < nb; b++) {
+            count_tp nn = n / nb + (b < n % nb);
+            count_tp mm = (nn >= 2 && m_parity_pct) ? count_tp((nn * m_parity_pct + 50) / 100) : 0;
+            if (nn >= 2 && mm < 1 && m_parity_pct)
+                mm = 1;
+            if (mm > nn - 1)
+                mm = nn - 1;
+            block_t blk = {uint8_t(nn - mm), uint8_t(mm)};
+            m_blocks.push_back(blk);
+            parity += mm;
+            count_tp tol = (m_scheme == FEC_XOR) ? (mm ? 1 : 0) : mm;
+            if (tol < m_tolerance)
+                m_tolerance = tol;
+        }
+        // the data packets leave room for the 2-byte length in the symbol, so the parity packets fit packet_size
+        m_data_size = packet_size - 2;
+        count_tp k = n - parity;
+        int64_t last = int64_t(frame_size) - int64_t(parity) * packet_size - int64_t(k - 1) * m_data_size;
+        int64_t min_size = (m_data_size < PRAGUE_MINMTU) ? m_data_size : PRAGUE_MINMTU;
+        m_last_size = size_tp((last < min_size) ? min_size : (last > int64_t(m_data_size)) ? m_data_size : last);
+        size_tp total = (k - 1) * m_data_size + m_last_size;
+        for (size_t b = 0; b < m_blocks.size(); b++) {
+            bool last_block = (b + 1 == m_blocks.size());
+            size_tp first = (last_block && m_blocks[b].k == 1) ? m_last_size : m_data_size;
+            total += m_blocks[b].m * (first + 2);
+        }
+        return total;
+    }
+    // lost packets of the frame that are always repaired (any m per block, or one per block with XOR)
+    count_tp Tolerance() const { return m_tolerance; }
+    bool HasNext() const { return m_block < m_blocks.size(); }
+    fec_pkt_t Next()
+    {
+        const block_t &blk = m_blocks[m_block];
+        bool last_data = (m_block + 1 == m_blocks.size()) && (m_next + 1 == blk.k);
+        fec_pkt_t pkt;
+        pkt.block = uint8_t(m_block);
+        pkt.blocks = uint8_t(m_blocks.size());
+        pkt.k = blk.k;
+        pkt.m = blk.m;
+        pkt.index = uint8_t(m_next);
+        if (m_next == 0) {
+            // the first data packet is the largest of the block
+            m_sym = 2 + (last_data ? m_last_size : m_data_size) - m_hdr;
+            m_parity.assign(size_t(blk.m) * m_sym, 0);
+            m_symbol.assign(m_sym, 0);
+        }
+        pkt.size = (m_next < blk.k) ? (last_data ? m_last_size : m_data_size) : m_hdr + m_sym;
+        m_cur = m_next;
+        m_k = blk.k;
+        m_m = blk.m;
+        if (++m_next == uint32_t(blk.k + blk.m)) {
+            m_block++;
+            m_next = 0;
+        }
+        return pkt;
+    }
+    // add the payload of the data packet just planned to the parity of its block
+    void Protect(const char *payload, size_tp len)
+    {
+        if (!m_m)
+            return;
+        m_symbol[0] = uint8_t(len >> 8);
+        m_symbol[1] = uint8_t(len);
+        memcpy(&m_symbol[2], payload, len);
+        memset(&m_symbol[2 + len], 0, m_sym - 2 - len);
+        if (m_scheme == FEC_XOR) {
+            fec_xor(&m_parity[(m_cur % m_m) * m_sym], &m_symbol[0], m_sym);
+        } else {
+            for (uint32_t j = 0; j < m_m; j++)
+                gf_mul_add(&m_parity[j * m_sym], &m_symbol[0], fec_cauchy(j, m_cur), m_sym);
+        }
+    }
+    // the payload of the parity packet just planned
+    const char *Parity() const { return (const char*)(&m_parity[(m_cur - m_k) * m_sym]); }
+
+private:
+    struct block_t {
+        uint8_t k;
+        uint8_t m;
+    };
+    uint8_t m_scheme;
+    uint32_t m_parity_pct;
+    size_tp m_hdr;
+    size_tp m_data_size;      // size of the data packets, but the last one of the frame
+    size_tp m_last_size;
+    count_tp m_tolerance;
+    std::vector<block_t> m_blocks;
+    size_t m_block;           // next packet
+    uint32_t m_next;
+    uint32_t m_cur;           // last planned packet
+    uint32_t m_k;
+    uint32_t m_m;
+    size_tp m_sym;            // symbol size of the current block
+    std::vector<uint8_t> m_parity;
+    std::vector<uint8_t> m_symbol;
+};
+
+// The received packets of one block, and the repair of its missing data packets
+class FecBlock {
+public:
+    FecBlock(): m_scheme(FEC_NONE), m_k(0), m_m(0), m_sym(0), m_data(0), m_recovered(0) {}
+
+    void Reset(uint8_t scheme, uint8_t k, uint8_t m)
+    {
+        m_scheme = scheme;
+        m_k = k;
+        m_m = m;
+        m_sym = 0;
+        m_data = 0;
+        m_recovered = 0;
+        m_have.assign(size_t(k) + m, 0);
+        if (m_symbols.size() < m_have.size())
+            m_symbols.resize(m_have.size());
+    }
+    bool Matches(uint8_t scheme, uint8_t k, uint8_t m) const { return scheme == m_scheme && k == m_k && m == m_m; }
+    // store a received packet, false if it is a duplicate or does not fit the block
+    bool Add(uint8_t index, const char *payload, size_tp len)
+    {
+        if (index >= m_have.size() || m_have[index])
+            return false;
+        std::vector<uint8_t> &sym = m_symbols[index];
+        if (index < m_k) {
+            if (len > 0xFFFF)
+                return false;
+            sym.resize(len + 2);
+            sym[0] = uint8_t(len >> 8);
+            sym[1] = uint8_t(len);
+            memcpy(&sym[2], payload, len);
+            m_data++;
+        } else {
+            if (m_sym && len != m_sym)
+                return false;
+            m_sym = len;
+            sym.assign(payload, payload + len);
+        }
+        m_have[index] = 1;
+        return true;
+    }
+    count_tp Missing() const { return m_k - m_data; }
+    count_tp Recovered() const { return m_recovered; }
+    // repair the missing data packets the received parity allows, returns the number repaired
+    count_tp Recover()
+    {
+        if (!Missing() || !m_sym)
+            return 0;
+        for (uint32_t i = 0; i < m_k; i++) {
+            if (m_have[i] && m_symbols[i].size() > m_sym)
+                return 0;  // does not belong to this parity
+            if (m_have[i])
+                m_symbols[i].resize(m_sym, 0);
+        }
+        count_tp done = (m_scheme == FEC_XOR) ? recover_xor() : recover_rs();
+        m_data += done;
+        m_recovered += done;
+        return done;
+    }
+    // the payload of a received or repaired data packet, NULL if missing
+    const char *Payload(uint8_t index, size_tp &len) const
+    {
+        if (index >= m_k || !m_have[index])
+            return NULL;
+        const std::vector<uint8_t> &sym = m_symbols[index];
+        len = (size_tp(sym[0]) << 8) | sym[1];
+        if (len + 2 > sym.size())
+            return NULL;  // corrupt length
+        return (const char*)(&sym[2]);
+    }
+
+private:
+    count_tp recover_xor()
+    {
+        count_tp done = 0;
+        for (uint32_t g = 0; g < m_m; g++) {
+            if (!m_have[m_k + g])
+                continue;
+            uint32_t miss = m_k;
+            uint32_t missing = 0;
+            for (uint32_t i = g; i < m_k; i += m_m) {
+                if (!m_have[i]) {
+                    miss = i;
+                    missing++;
+                }
+            }
+            if (missing != 1)
+                continue;
+            std::vector<uint8_t> &out = m_symbols[miss];
+            out = m_symbols[m_k + g];
+            for (uint32_t i = g; i < m_k; i += m_m)
+                if (i != miss)
+                    fec_xor(&out[0], &m_symbols[i][0], m_sym);
+            m_have[miss] = 1;
+            done++;
+        }
+        return done;
+    }
+    count_tp recover_rs()
+    {
+        std::vector<uint32_t> lost, rows;
+        for (uint32_t i = 0; i < m_k; i++)
+            if (!m_have[i])
+                lost.push_back(i);
+        for (uint32_t j = 0; j < m_m && rows.size() < lost.size(); j++)
+            if (m_have[m_k + j])
+                rows.push_back(j);
+        size_t t = lost.size();
+        if (rows.size() < t)
+            return 0;
+        // remove the received data from the parity, leaving t equations in the t lost symbols
+        m_syndrome.assign(t * m_sym, 0);
+        for (size_t r = 0; r < t; r++) {
+            uint8_t *s = &m_syndrome[r * m_sym];
+            memcpy(s, &m_symbols[m_k + rows[r]][0], m_sym);
+            for (uint32_t i = 0; i < m_k; i++)
+                if (m_have[i])
+                    gf_mul_add(s, &m_symbols[i][0], fec_cauchy(rows[r], i), m_sym);
+        }
+        // invert the t x t Cauchy submatrix (always invertible) by Gauss-Jordan elimination
+        const gf_tables_t &g = gf();
+        m_matrix.assign(t * t * 2, 0);
+        for (size_t r = 0; r < t; r++) {
+            for (size_t c = 0; c < t; c++)
+                m_matrix[r * 2 * t + c] = fec_cauchy(rows[r], lost[c]);
+            m_matrix[r * 2 * t + t + r] = 1;
+        }
+        for (size_t c = 0; c < t; c++) {
+            size_t p = c;
+            while (!m_matrix[p * 2 * t + c])
+                p++;
+            if (p != c)
+                for (size_t x = 0; x < 2 * t; x++)
+                    std::swap(m_matrix[p * 2 * t + x], m_matrix[c * 2 * t + x]);
+            uint8_t inv = g.inv(m_matrix[c * 2 * t + c]);
+            for (size_t x = 0; x < 2 * t; x++)
+                m_matrix[c * 2 * t + x] = g.mul(m_matrix[c * 2 * t + x], inv);
+            for (size_t r = 0; r < t; r++) {
+                uint8_t f = m_matrix[r * 2 * t + c];
+                if (r != c && f)
+                    for (size_t x = 0; x < 2 * t; x++)
+                        m_matrix[r * 2 * t + x] ^= g.mul(f, m_matrix[c * 2 * t + x]);
+            }
+        }
+        for (size_t c = 0; c < t; c++) {
+            std::vector<uint8_t> &out = m_symbols[lost[c]];
+            out.assign(m_sym, 0);
+            for (size_t r = 0; r < t; r++)
+                gf_mul_add(&out[0], &m_syndrome[r * m_sym], m_matrix[c * 2 * t + t + r], m_sym);
+            m_have[lost[c]] = 1;
+        }
+        return count_tp(t);
+    }
+
+    uint8_t m_scheme;
+    uint8_t m_k;
+    uint8_t m_m;
+    size_tp m_sym;            // symbol size, known from the first parity packet
+    count_tp m_data;          // data packets received or repaired
+    count_tp m_recovered;
+    std::vector<uint8_t> m_have;
+    std::vector<std::vector<uint8_t>> m_symbols;  // the buffers are kept when the block is reused
+    std::vector<uint8_t> m_syndrome;
+    std::vector<uint8_t> m_matrix;
+};
+
+struct fec_stats_t {
+    count_tp frames;          // frames with FEC seen
+    count_tp complete;        // all data packets received
+    count_tp recovered;       // missing data packets all repaired
+    count_tp lost;            // data packets missing after the repair
+    count_tp pkts_recovered;
+    count_tp parity;          // parity packets received
+    count_tp late;            // packets of frames already finished, or duplicates
+};
+
+// Repairs the frames of the received RT packets with FEC, keeping the last FEC_FRAMES frames. A frame is finished
+// (and counted) when a later frame reuses its slot, or by Flush().
+class FecReceiver {
+public:
+    FecReceiver(): m_stats() {}
+
+    // a received packet with its header in host byte order, returns the data packets repaired by it
+    count_tp Received(count_tp frame_nr, uint8_t scheme, uint8_t block, uint8_t k, uint8_t m, uint8_t index,
+                      const char *payload, size_tp len)
+    {
+        frame_t &f = m_frames[uint32_t(frame_nr) % FEC_FRAMES];
+        if (f.used && f.frame_nr != frame_nr) {
+            if (frame_nr - f.frame_nr < 0) {
+                m_stats.late++;
+                return 0;
+            }
+            finish(f);
+        }
+        if (!f.used) {
+            f.used = true;
+            f.frame_nr = frame_nr;
+            f.blocks = 0;
+            m_stats.frames++;
+        }
+        if (k == 0 || size_t(k) + m > FEC_MAX_N || index >= k + m)
+            return 0;
+        if (block >= f.blocks) {
+            if (f.block.size() <= block)
+                f.block.resize(size_t(block) + 1);
+            for (uint32_t b = f.blocks; b <= block; b++)
+                f.block[b].Reset(FEC_NONE, 0, 0);  // blocks not seen yet
+            f.blocks = block + 1;
+        }
+        FecBlock &blk = f.block[block];
+        if (!blk.Matches(scheme, k, m))
+            blk.Reset(scheme, k, m);
+        if (!blk.Add(index, payload, len)) {
+            m_stats.late++;
+            return 0;
+        }
+        if (index >= k)
+            m_stats.parity++;
+        count_tp done = blk.Recover();
+        m_stats.pkts_recovered += done;
+        return done;
+    }
+    // are all data packets of the first blocks of frame frame_nr received or repaired?
+    bool Complete(count_tp frame_nr, uint32_t blocks) const
+    {
+        const frame_t &f = m_frames[uint32_t(frame_nr) % FEC_FRAMES];
+        if (!f.used || f.frame_nr != frame_nr || f.blocks < blocks)
+            return false;
+        for (uint32_t b = 0; b < f.blocks; b++)
+            if (f.block[b].Matches(FEC_NONE, 0, 0) || f.block[b].Missing() > 0)
+                return false;  // not seen yet, or data missing
+        return true;
+    }
+    void Flush()
+    {
+        for (uint32_t i = 0; i < FEC_FRAMES; i++)
+            if (m_frames[i].used)
+                finish(m_frames[i]);
+    }
+    const fec_stats_t &Stats() const { return m_stats; }
+
+private:
+    struct frame_t {
+        frame_t(): used(false), frame_nr(0), blocks(0) {}
+        bool used;
+        count_tp frame_nr;
+        uint32_t blocks;
+        std::vector<FecBlock> block;
+    };
+    void finish(frame_t &f)
+    {
+        bool lost = false, recovered = false;
+        for (uint32_t b = 0; b < f.blocks; b++) {
+            lost |= f.block[b].Missing() > 0;
+            recovered |= f.block[b].Recovered() > 0;
+        }
+        if (lost)
+            m_stats.lost++;
+        else if (recovered)
+            m_stats.recovered++;
+        else
+            m_stats.complete++;
+        f.used = false;
+    }
+
+    frame_t m_frames[FEC_FRAMES];
+    fec_stats_t m_stats;
+};
+#endif //FEC_H
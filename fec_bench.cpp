@@ -0,0 +1,195 @@
+// fec_bench.cpp:
+// Recovery-rate vs overhead benchmark of the RT-mode frame FEC of fec.h. Frames are planned by the FecEncoder with a
+// growing parity share, sent through random and bursty loss, and repaired by a FecBlock, verifying every repaired
+// payload. Also measures the GF(2^8) multiply-add kernel against the scalar code.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "udpsocket.h"
+#include "pkt_format.h"
+#include "fec.h"
+
+#define BENCH_FRAMES   2000   // frames per scenario
+#define BENCH_PKT_SIZE 1200   // packet size in bytes
+
+struct loss_t {
+    const char *name;
+    uint32_t loss_ppm;        // loss probability in the good state (or always), in packets per million
+    uint32_t burst_ppm;       // probability to enter the bursty state per packet (Gilbert-Elliott), 0 if none
+    uint32_t exit_ppm;        // probability to leave the bursty state per packet
+    uint32_t burst_loss_ppm;  // loss probability in the bursty state
+};
+
+struct result_t {
+    count_tp frames_lost;     // frames with data missing after the repair
+    count_tp frames_hit;      // frames with packets lost
+    count_tp pkts_lost;
+    count_tp pkts_recovered;
+    count_tp mismatches;      // repaired payloads that differ from the sent ones
+    uint64_t data_bytes;
+    uint64_t total_bytes;
+    double enc_ns;
+    double dec_ns;
+};
+
+static uint32_t lcg(uint32_t &state)
+{
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+static double now_ns()
+{
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static result_t run(const loss_t &loss, uint8_t scheme, uint32_t parity_pct, count_tp frame_pkts)
+{
+    result_t res = result_t();
+    uint32_t rnd = 12345;     // the same loss pattern for every scheme and parity share
+    uint32_t data_rnd = 777;
+    bool bursty = false;
+    FecEncoder enc;
+    enc.Init(scheme, parity_pct);
+    FecBlock blk;
+    std::vector<std::vector<char> > sent(FEC_MAX_N);
+    std::vector<fec_pkt_t> pkts;
+    std::vector<std::vector<char> > parity(FEC_MAX_N);
+    for (count_tp f = 0; f < BENCH_FRAMES; f++) {
+        size_tp frame_size = enc.Plan(size_tp(frame_pkts) * BENCH_PKT_SIZE, BENCH_PKT_SIZE, sizeof(fecmessage_t));
+        res.total_bytes += frame_size;
+        // encode, the payloads are random
+        pkts.clear();
+        double t0 = now_ns();
+        double gen = 0;
+        while (enc.HasNext()) {
+            fec_pkt_t pkt = enc.Next();
+            size_tp len = pkt.size - sizeof(fecmessage_t);
+            if (pkt.index < pkt.k) {
+                double g0 = now_ns();
+                sent[pkt.index].resize(len);
+                for (size_tp i = 0; i < len; i++)
+                    sent[pkt.index][i] = char(lcg(data_rnd));
+                gen += now_ns() - g0;
+                enc.Protect(&sent[pkt.index][0], len);
+                res.data_bytes += pkt.size;
+            } else {
+                const char *p = enc.Parity();
+                parity[pkt.index - pkt.k].assign(p, p + len);
+            }
+            pkts.push_back(pkt);
+        }
+        res.enc_ns += now_ns() - t0 - gen;
+        // lose, then repair
+        t0 = now_ns();
+        blk.Reset(scheme, pkts[0].k, pkts[0].m);
+        count_tp lost = 0;
+        for (size_t i = 0; i < pkts.size(); i++) {
+            bursty = bursty ? (lcg(rnd) % 1000000 >= loss.exit_ppm) : (lcg(rnd) % 1000000 < loss.burst_ppm);
+            if (lcg(rnd) % 1000000 < (bursty ? loss.burst_loss_ppm : loss.loss_ppm)) {
+                lost++;
+                continue;
+            }
+            const fec_pkt_t &pkt = pkts[i];
+            size_tp len = pkt.size - sizeof(fecmessage_t);
+            blk.Add(pkt.index, (pkt.index < pkt.k) ? &sent[pkt.index][0] : &parity[pkt.index - pkt.k][0], len);
+        }
+        count_tp missing = blk.Missing();
+        res.pkts_recovered += blk.Recover();
+        res.dec_ns += now_ns() - t0;
+        res.pkts_lost += lost;
+        res.frames_hit += (missing > 0);
+        res.frames_lost += (blk.Missing() > 0);
+        for (uint8_t i = 0; i < pkts[0].k; i++) {
+            size_tp len;
+            const char *p = blk.Payload(i, len);
+            if (p && (len != sent[i].size() || memcmp(p, &sent[i][0], len)))
+                res.mismatches++;
+        }
+    }
+    return res;
+}
+
+// the scalar reference of gf_mul_add
+static void mul_add_ref(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] ^= gf().mul(c, src[i]);
+}
+
+static void kernel_bench()
+{
+    const size_t len = BENCH_PKT_SIZE;
+    const uint32_t rounds = 200000;
+    std::vector<uint8_t> src(len), dst(len), ref(len);
+    uint32_t rnd = 1;
+    for (size_t i = 0; i < len; i++)
+        src[i] = uint8_t(lcg(rnd));
+    bool ok = true;
+    for (uint32_t c = 0; c < 256; c++) {
+        memset(&dst[0], 0x5A, len);
+        memset(&ref[0], 0x5A, len);
+        gf_mul_add(&dst[0], &src[0], uint8_t(c), len);
+        mul_add_ref(&ref[0], &src[0], uint8_t(c), len);
+        ok = ok && !memcmp(&dst[0], &ref[0], len);
+    }
+    double t0 = now_ns();
+    for (uint32_t r = 0; r < rounds; r++)
+        gf_mul_add(&dst[0], &src[0], uint8_t(2 + r % 250), len);
+    double t1 = now_ns();
+    for (uint32_t r = 0; r < rounds / 10; r++)
+        mul_add_ref(&ref[0], &src[0], uint8_t(2 + r % 250), len);
+    double t2 = now_ns();
+    for (uint32_t r = 0; r < rounds; r++)
+        fec_xor(&dst[0], &src[0], len);
+    double t3 = now_ns();
+    printf("GF(2^8) multiply-add (%s): %.0f MB/s, scalar log/exp: %.0f MB/s, XOR: %.0f MB/s, results %s (checksum %d)\n",
+           fec_simd(), len * double(rounds) * 1000 / (t1 - t0), len * double(rounds / 10) * 1000 / (t2 - t1),
+           len * double(rounds) * 1000 / (t3 - t2), ok ? "equal" : "DIFFERENT", dst[0] ^ ref[0]);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        printf("FEC benchmark usage:\n    %s (no arguments)\n", argv[0]);
+        exit(1);
+    }
+    kernel_bench();
+    const loss_t losses[] = {
+        {"random 1%", 10000, 0, 0, 0},
+        {"random 5%", 50000, 0, 0, 0},
+        {"random 10%", 100000, 0, 0, 0},
+        {"bursty 2%", 2000, 5000, 250000, 750000},   // bursts of 4 packets on average, 3 of them lost
+    };
+    const count_tp frame_pkts[] = {8, 40};
+    const uint32_t parity_pcts[] = {0, 10, 20, 30, 50};
+    const uint8_t schemes[] = {FEC_XOR, FEC_RS};
+    printf("%d frames per scenario, %d B packets; frame loss without FEC, then the residual frame loss with the parity "
+           "share inside the same frame size\n", BENCH_FRAMES, BENCH_PKT_SIZE);
+    printf("%-11s %6s %-4s %7s %8s %10s %9s %10s %8s %8s %6s\n", "loss", "frame", "fec", "parity", "overhead",
+           "frame_loss", "pkt_loss", "recovered", "enc_us", "dec_us", "errors");
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        for (size_t n = 0; n < sizeof(frame_pkts) / sizeof(frame_pkts[0]); n++) {
+            for (size_t s = 0; s < sizeof(schemes) / sizeof(schemes[0]); s++) {
+                for (size_t p = 0; p < sizeof(parity_pcts) / sizeof(parity_pcts[0]); p++) {
+                    if (!parity_pcts[p] && s)
+                        continue;  // no FEC is the same for both
+                    result_t r = run(losses[l], schemes[s], parity_pcts[p], frame_pkts[n]);
+                    printf("%-11s %6d %-4s %6d%% %7.1f%% %9.2f%% %8.2f%% %9.1f%% %8.2f %8.2f %6d\n", losses[l].name,
+                           frame_pkts[n], !parity_pcts[p] ? "none" : (schemes[s] == FEC_XOR) ? "xor" : "rs",
+                           parity_pcts[p], 100.0 * (r.total_bytes - r.data_bytes) / r.total_bytes,
+                           100.0 * r.frames_lost / BENCH_FRAMES,
+                           100.0 * r.pkts_lost / (r.total_bytes / BENCH_PKT_SIZE),
+                           r.frames_hit ? 100.0 * (r.frames_hit - r.frames_lost) / r.frames_hit : 100.0,
+                           r.enc_ns / BENCH_FRAMES / 1000, r.dec_ns / BENCH_FRAMES / 1000, r.mismatches);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+// feedback_bench.cpp:
+// Size-vs-fidelity benchmark of the RFC8888 feedback against the run-length compressed (RLE) feedback.
+// Replays synthetic arrival patterns through the receiver encoders and the sender decoders of pkt_format.h
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "udpsocket.h"
+#include "pkt_format.h"
+
+#define BENCH_PACKETS  400000 // packets per scenario
+#define BENCH_OWD      10000  // one-way delay in us, the exact RTT sample is 2 * BENCH_OWD
+#define BENCH_PKT_SIZE 1400   // data packet size in bytes
+
+struct scenario_t {
+    const char *name;
+    uint32_t rate_mbps;       // bottleneck rate
+    uint32_t loss_ppm;        // random loss probability in packets per million
+    uint32_t ce_ppm;          // random CE probability in packets per million
+    uint32_t jitter_us;       // maximum random extra delay per packet
+    time_tp period;           // feedback period
+};
+
+struct result_t {
+    uint64_t fb_bytes;        // total feedback bytes
+    uint64_t fb_packets;      // total feedback packets
+    uint64_t reports;         // total reports decoded
+    uint64_t rtt_samples;
+    double abs_err;           // accumulated absolute RTT error in us
+    time_tp max_err;
+    double enc_ns;            // total encoding time
+    double dec_ns;            // total decoding time
+};
+
+static uint32_t lcg(uint32_t &state)
+{
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+// shift < 0 selects RFC8888, otherwise RLE with the given ATO resolution
+static result_t run(const scenario_t &sc, int shift, size_tp maxpkt)
+{
+    static time_tp pkts_rtt[REPORT_SIZE];
+    static rfc8888ack_t rfc8888_msg;
+    static rleack_t rle_msg;
+
+    result_t res = result_t();
+    res.max_err = 0;
+    Scoreboard sb;
+    RecvScoreboard rb;
+
+    uint32_t rnd = 12345;
+    double interval = BENCH_PKT_SIZE * 8.0 / sc.rate_mbps;  // us per packet at the bottleneck
+    count_tp seq = 1;                // next packet to arrive
+    count_tp start_seq = 1, end_seq = 1;
+    count_tp rcvd = 0, lost = 0, mark = 0;
+    bool error = false;
+    time_tp now = 1;
+    count_tp fb_rcvd, fb_mark, fb_lost;
+    rate_tp fb_ato;
+
+    while (seq <= BENCH_PACKETS) {
+        now += sc.period;
+        // all packets that arrived before now become pending
+        for (;;) {
+            time_tp arrival = 1 + time_tp((seq - 1) * interval);
+            if (arrival - now > 0 || seq > BENCH_PACKETS)
+                break;
+            sb.Sent(seq, arrival - BENCH_OWD);
+            if (sc.jitter_us)
+                arrival += lcg(rnd) % sc.jitter_us;
+            if (lcg(rnd) % 1000000 >= sc.loss_ppm)
+                rb.Received(seq, arrival, (lcg(rnd) % 1000000 < sc.ce_ppm) ? ecn_ce : ecn_l4s_id);
+            end_seq = ++seq;
+        }
+        while (start_seq != end_seq) {
+            uint16_t size;
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            if (shift < 0)
+                size = rfc8888_msg.set_stat(start_seq, end_seq, now, rb, maxpkt);
+            else
+                size = rle_msg.set_stat(start_seq, end_seq, now, rb, maxpkt, uint8_t(shift),
+                                        fb_rcvd, fb_mark, fb_lost, fb_ato);
+            res.enc_ns += elapsed_ns(t0);
+            res.fb_bytes += size;
+            res.fb_packets++;
+
+            time_tp snd_now = now + BENCH_OWD;
+            uint16_t num_rtt, num_reports;
+            t0 = std::chrono::steady_clock::now();
+            if (shift < 0) {
+                num_rtt = rfc8888_msg.get_stat(snd_now, sb, pkts_rtt, rcvd, lost, mark, error);
+                num_reports = rfc8888_msg.num_reports;
+            } else {
+                num_rtt = rle_msg.get_stat(snd_now, sb, pkts_rtt, rcvd, lost, mark, error, size);
+                num_reports = rle_msg.num_reports;
+            }
+            res.dec_ns += elapsed_ns(t0);
+            res.reports += num_reports;
+            for (uint16_t i = 0; i < num_rtt; i++) {
+                time_tp err = pkts_rtt[i] - 2 * BENCH_OWD;
+                err = (err < 0) ? -err : err;
+                res.abs_err += err;
+                res.max_err = (err > res.max_err) ? err : res.max_err;
+            }
+            res.rtt_samples += num_rtt;
+        }
+    }
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    size_tp maxpkt = PRAGUE_INITMTU;
+    if (argc > 1)
+        maxpkt = strtoull(argv[1], NULL, 10);
+    if (maxpkt > sizeof(rfc8888ack_t))
+        maxpkt = sizeof(rfc8888ack_t);
+
+    const scenario_t scenarios[] = {
+        {"100M clean",           100,    0,     0,  0, 25000},
+        {"1G clean",             1000,   0,     0,  0, 25000},
+        {"1G 0.1% loss, 2% CE",  1000,   1000,  20000, 0, 25000},
+        {"10G clean",            10000,  0,     0,  0, 5000},
+        {"10G 2% CE, jitter",    10000,  0,     20000, 200, 5000},
+        {"10G 0.1% loss, 20% CE", 10000, 1000,  200000, 50, 5000},
+    };
+    const int shifts[] = {-1, 10, 8, 6, 4, 0};
+
+    printf("Feedback size vs fidelity, %d packets of %d B per scenario, max feedback size %llu B\n",
+           BENCH_PACKETS, BENCH_PKT_SIZE, (unsigned long long)maxpkt);
+    printf("%-24s %-10s %10s %10s %10s %12s %10s %10s %10s\n", "scenario", "encoding", "fb_pkts", "B/report", "rpts/fb",
+           "mean_err_us", "max_err_us", "enc_ns/r", "dec_ns/r");
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        for (size_t e = 0; e < sizeof(shifts) / sizeof(shifts[0]); e++) {
+            result_t r = run(scenarios[s], shifts[e], maxpkt);
+            char enc[16];
+            if (shifts[e] < 0)
+                snprintf(enc, sizeof(enc), "RFC8888");
+            else
+                snprintf(enc, sizeof(enc), "RLE/%dus", 1 << shifts[e]);
+            printf("%-24s %-10s %10llu %10.3f %10.1f %12.1f %10d %10.2f %10.2f\n", scenarios[s].name, enc, (unsigned long long)r.fb_packets,
+                   double(r.fb_bytes) / r.reports, double(r.reports) / r.fb_packets,
+                   r.rtt_samples ? r.abs_err / r.rtt_samples : 0.0, r.max_err, r.enc_ns / r.reports, r.dec_ns / r.reports);
+        }
+    }
+    return 0;
+}
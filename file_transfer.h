@@ -0,0 +1,225 @@
+#ifndef FILE_TRANSFER_H
+#define FILE_TRANSFER_H
+
+// file_transfer.h:
+// Reliable bulk file transfer on top of the bulk sender. FileSender splits a memory-mapped source file in chunks of
+// one packet, keeps the chunk of every sent packet in the scoreboard, and after each feedback walks the packets whose
+// state is resolved: the chunks of received packets are delivered, the chunks of lost packets are sent again under new
+// sequence numbers. FileReceiver writes every first copy of a chunk in place into a memory-mapped destination file.
+// Both measure the goodput (file bytes) against the throughput (all bytes on the wire, with headers and copies).
+//
+
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <cstring>
+#include "mapped_file.h"
+#include "scoreboard.h"
+#include "pkt_format.h"
+
+#define FILE_LINGER 1000000     // receiver keeps answering retransmissions this long after the last chunk (us)
+#define FILE_MAX_CHUNKS 0x7FFFFFFF  // chunk numbers are count_tp
+
+// the chunks of a file, false if they do not fit in count_tp
+inline bool file_chunks(uint64_t file_size, uint32_t chunk_size, count_tp &chunks)
+{
+    if (!chunk_size || file_size / chunk_size >= FILE_MAX_CHUNKS)
+        return false;
+    chunks = count_tp((file_size + chunk_size - 1) / chunk_size);
+    return true;
+}
+
+// monotonic wall clock in us, the transfer can outlast the wrapping time_tp
+inline int64_t file_clock()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class FileSender {
+public:
+    FileSender(): m_chunk_size(0), m_chunks(0), m_next(0), m_done(0), m_scan(1), m_retransmitted(0), m_bytes(0),
+        m_start(0), m_end(0) {}
+
+    // false with errno set if the file cannot be mapped, or has too many chunks
+    bool Open(const char *filename, uint32_t chunk_size)
+    {
+        try {
+            m_file.Open(filename);
+        } catch (const std::system_error &e) {
+            errno = e.code().default_error_condition().value();
+            return false;
+        }
+        m_chunk_size = chunk_size;
+        if (!file_chunks(m_file.Size(), chunk_size, m_chunks)) {
+            errno = EFBIG;
+            return false;
+        }
+        m_delivered.assign((size_t(m_chunks) + 63) / 64, 0);
+        return true;
+    }
+    bool HasData() const { return !m_lost.empty() || m_next < m_chunks; }
+    // the next chunk to send, the lost ones first, false if none
+    bool NextChunk(count_tp &chunk)
+    {
+        if (!m_start)
+            m_start = file_clock();
+        while (!m_lost.empty()) {
+            chunk = m_lost.front();
+            m_lost.pop_front();
+            if (!Delivered(chunk)) {
+                m_retransmitted++;
+                return true;
+            }
+        }
+        if (m_next >= m_chunks)
+            return false;
+        chunk = m_next++;
+        return true;
+    }
+    // fill the header of a chunk, returning its data
+    const uint8_t *Chunk(count_tp chunk, filemessage_t &msg, size_tp &len) const
+    {
+        uint64_t offset = uint64_t(chunk) * m_chunk_size;
+        len = (m_file.Size() - offset < m_chunk_size) ? size_tp(m_file.Size() - offset) : m_chunk_size;
+        msg.chunk = chunk;
+        msg.chunk_size = m_chunk_size;
+        msg.file_size = m_file.Size();
+        return m_file.Data() + offset;
+    }
+    void Sent(size_tp bytes) { m_bytes += bytes; }
+
+    // Walk the packets up to seqnr whose feedback resolved them, in order. Returns true when all chunks are delivered.
+    bool Update(const Scoreboard &sb, count_tp seqnr)
+    {
+        for (; m_scan - seqnr <= 0; m_scan++) {
+            pktsend_tp state = sb.State(m_scan);
+            if (state == snd_sent)
+                break;  // outstanding, the packets after it are walked when it is resolved
+            count_tp chunk = sb.Frame(m_scan);
+            if (state == snd_recv && !Delivered(chunk)) {
+                m_delivered[chunk / 64] |= uint64_t(1) << (chunk % 64);
+                m_done++;
+            } else if (state == snd_lost && !Delivered(chunk)) {
+                m_lost.push_back(chunk);
+            }
+        }
+        if (Done() && !m_end)
+            m_end = file_clock();
+        return Done();
+    }
+    // probe timeout: the chunk of the last packet is sent again (tail loss probe)
+    void Probe(const Scoreboard &sb, count_tp seqnr)
+    {
+        if (m_scan - seqnr <= 0 && !Delivered(sb.Frame(seqnr)))
+            m_lost.push_back(sb.Frame(seqnr));
+    }
+    // retransmission timeout: the chunks of all outstanding packets are sent again
+    void Timeout(const Scoreboard &sb, count_tp seqnr)
+    {
+        for (; m_scan - seqnr <= 0; m_scan++) {
+            count_tp chunk = sb.Frame(m_scan);
+            if (sb.State(m_scan) != snd_recv && !Delivered(chunk))
+                m_lost.push_back(chunk);
+        }
+    }
+
+    bool Done() const { return m_done == m_chunks; }
+    uint64_t FileSize() const { return m_file.Size(); }
+    count_tp Chunks() const { return m_chunks; }
+    count_tp Retransmitted() const { return m_retransmitted; }
+    uint64_t Bytes() const { return m_bytes; }
+    // from the first chunk sent until all were delivered (or now)
+    int64_t Duration() const { return m_start ? (m_end ? m_end : file_clock()) - m_start : 0; }
+
+private:
+    bool Delivered(count_tp chunk) const { return (m_delivered[chunk / 64] >> (chunk % 64)) & 1; }
+
+    MappedFile m_file;
+    uint32_t m_chunk_size;
+    count_tp m_chunks;
+    count_tp m_next;            // first chunk never sent
+    count_tp m_done;            // delivered chunks
+    count_tp m_scan;            // first packet not walked yet
+    std::vector<uint64_t> m_delivered;
+    std::deque<count_tp> m_lost; // chunks to send again
+    count_tp m_retransmitted;
+    uint64_t m_bytes;           // sent, with headers and retransmissions
+    int64_t m_start;
+    int64_t m_end;
+};
+
+class FileReceiver {
+public:
+    FileReceiver(): m_filename(NULL), m_error(NULL), m_chunk_size(0), m_file_size(0), m_chunks(0), m_received(0), m_duplicates(0),
+        m_bytes(0), m_last(0), m_start(0), m_end(0) {}
+
+    void Init(const char *filename) { m_filename = filename; }
+    // Write the chunk of a file packet in place (the first one sizes the file), false if it does not belong to it or
+    // the file cannot be created (Error() tells which, with errno set for the latter)
+    bool Received(const filemessage_t &msg, const char *payload, size_tp len, time_tp now)
+    {
+        m_error = "Invalid file chunk received";
+        if (!m_chunks) {
+            count_tp chunks = 0;
+            if (!msg.file_size || !file_chunks(msg.file_size, msg.chunk_size, chunks) || msg.file_size > SIZE_MAX)
+                return false;
+            try {
+                m_file.Create(m_filename, size_t(msg.file_size));
+            } catch (const std::system_error &e) {
+                errno = e.code().default_error_condition().value();
+                m_error = "Could not create the destination file";
+                return false;
+            }
+            m_chunk_size = msg.chunk_size;
+            m_file_size = msg.file_size;
+            m_chunks = chunks;
+            m_got.assign((size_t(m_chunks) + 63) / 64, 0);
+            m_start = file_clock();
+        }
+        if (msg.chunk_size != m_chunk_size || msg.file_size != m_file_size || uint32_t(msg.chunk) >= uint32_t(m_chunks))
+            return false;
+        uint64_t offset = uint64_t(msg.chunk) * m_chunk_size;
+        if (len != ((m_file_size - offset < m_chunk_size) ? m_file_size - offset : m_chunk_size))
+            return false;
+        m_bytes += len + sizeof(msg);
+        m_last = now;
+        if ((m_got[msg.chunk / 64] >> (msg.chunk % 64)) & 1) {
+            m_duplicates++;
+            return true;
+        }
+        memcpy(m_file.WritableData() + offset, payload, len);
+        m_got[msg.chunk / 64] |= uint64_t(1) << (msg.chunk % 64);
+        if (++m_received == m_chunks) {
+            m_end = file_clock();
+            m_file.Close();  // written back
+        }
+        return true;
+    }
+
+    const char *Error() const { return m_error; }
+    bool Complete() const { return m_chunks && m_received == m_chunks; }
+    time_tp LastData() const { return m_last; }
+    uint64_t FileSize() const { return m_file_size; }
+    count_tp Chunks() const { return m_chunks; }
+    count_tp Duplicates() const { return m_duplicates; }
+    uint64_t Bytes() const { return m_bytes; }
+    // from the first chunk received until the last one was written (or now)
+    int64_t Duration() const { return m_start ? (m_end ? m_end : file_clock()) - m_start : 0; }
+
+private:
+    const char *m_filename;
+    const char *m_error;        // why the last Received failed
+    MappedFile m_file;
+    uint32_t m_chunk_size;
+    uint64_t m_file_size;
+    count_tp m_chunks;
+    count_tp m_received;
+    count_tp m_duplicates;
+    std::vector<uint64_t> m_got;
+    uint64_t m_bytes;           // received, with headers and duplicates
+    time_tp m_last;             // last chunk received
+    int64_t m_start;
+    int64_t m_end;
+};
+#endif //FILE_TRANSFER_H
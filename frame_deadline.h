@@ -0,0 +1,168 @@
+#ifndef FRAME_DEADLINE_H
+#define FRAME_DEADLINE_H
+
+// frame_deadline.h:
+// Deadlines of RT-mode frames. A frame is only useful when it is complete within a latency budget after it was
+// captured. The sender drops the packets of a frame that can no longer arrive in time before sending them
+// (frame_late). The receiver's FramePlayout releases each frame when it is complete, and skips it when its deadline
+// passes first. The receiver has no clock in common with the sender: it takes the clock offset from the fastest
+// packet and the one-way delay from half its min RTT, and the capture time from the earliest sender timestamp of the
+// frame. Without a valid RTT sample (with RFC8888 feedback the sender echoes no timestamps) the one-way delay is 0,
+// so the budget starts when the fastest packet would arrive. A frame of which no packet arrived yet is captured a
+// frame interval before the next one.
+//
+
+#include "prague_cc.h"
+
+#define PLAYOUT_FRAMES 64     // frames the receiver tracks at the same time
+
+// Can a frame with remaining bytes still to send at the pacing rate arrive completely by its deadline?
+inline bool frame_late(time_tp now, time_tp deadline, size_tp remaining, rate_tp pacing_rate, time_tp srtt)
+{
+    time_tp send_time = pacing_rate ? time_tp(remaining * 1000000 / pacing_rate) : 0;
+    return now + send_time + srtt / 2 - deadline > 0;
+}
+
+// at the receiver
+struct deadline_stats_t {
+    count_tp frames;          // frames of the stream, also those of which no packet arrived
+    count_tp ontime;          // complete by their deadline and released
+    count_tp late;            // skipped at their deadline, completed later
+    count_tp dropped;         // never completed
+    count_tp late_pkts;       // packets that arrived after the deadline of their frame, discarded
+};
+
+struct frame_drop_stats_t {
+    count_tp frames;          // frames of the stream
+    count_tp sent;            // sent completely
+    count_tp dropped;         // dropped at the sender because they would arrive too late
+    count_tp partial;         // of which a part was sent already
+    count_tp skipped;         // skipped because the sender fell behind the frame rate
+};
+
+class FramePlayout {
+public:
+    FramePlayout(): m_budget(0), m_interval(0), m_offset(0), m_synced(false), m_highest(0), m_next(0), m_stats() {}
+
+    void Init(time_tp budget, time_tp interval)
+    {
+        m_budget = budget;
+        m_interval = interval;
+    }
+    // A packet of len bytes of frame frame_nr (of frame_size bytes) with the sender's timestamp arrived at now.
+    // min_owd is the min one-way delay, 0 if unknown. repaired tells the FEC of the frame repaired all of its data
+    // packets.
+    void Received(count_tp frame_nr, size_tp frame_size, size_tp len, time_tp timestamp, time_tp now, time_tp min_owd,
+                  bool repaired)
+    {
+        if (!m_synced || now - timestamp - m_offset < 0)
+            m_offset = now - timestamp;
+        if (!m_synced) {
+            m_synced = true;
+            m_highest = frame_nr - 1;
+            m_next = now;
+        }
+        if (frame_nr - m_highest > 0) {
+            // the frames up to this one are tracked from now on, one of which no packet arrives counts dropped
+            count_tp from = (frame_nr - m_highest > PLAYOUT_FRAMES) ? frame_nr - PLAYOUT_FRAMES + 1 : m_highest + 1;
+            m_stats.frames += from - m_highest - 1;
+            m_stats.dropped += from - m_highest - 1;
+            for (count_tp nr = from; nr - frame_nr <= 0; nr++)
+                start(nr, timestamp - time_tp(frame_nr - nr) * m_interval, min_owd);
+            m_highest = frame_nr;
+        }
+        frame_t &f = m_frames[uint32_t(frame_nr) % PLAYOUT_FRAMES];
+        if (!f.used || f.frame_nr != frame_nr) {
+            m_stats.late_pkts++;  // older than the tracked frames
+            return;
+        }
+        if (f.state == frm_released || f.state == frm_late)
+            return;  // complete already, parity or a duplicate
+        if (f.state == frm_skipped)
+            m_stats.late_pkts++;  // only tells whether the frame completes late
+        if (timestamp - f.first_ts < 0)
+            f.first_ts = timestamp;
+        f.bytes += len;
+        f.deadline = deadline_of(f.first_ts, min_owd);
+        if (f.bytes < frame_size && !repaired) {
+            if (f.state == frm_pending && f.deadline - m_next < 0)
+                m_next = f.deadline;
+            return;
+        }
+        if (f.state == frm_pending && now - f.deadline <= 0) {
+            f.state = frm_released;
+            m_stats.ontime++;
+        } else {
+            f.state = frm_late;
+            m_stats.late++;
+        }
+    }
+    // skip the incomplete frames whose deadline passed
+    void Expire(time_tp now)
+    {
+        if (!m_synced || now - m_next < 0)
+            return;
+        m_next = now + m_budget;
+        for (uint32_t i = 0; i < PLAYOUT_FRAMES; i++) {
+            frame_t &f = m_frames[i];
+            if (!f.used || f.state != frm_pending)
+                continue;
+            if (now - f.deadline >= 0)
+                f.state = frm_skipped;
+            else if (f.deadline - m_next < 0)
+                m_next = f.deadline;
+        }
+    }
+    // the next time Expire has frames to skip
+    time_tp NextDeadline() const { return m_next; }
+    void Flush()
+    {
+        for (uint32_t i = 0; i < PLAYOUT_FRAMES; i++)
+            if (m_frames[i].used)
+                finish(m_frames[i]);
+    }
+    const deadline_stats_t &Stats() const { return m_stats; }
+
+private:
+    enum frame_state_t { frm_pending, frm_released, frm_skipped, frm_late };
+    struct frame_t {
+        frame_t(): used(false), state(frm_pending), frame_nr(0), bytes(0), first_ts(0), deadline(0) {}
+        bool used;
+        frame_state_t state;
+        count_tp frame_nr;
+        size_tp bytes;
+        time_tp first_ts;       // earliest sender timestamp of its packets
+        time_tp deadline;       // in our clock
+    };
+    // the deadline in our clock of a frame captured at timestamp in the sender's clock
+    time_tp deadline_of(time_tp timestamp, time_tp min_owd) const { return timestamp + m_offset - min_owd + m_budget; }
+    void start(count_tp frame_nr, time_tp timestamp, time_tp min_owd)
+    {
+        frame_t &f = m_frames[uint32_t(frame_nr) % PLAYOUT_FRAMES];
+        if (f.used)
+            finish(f);
+        f.used = true;
+        f.state = frm_pending;
+        f.frame_nr = frame_nr;
+        f.bytes = 0;
+        f.first_ts = timestamp;
+        f.deadline = deadline_of(timestamp, min_owd);
+        m_stats.frames++;
+    }
+    void finish(frame_t &f)
+    {
+        if (f.state == frm_pending || f.state == frm_skipped)
+            m_stats.dropped++;
+        f.used = false;
+    }
+
+    time_tp m_budget;
+    time_tp m_interval;         // frame interval of the sender
+    time_tp m_offset;           // our clock minus the sender's, plus the min one-way delay
+    bool m_synced;
+    count_tp m_highest;         // highest frame number seen
+    time_tp m_next;             // earliest deadline of the pending frames (or later)
+    frame_t m_frames[PLAYOUT_FRAMES];
+    deadline_stats_t m_stats;
+};
+#endif //FRAME_DEADLINE_H
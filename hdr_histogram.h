@@ -0,0 +1,117 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+// hdr_histogram.h:
+// High dynamic range (log-linear) histogram of non-negative time_tp values in us. Values below 2^HDR_SUB_BITS have
+// their own bucket, above that every power of 2 is split in 2^(HDR_SUB_BITS-1) buckets, so any value up to 2^31 is
+// recorded in constant time with a relative error below 1/2^(HDR_SUB_BITS-1) (0.8%), in a fixed 12.8 KB array.
+//
+
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "prague_cc.h"
+
+#define HDR_SUB_BITS  8
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_SUB_HALF  (HDR_SUB_COUNT / 2)
+#define HDR_BUCKETS   (HDR_SUB_COUNT + (31 - HDR_SUB_BITS) * HDR_SUB_HALF)
+
+inline uint32_t msb32(uint32_t v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse(&i, v);
+    return uint32_t(i);
+#else
+    return uint32_t(31 - __builtin_clz(v));
+#endif
+}
+
+class HdrHistogram {
+public:
+    HdrHistogram(): m_count(0), m_max(0), m_min_idx(HDR_BUCKETS), m_max_idx(0) { memset(m_counts, 0, sizeof(m_counts)); }
+
+    // only the used buckets are cleared
+    void Reset()
+    {
+        if (m_count)
+            memset(m_counts + m_min_idx, 0, (m_max_idx - m_min_idx + 1) * sizeof(m_counts[0]));
+        m_count = 0;
+        m_max = 0;
+        m_min_idx = HDR_BUCKETS;
+        m_max_idx = 0;
+    }
+    void Record(time_tp v)
+    {
+        if (v < 0)
+            v = 0;
+        uint32_t idx = Index(uint32_t(v));
+        m_counts[idx]++;
+        m_count++;
+        if (v > m_max)
+            m_max = v;
+        if (idx < m_min_idx)
+            m_min_idx = idx;
+        if (idx > m_max_idx)
+            m_max_idx = idx;
+    }
+    // merge the samples of another histogram (e.g. an interval into the totals)
+    void Add(const HdrHistogram &other)
+    {
+        for (uint32_t i = other.m_min_idx; i <= other.m_max_idx && other.m_count; i++)
+            m_counts[i] += other.m_counts[i];
+        m_count += other.m_count;
+        if (other.m_max > m_max)
+            m_max = other.m_max;
+        if (other.m_count && other.m_min_idx < m_min_idx)
+            m_min_idx = other.m_min_idx;
+        if (other.m_count && other.m_max_idx > m_max_idx)
+            m_max_idx = other.m_max_idx;
+    }
+    uint64_t Count() const { return m_count; }
+    time_tp Max() const { return m_max; }
+    // highest value equivalent to the p-th percentile sample (0 < p <= 100), never above the recorded maximum
+    time_tp Percentile(double p) const
+    {
+        if (!m_count)
+            return 0;
+        uint64_t rank = uint64_t(p / 100.0 * m_count + 0.5);
+        if (rank < 1)
+            rank = 1;
+        uint64_t acc = 0;
+        for (uint32_t i = m_min_idx; i <= m_max_idx; i++) {
+            acc += m_counts[i];
+            if (acc >= rank) {
+                time_tp v = Highest(i);
+                return (v < m_max) ? v : m_max;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static uint32_t Index(uint32_t v)
+    {
+        if (v < HDR_SUB_COUNT)
+            return v;
+        uint32_t shift = msb32(v) - (HDR_SUB_BITS - 1);
+        return HDR_SUB_COUNT + (shift - 1) * HDR_SUB_HALF + (v >> shift) - HDR_SUB_HALF;
+    }
+    static time_tp Highest(uint32_t idx)
+    {
+        if (idx < HDR_SUB_COUNT)
+            return time_tp(idx);
+        uint32_t shift = (idx - HDR_SUB_COUNT) / HDR_SUB_HALF + 1;
+        uint32_t sub = (idx - HDR_SUB_COUNT) % HDR_SUB_HALF + HDR_SUB_HALF;
+        return time_tp((uint64_t(sub + 1) << shift) - 1);
+    }
+
+    uint32_t m_counts[HDR_BUCKETS];
+    uint64_t m_count;
+    time_tp m_max;
+    uint32_t m_min_idx;
+    uint32_t m_max_idx;
+};
+#endif //HDR_HISTOGRAM_H
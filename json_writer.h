@@ -1,84 +1,193 @@
 #ifndef JSON_WRITER_H
 #define JSON_WRITER_H
 
+#include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 
-// Simple JSON lines file writer
+// JSON lines file writer: a line is formatted into a preallocated buffer with numbers as JSON numbers,
+// and a background thread appends the finished lines to a file that stays open, so the CC loop never waits for the disk
 struct json_writer {
-  std::string buf;
-  std::string file;
+  static const size_t LINE_SIZE = 4096;       // max size of one line
+  static const size_t MAX_PENDING = 16 << 20; // lines are dropped when this many bytes wait for the disk
+
+  char line[LINE_SIZE];
+  size_t len = 0;
   bool first = true;
+  uint64_t dropped = 0;                       // lines dropped because the disk could not keep up
+
+  FILE *fp = NULL;
+  std::thread thread;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::condition_variable space;              // signaled when the background thread took the pending lines
+  std::string pending;                        // finished lines, not yet handed to the background thread
+  bool stop = false;
+
+  json_writer() = default;
+  json_writer(const json_writer &) = delete;
+  json_writer &operator=(const json_writer &) = delete;
+  ~json_writer() { close(); }
 
   int init(const char *filename, bool append = true) {
     if (!filename || !*filename)
       return -1;
-    file = filename;
-    if (!append)
-      std::ofstream(file, std::ios::trunc).close();
+    close();
+    fp = fopen(filename, append ? "ab" : "wb");
+    if (!fp)
+      return -1;
+    pending.reserve(1 << 16);
+    stop = false;
+    thread = std::thread(&json_writer::run, this);
     return 0;
   }
 
+  // flushes all pending lines and closes the file
+  void close() {
+    if (!fp)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+    fclose(fp);
+    fp = NULL;
+  }
+
   void reset() {
-    buf.clear();
-    buf.push_back('{');
+    len = 0;
+    line[len++] = '{';
     first = true;
   }
 
   void sep() {
     if (!first)
-      buf.push_back(',');
+      line[len++] = ',';
     first = false;
   }
 
   /* Field functions */
   void field(const char *k, const std::string &v) {
-    sep();
-    buf += "\"";
-    buf += k;
-    buf += "\":\"";
-    buf += v;
-    buf += "\"";
+    if (!key(k, v.size() * 2 + 2))
+      return;
+    line[len++] = '"';
+    for (size_t i = 0; i < v.size(); i++) {
+      if (v[i] == '"' || v[i] == '\\')
+        line[len++] = '\\';
+      line[len++] = (v[i] < ' ') ? ' ' : v[i];
+    }
+    line[len++] = '"';
   }
 
   void field(const char *k, uint64_t v) {
-    sep();
-    buf += "\"";
-    buf += k;
-    buf += "\":\"";
-    buf += std::to_string(v);
-    buf += "\"";
+    if (key(k, 20))
+      put_uint(v);
   }
 
   void field(const char *k, int32_t v) {
-    sep();
-    buf += "\"";
-    buf += k;
-    buf += "\":\"";
-    buf += std::to_string(v);
-    buf += "\"";
+    if (!key(k, 11))
+      return;
+    if (v < 0) {
+      line[len++] = '-';
+      put_uint(uint64_t(-int64_t(v)));
+    } else {
+      put_uint(uint64_t(v));
+    }
   }
 
   void field(const char *k, float v) {
-    sep();
-    buf += "\"";
-    buf += k;
-    buf += "\":\"";
-    buf += std::to_string(v);
-    buf += "\"";
+    if (!key(k, 48))
+      return;
+    if (v != v || v - v != 0) {  // NaN or infinite has no JSON number
+      memcpy(line + len, "null", 4);
+      len += 4;
+      return;
+    }
+    int n = snprintf(line + len, LINE_SIZE - len, "%.6f", double(v));
+    len += (n > 0 && size_t(n) < LINE_SIZE - len) ? size_t(n) : 0;
   }
 
   /* Finalize I/O */
-  void finalize() { buf.push_back('}'); }
+  void finalize() { line[len++] = '}'; }
 
-  int dump() {
-    std::ofstream out(file, std::ios::app | std::ios::binary);
-    if (!out)
+  const char *c_str() {
+    line[len] = '\0';
+    return line;
+  }
+
+  // queues the finished line for the background thread, if the disk can't keep up
+  // the line is dropped, or with wait (for offline tools) dump waits for the disk
+  int dump(bool wait = false) {
+    if (!fp)
       return -1;
-    out << buf << '\n';
+    line[len++] = '\n';
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      if (pending.size() + len > MAX_PENDING) {
+        if (!wait) {
+          dropped++;
+          return -1;
+        }
+        space.wait(lock, [this] { return pending.size() + len <= MAX_PENDING; });
+      }
+      pending.append(line, len);
+    }
+    cv.notify_one();
     return 0;
   }
+
+private:
+  // writes the key and checks that value_size more bytes (plus the closing "}\n") still fit the line
+  bool key(const char *k, size_t value_size) {
+    size_t klen = strlen(k);
+    if (len + klen + value_size + 8 > LINE_SIZE)
+      return false;
+    sep();
+    line[len++] = '"';
+    memcpy(line + len, k, klen);
+    len += klen;
+    line[len++] = '"';
+    line[len++] = ':';
+    return true;
+  }
+
+  void put_uint(uint64_t v) {
+    char digits[20];
+    int n = 0;
+    do {
+      digits[n++] = char('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (n)
+      line[len++] = digits[--n];
+  }
+
+  void run() {
+    std::string writing;
+    writing.reserve(1 << 16);
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+      cv.wait(lock, [this] { return stop || !pending.empty(); });
+      bool last = stop;
+      writing.swap(pending);
+      lock.unlock();
+      space.notify_all();
+      if (!writing.empty()) {
+        fwrite(writing.data(), 1, writing.size(), fp);
+        fflush(fp);
+        writing.clear();
+      }
+      lock.lock();
+      if (last && pending.empty())
+        return;
+    }
+  }
 };
 
 #endif //! JSON_WRITER_H
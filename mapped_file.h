@@ -0,0 +1,125 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+// mapped_file.h:
+// Memory mapping of a whole file: read-only with sequential read-ahead (Open), or created with a given size and
+// mapped for writing in place (Create), which is written back to the file when closed.
+//
+
+#include <string>
+#include <system_error>
+#include <cstdint>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile(): m_data(NULL), m_len(0)
+#ifdef _WIN32
+        , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+    {}
+    ~MappedFile() { Close(); }
+
+    void Open(const char *filename)
+    {
+        Close();
+#ifdef _WIN32
+        m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::system_error(GetLastError(), std::system_category(), std::string("Could not open file ") + filename);
+        LARGE_INTEGER fsize;
+        GetFileSizeEx(m_file, &fsize);
+        m_len = size_t(fsize.QuadPart);
+        m_mapping = m_len ? CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        void *p = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!p)
+            throw std::system_error(m_len ? GetLastError() : ERROR_HANDLE_EOF, std::system_category(),
+                                    std::string("Could not map file ") + filename);
+#else
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), std::string("Could not open file ") + filename);
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::system_category(), std::string("Could not size file ") + filename);
+        }
+        m_len = size_t(st.st_size);
+        void *p = m_len ? mmap(NULL, m_len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        int err = m_len ? errno : EINVAL;
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::system_error(err, std::system_category(), std::string("Could not map file ") + filename);
+        madvise(p, m_len, MADV_SEQUENTIAL);  // read-ahead, and drop the pages behind
+#endif
+        m_data = static_cast<uint8_t*>(p);
+    }
+    // create (or truncate) the file with size len and map it for writing
+    void Create(const char *filename, size_t len)
+    {
+        Close();
+        m_len = len;
+#ifdef _WIN32
+        m_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::system_error(GetLastError(), std::system_category(), std::string("Could not create file ") + filename);
+        m_mapping = m_len ? CreateFileMappingA(m_file, NULL, PAGE_READWRITE, DWORD(uint64_t(m_len) >> 32),
+                                               DWORD(m_len), NULL) : NULL;
+        void *p = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0) : NULL;
+        if (!p)
+            throw std::system_error(m_len ? GetLastError() : ERROR_HANDLE_EOF, std::system_category(),
+                                    std::string("Could not map file ") + filename);
+#else
+        int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), std::string("Could not create file ") + filename);
+        if (ftruncate(fd, off_t(m_len)) < 0) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::system_category(), std::string("Could not size file ") + filename);
+        }
+        void *p = m_len ? mmap(NULL, m_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        int err = m_len ? errno : EINVAL;
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::system_error(err, std::system_category(), std::string("Could not map file ") + filename);
+#endif
+        m_data = static_cast<uint8_t*>(p);
+    }
+    void Close()
+    {
+        if (!m_data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        munmap(m_data, m_len);
+#endif
+        m_data = NULL;
+    }
+    const uint8_t *Data() const { return m_data; }
+    uint8_t *WritableData() { return m_data; }
+    size_t Size() const { return m_len; }
+
+private:
+    uint8_t *m_data;
+    size_t m_len;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
+#endif //MAPPED_FILE_H
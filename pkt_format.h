@@ -6,34 +6,111 @@
 //
 
 #include "prague_cc.h"
+#include "scoreboard.h"
+#include "rfc8888_simd.h"
 
 #define BUFFER_SIZE 8192      // in bytes (depending on MTU)
+#define MAX_DGRAM_SIZE 65507  // largest UDP datagram (IPv4), the limit of the sender's data packets
 #define REPORT_SIZE (BUFFER_SIZE / 4)
 #define PKT_BUFFER_SIZE 65536 // [RFC8888] calculated using arithmetic modulo 65536
 #define FRM_BUFFER_SIZE 2048
-#define SND_TIMEOUT 1000000   // Sender timeout in us when window-limited
+#define FRM_DROPPED 0x40000000  // added to the lost packets of a frame dropped before it was sent completely
 #define RCV_TIMEOUT 250000    // Receive timeout for a previously-receiving packet
 
 #define BULK_DATA_TYPE   1
 #define RT_DATA_TYPE     2
+#define FILE_DATA_TYPE   3
+#define RT_FEC_TYPE      4
+#define BIDI_DATA_TYPE   5
 #define PKT_ACK_TYPE     17
 #define RFC8888_ACK_TYPE 18
+#define RLE_ACK_TYPE     19
 
-enum pktsend_tp {snd_init = 0, snd_sent, snd_recv, snd_lost};
-enum pktrecv_tp {rcv_init = 0, rcv_recv, rcv_ackd, rcv_lost};
+#define RLE_MAX_RUN      8192 // run length is coded in 13 bits (length - 1)
+#define RLE_MAX_RUN_SIZE 7    // 2 bytes run header and a varint of up to 5 bytes
+#define RLE_MAX_ATO_SHIFT 16  // coarsest ATO resolution, 2^16 µs
+
+
+inline uint64_t hton64(uint64_t v)
+{
+    return (htonl(1) == 1) ? v : (uint64_t(htonl(uint32_t(v))) << 32) | htonl(uint32_t(v >> 32));
+}
+
+// Frame accounting for a sent packet of frame frm_index that is found lost. frm_pktlost starts at minus the number of
+// lost packets the FEC of the frame always repairs (0 without FEC), so a frame is lost when it becomes positive, and
+// is received when its last packet is found lost while FEC still repairs it
+inline void frame_stat_lost(count_tp frm_index, bool is_sending, count_tp frm_sending, count_tp &recv_frame,
+                            count_tp &lost_frame, count_tp *frm_pktsent, count_tp *frm_pktlost)
+{
+    frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
+    if ((frm_index != frm_sending || !is_sending) &&
+        !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
+        lost_frame++;
+    frm_pktlost[frm_index % FRM_BUFFER_SIZE]++;
+    if ((frm_index != frm_sending || !is_sending) &&
+        !frm_pktsent[frm_index % FRM_BUFFER_SIZE] &&
+        frm_pktlost[frm_index % FRM_BUFFER_SIZE] <= 0)
+        recv_frame++;
+}
+
+// Frame accounting for the frame that is sending when its remaining packets are dropped: it is lost, whatever the
+// feedback on its sent packets will be
+inline void frame_stat_drop(count_tp frm_index, count_tp &lost_frame, count_tp *frm_pktlost)
+{
+    lost_frame++;
+    frm_pktlost[frm_index % FRM_BUFFER_SIZE] += FRM_DROPPED;
+}
+
+// Frame accounting for a sent (or previously lost) packet of frame frm_index that is found received
+inline void frame_stat_recv(pktsend_tp pkt_stat, count_tp frm_index, bool is_sending, count_tp frm_sending, count_tp &recv_frame,
+                            count_tp &lost_frame, count_tp *frm_pktsent, count_tp *frm_pktlost)
+{
+    if (pkt_stat == snd_sent) {
+        frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
+        if ((frm_index != frm_sending || !is_sending) &&
+            !frm_pktsent[frm_index % FRM_BUFFER_SIZE] &&
+            frm_pktlost[frm_index % FRM_BUFFER_SIZE] <= 0)
+            recv_frame++;
+    } else if (pkt_stat == snd_lost) {
+        frm_pktlost[frm_index % FRM_BUFFER_SIZE]--;
+        if ((frm_index != frm_sending || !is_sending) &&
+            !frm_pktlost[frm_index % FRM_BUFFER_SIZE]) {
+            lost_frame--;
+            if (!frm_pktsent[frm_index % FRM_BUFFER_SIZE])
+                recv_frame++;
+        }
+    }
+}
+
+// Reordering-tolerant loss detection of the scoreboard with the frame accounting, frm_pktsent/frm_pktlost can be NULL
+// if frames are not used
+inline count_tp detect_lost(time_tp now, Scoreboard &sb, bool is_sending, count_tp frm_sending, count_tp &recv_frame,
+                            count_tp &lost_frame, count_tp *frm_pktsent, count_tp *frm_pktlost)
+{
+    if (!frm_pktsent)
+        return sb.DetectLost(now);
+    return sb.DetectLost(now, [&](count_tp seq) {
+        frame_stat_lost(sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost); });
+}
 
 #pragma pack(push, 1)
+// The ACK frequency request (ack_window, ack_delay) is always on the wire, also when the sender does not thin ACKs.
+// It made the data headers 8 bytes longer than before, which older senders, receivers and dissectors do not expect.
 struct datamessage_t {
     uint8_t type;
     time_tp timestamp;         // timestamp from peer, freeze and keep this time
     time_tp echoed_timestamp;  // echoed_timestamp can be used to calculate the RTT
     count_tp seq_nr;           // packet sequence number, should start with 1 and increase monotonic with packets sent
+    count_tp ack_window;       // requested ACK frequency: ACK at least once every ack_window packets (1 is every packet)
+    time_tp ack_delay;         // requested ACK frequency: do not hold back an ACK for longer than ack_delay [µs]
 
     void hton() {              // swap the bytes if needed
         type = BULK_DATA_TYPE;
         timestamp = htonl(timestamp);
         echoed_timestamp = htonl(echoed_timestamp);
         seq_nr = htonl(seq_nr);
+        ack_window = htonl(ack_window);
+        ack_delay = htonl(ack_delay);
     }
 };
 
@@ -42,6 +119,8 @@ struct framemessage_t {
     time_tp timestamp;         // timestamp from peer, freeze and keep this time
     time_tp echoed_timestamp;  // echoed_timestamp can be used to calculate the RTT
     count_tp seq_nr;           // packet sequence number, should start with 1 and increase monotonic with packets sent
+    count_tp ack_window;       // requested ACK frequency: ACK at least once every ack_window packets (1 is every packet)
+    time_tp ack_delay;         // requested ACK frequency: do not hold back an ACK for longer than ack_delay [µs]
     count_tp frame_nr;         // frame sequence number, also start with 1 and increase monitonically
     count_tp frame_sent;       // frame sent before this packets
     count_tp frame_size;       // frame size in bytes
@@ -51,49 +130,123 @@ struct framemessage_t {
         timestamp = htonl(timestamp);
         echoed_timestamp = htonl(echoed_timestamp);
         seq_nr = htonl(seq_nr);
+        ack_window = htonl(ack_window);
+        ack_delay = htonl(ack_delay);
         frame_nr = htonl(frame_nr);
         frame_sent = htonl(frame_sent);
         frame_size = htonl(frame_size);
     }
 };
 
-struct ackmessage_t {
+// RT data with FEC: every packet of a frame (data or parity) carries its FEC block and position, see fec.h
+struct fecmessage_t {
+    uint8_t type;
+    time_tp timestamp;         // the same fields as framemessage_t
+    time_tp echoed_timestamp;
+    count_tp seq_nr;
+    count_tp ack_window;
+    time_tp ack_delay;
+    count_tp frame_nr;
+    count_tp frame_sent;
+    count_tp frame_size;       // frame size in bytes, including the parity packets
+    uint8_t fec_scheme;        // FEC_XOR or FEC_RS
+    uint8_t fec_block;         // FEC block of the frame
+    uint8_t fec_k;             // data packets of the block
+    uint8_t fec_m;             // parity packets of the block
+    uint8_t fec_index;         // position in the block, the data packets first (index < fec_k)
+    uint8_t fec_blocks;        // FEC blocks of the frame
+
+    void hton() {              // swap the bytes if needed
+        type = RT_FEC_TYPE;
+        timestamp = htonl(timestamp);
+        echoed_timestamp = htonl(echoed_timestamp);
+        seq_nr = htonl(seq_nr);
+        ack_window = htonl(ack_window);
+        ack_delay = htonl(ack_delay);
+        frame_nr = htonl(frame_nr);
+        frame_sent = htonl(frame_sent);
+        frame_size = htonl(frame_size);
+    }
+};
+
+struct filemessage_t {
+    uint8_t type;
+    time_tp timestamp;         // timestamp from peer, freeze and keep this time
+    time_tp echoed_timestamp;  // echoed_timestamp can be used to calculate the RTT
+    count_tp seq_nr;           // packet sequence number, a retransmitted chunk gets a new one
+    count_tp ack_window;       // requested ACK frequency: ACK at least once every ack_window packets (1 is every packet)
+    time_tp ack_delay;         // requested ACK frequency: do not hold back an ACK for longer than ack_delay [µs]
+    count_tp chunk;            // index of the file chunk in the payload, at offset chunk * chunk_size
+    uint32_t chunk_size;       // size of every chunk but the last
+    uint64_t file_size;
+
+    void hton() {              // swap the bytes if needed
+        type = FILE_DATA_TYPE;
+        timestamp = htonl(timestamp);
+        echoed_timestamp = htonl(echoed_timestamp);
+        seq_nr = htonl(seq_nr);
+        ack_window = htonl(ack_window);
+        ack_delay = htonl(ack_delay);
+        chunk = htonl(chunk);
+        chunk_size = htonl(chunk_size);
+        file_size = hton64(file_size);
+    }
+};
+
+// Data with a piggybacked ACK, for peers that send data in both directions (udp_prague_peer): the timing and sequence
+// fields of the data, followed by the ACK of the data received from the peer. A peer without data due sends an
+// ackmessage_t instead.
+struct bidimessage_t {
     uint8_t type;
-    count_tp ack_seq;
     time_tp timestamp;         // timestamp from peer, freeze and keep this time
     time_tp echoed_timestamp;  // echoed_timestamp can be used to calculate the RTT
+    count_tp seq_nr;           // packet sequence number of the data
+    count_tp ack_seq;          // latest data packet received from the peer
     count_tp packets_received; // echoed_packet counter
     count_tp packets_CE;       // echoed CE counter
     count_tp packets_lost;     // echoed lost counter
     bool error_L4S;            // receiver found a bleached/error ECN; stop using L4S_id on the sending packets!
 
-    void set_stat() {
-        type = PKT_ACK_TYPE;
-        ack_seq = htonl(ack_seq);
+    void hton() {              // swap the bytes if needed
+        type = BIDI_DATA_TYPE;
         timestamp = htonl(timestamp);
         echoed_timestamp = htonl(echoed_timestamp);
+        seq_nr = htonl(seq_nr);
+        ack_seq = htonl(ack_seq);
         packets_received = htonl(packets_received);
         packets_CE = htonl(packets_CE);
         packets_lost = htonl(packets_lost);
     }
-    void get_stat(pktsend_tp *pkts_stat, count_tp &m_packets_lost) {
+};
+
+struct ackmessage_t {
+    uint8_t type;
+    count_tp ack_seq;
+    time_tp timestamp;         // timestamp from peer, freeze and keep this time
+    time_tp echoed_timestamp;  // echoed_timestamp can be used to calculate the RTT
+    count_tp packets_received; // echoed_packet counter
+    count_tp packets_CE;       // echoed CE counter
+    count_tp packets_lost;     // echoed lost counter
+    bool error_L4S;            // receiver found a bleached/error ECN; stop using L4S_id on the sending packets!
+
+    void set_stat() {
+        type = PKT_ACK_TYPE;
         ack_seq = htonl(ack_seq);
         timestamp = htonl(timestamp);
         echoed_timestamp = htonl(echoed_timestamp);
         packets_received = htonl(packets_received);
         packets_CE = htonl(packets_CE);
         packets_lost = htonl(packets_lost);
-
-        pkts_stat[ack_seq % PKT_BUFFER_SIZE] = snd_recv;
-        if (packets_lost - m_packets_lost > 0) {
-            for(uint16_t i = 1; i <= (packets_lost - m_packets_lost); i++)
-                if (pkts_stat[(ack_seq - i) % PKT_BUFFER_SIZE] == snd_sent)
-                    pkts_stat[(ack_seq - i) % PKT_BUFFER_SIZE] = snd_lost;
-        }
-        m_packets_lost = packets_lost;
     }
-    void get_frame_stat(pktsend_tp *pkts_stat, count_tp &m_packets_lost, bool is_sending, count_tp frm_sending, count_tp &recv_frame,
-                        count_tp &lost_frame, count_tp *frm_idx, count_tp *frm_pktsent, count_tp *frm_pktlost) {
+    // An ACK covers all packets since the previous ACK (the receiver might only ACK every ack_window packets).
+    // The receiver ACKs immediately when it detects a loss, so newly lost packets are the ones right before ack_seq.
+    void get_stat(Scoreboard &sb, count_tp &m_packets_lost) {
+        count_tp no_frame = 0;
+        get_frame_stat(sb, m_packets_lost, false, 0, no_frame, no_frame, NULL, NULL);
+    }
+    // frm_pktsent/frm_pktlost can be NULL if frames are not used
+    void get_frame_stat(Scoreboard &sb, count_tp &m_packets_lost, bool is_sending, count_tp frm_sending,
+                        count_tp &recv_frame, count_tp &lost_frame, count_tp *frm_pktsent, count_tp *frm_pktlost) {
         ack_seq = htonl(ack_seq);
         timestamp = htonl(timestamp);
         echoed_timestamp = htonl(echoed_timestamp);
@@ -101,37 +254,24 @@ struct ackmessage_t {
         packets_CE = htonl(packets_CE);
         packets_lost = htonl(packets_lost);
 
-        count_tp frm_index = frm_idx[ack_seq % PKT_BUFFER_SIZE];
-        if (pkts_stat[ack_seq % PKT_BUFFER_SIZE] == snd_sent) {
-            frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
-            if ((frm_index != frm_sending || !is_sending) &&
-                !frm_pktsent[frm_index % FRM_BUFFER_SIZE] &&
-                !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
-                recv_frame++;
-        } else if (pkts_stat[ack_seq % PKT_BUFFER_SIZE] == snd_lost) {
-            frm_pktlost[frm_index % FRM_BUFFER_SIZE]--;
-            if ((frm_index != frm_sending || !is_sending) &&
-                !frm_pktlost[frm_index % FRM_BUFFER_SIZE]) {
-                lost_frame--;
-                if (!frm_pktsent[frm_index % FRM_BUFFER_SIZE])
-                    recv_frame++;
-            }
-        }
-        pkts_stat[ack_seq % PKT_BUFFER_SIZE] = snd_recv;
-
-        if (packets_lost - m_packets_lost > 0) {
-            for(uint16_t i = 1; i <= (packets_lost - m_packets_lost); i++) {
-                if (pkts_stat[(ack_seq - i) % PKT_BUFFER_SIZE] == snd_sent) {
-                    frm_index = frm_idx[(ack_seq - i) % PKT_BUFFER_SIZE];
-                    frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
-                    if ((frm_index != frm_sending || !is_sending) &&
-                        !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
-                        lost_frame++;
-                    frm_pktlost[frm_index % FRM_BUFFER_SIZE]++;
-                    pkts_stat[(ack_seq - i) % PKT_BUFFER_SIZE] = snd_lost;
-                }
-            }
+        count_tp first = sb.LastAck() + 1;
+        count_tp lost_from = ack_seq - (packets_lost - m_packets_lost);
+        if (lost_from - first < 0)
+            lost_from = first;
+        if (lost_from - ack_seq > 0)
+            lost_from = ack_seq;
+        if (frm_pktsent) {
+            sb.MarkRecv(first, lost_from, [&](count_tp seq) {
+                frame_stat_recv(snd_sent, sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost); });
+            sb.MarkLost(lost_from, ack_seq, [&](count_tp seq) {
+                frame_stat_lost(sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost); });
+            frame_stat_recv(sb.Received(ack_seq), sb.Frame(ack_seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost);
+        } else {
+            sb.MarkRecv(first, lost_from);
+            sb.MarkLost(lost_from, ack_seq);
+            sb.Received(ack_seq);
         }
+        sb.AckedUpTo(ack_seq);
         m_packets_lost = packets_lost;
     }
 };
@@ -145,121 +285,93 @@ struct rfc8888ack_t {
     uint16_t get_size(uint16_t rptsize) {
         return sizeof(uint16_t) * rptsize + sizeof(type) + sizeof(begin_seq) + sizeof(num_reports);
     }
-    uint16_t get_stat(time_tp now, time_tp *sendtime, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark, bool &error,
-                      pktsend_tp *pkts_stat, count_tp &last_ack) {
-        uint16_t num_rtt = 0;
-        begin_seq = htonl(begin_seq);
-        num_reports = htons(num_reports);
-        while (last_ack + 1 - begin_seq < 0) {
-            if (pkts_stat[(last_ack + 1) % PKT_BUFFER_SIZE] == snd_sent) {
-                lost++;
-                pkts_stat[(last_ack + 1) % PKT_BUFFER_SIZE] = snd_lost;
-            }
-            last_ack++;
-        }
-        for (uint16_t i = 0; i < num_reports; i++, last_ack++) {
-            uint16_t idx = (begin_seq + i) % PKT_BUFFER_SIZE;
-            report[i] = htons(report[i]);
-            if ((report[i] & 0x8000) >> 15) {
-                if (pkts_stat[idx] == snd_sent || pkts_stat[idx] == snd_lost) {
-                    rcvd++;
-                    mark += ((report[i] & 0x6000) >> 13 == ecn_ce);
-                    error |= ((report[i] & 0x2000) >> 13 == 0x0);
-                    pkts_rtt[num_rtt++] = now - ((report[i] & 0x1FFF) << 10) - sendtime[idx];
-                    if (pkts_stat[idx] == snd_lost)
-                        lost--;
-                    pkts_stat[idx] = snd_recv;
-                }
-            } else {
-                if (pkts_stat[idx] == snd_sent) {
-                    lost++;
-                    pkts_stat[idx] = snd_lost;
-                }
-            }
-        }
-        return num_rtt;
+    uint16_t get_stat(time_tp now, Scoreboard &sb, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark, bool &error) {
+        count_tp no_frame = 0;
+        return get_frame_stat(now, sb, pkts_rtt, rcvd, lost, mark, error, false, 0, no_frame, no_frame, NULL, NULL);
     }
-    uint16_t get_frame_stat(time_tp now, time_tp *sendtime, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark,
-                            bool &error, pktsend_tp *pkts_stat, count_tp &last_ack, bool is_sending, count_tp frm_sending,
-                            count_tp &recv_frame, count_tp &lost_frame, count_tp *frm_idx, count_tp *frm_pktsent, count_tp *frm_pktlost){
-        uint16_t frm_index;
+    // frm_pktsent/frm_pktlost can be NULL if frames are not used
+    uint16_t get_frame_stat(time_tp now, Scoreboard &sb, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark, bool &error,
+                            bool is_sending, count_tp frm_sending, count_tp &recv_frame, count_tp &lost_frame,
+                            count_tp *frm_pktsent, count_tp *frm_pktlost) {
         uint16_t num_rtt = 0;
         begin_seq = htonl(begin_seq);
         num_reports = htons(num_reports);
-        while (last_ack + 1 - begin_seq < 0) {
-            if (pkts_stat[(last_ack + 1) % PKT_BUFFER_SIZE] == snd_sent) {
-                lost++;
-                frm_index = frm_idx[(last_ack + 1) % PKT_BUFFER_SIZE];
-                frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
-                if ((frm_index != frm_sending || !is_sending) &&
-                    !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
-                    lost_frame++;
-                frm_pktlost[frm_index % FRM_BUFFER_SIZE]++;
-                pkts_stat[(last_ack + 1) % PKT_BUFFER_SIZE] = snd_lost;
-            }
-            last_ack++;
-        }
-        for (uint16_t i = 0; i < num_reports; i++, last_ack++) {
-            uint16_t idx = (begin_seq + i) % PKT_BUFFER_SIZE;
-            report[i] = htons(report[i]);
-            if ((report[i] & 0x8000) >> 15) {
-                if (pkts_stat[idx] == snd_sent || pkts_stat[idx] == snd_lost) {
-                    rcvd++;
-                    mark += ((report[i] & 0x6000) >> 13 == ecn_ce);
-                    error |= ((report[i] & 0x2000) >> 13 == 0x0);
-                    pkts_rtt[num_rtt++] = now - ((report[i] & 0x1FFF) << 10) - sendtime[idx];
-                    if (pkts_stat[idx] == snd_lost)
-                        lost--;
-                    frm_index = frm_idx[idx];
-                    if (pkts_stat[idx] == snd_sent) {
-                        frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
-                        if ((frm_index != frm_sending || !is_sending) &&
-                            !frm_pktsent[frm_index % FRM_BUFFER_SIZE] &&
-                            !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
-                            recv_frame++;
-                    } else if (pkts_stat[idx] == snd_lost) {
-                        frm_pktlost[frm_index % FRM_BUFFER_SIZE]--;
-                        if ((frm_index != frm_sending || !is_sending) &&
-                            !frm_pktlost[frm_index % FRM_BUFFER_SIZE]) {
-                            lost_frame--;
-                            if (!frm_pktsent[frm_index % FRM_BUFFER_SIZE])
-                                recv_frame++;
-                        }
+        if (num_reports > REPORT_SIZE)
+            num_reports = REPORT_SIZE;
+        // packets before begin_seq that were not reported yet are lost
+        if (frm_pktsent)
+            lost += sb.MarkLost(sb.LastAck() + 1, begin_seq, [&](count_tp seq) {
+                frame_stat_lost(sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost); });
+        else
+            lost += sb.MarkLost(sb.LastAck() + 1, begin_seq);
+        // Reports are decoded (left in network order) per block of packets that share a scoreboard word: the
+        // block is classified in bulk, the scoreboard word is updated once, and only the changed packets are counted.
+        count_tp seq = begin_seq;
+        for (uint32_t i = 0; i < num_reports; ) {
+            uint32_t n = 32 - (uint32_t(seq) & 31);
+            if (n > num_reports - i)
+                n = num_reports - i;
+            uint32_t recv, ce, notect, to_recv, from_lost, to_lost;
+            rfc8888_classify(report + i, n, REPORT_SIZE - i, recv, ce, notect);
+            sb.Apply(seq, n, recv, to_recv, from_lost, to_lost);
+            if (to_recv) {
+                rcvd += popcount64(to_recv);
+                lost -= popcount64(from_lost);
+                mark += popcount64(to_recv & ce);
+                error |= (to_recv & notect) != 0;
+                if (to_recv == ((n == 32) ? ~0U : (1U << n) - 1)) {
+                    rfc8888_rtt(now, report + i, sb.SendTimes(seq), n, pkts_rtt + num_rtt);
+                    num_rtt += n;
+                } else {
+                    for (uint32_t m = to_recv; m; m &= m - 1) {
+                        uint32_t j = ctz64(m);
+                        pkts_rtt[num_rtt++] = now - ((rfc8888_swap(report[i + j]) & RFC8888_ATO_MASK) << 10) - sb.SendTime(seq + j);
                     }
-                    pkts_stat[idx] = snd_recv;
                 }
-            } else {
-                if (pkts_stat[idx] == snd_sent) {
-                    lost++;
-                    frm_index = frm_idx[idx];
-                    frm_pktsent[frm_index % FRM_BUFFER_SIZE]--;
-                    if ((frm_index != frm_sending || !is_sending) &&
-                        !frm_pktlost[frm_index % FRM_BUFFER_SIZE])
-                        lost_frame++;
-                    frm_pktlost[frm_index % FRM_BUFFER_SIZE]++;
-                    pkts_stat[idx] = snd_lost;
+                if (frm_pktsent) {
+                    for (uint32_t m = to_recv; m; m &= m - 1) {
+                        uint32_t j = ctz64(m);
+                        frame_stat_recv((from_lost >> j) & 1 ? snd_lost : snd_sent, sb.Frame(seq + j), is_sending, frm_sending,
+                                        recv_frame, lost_frame, frm_pktsent, frm_pktlost);
+                    }
+                }
+            }
+            if (to_lost) {
+                lost += popcount64(to_lost);
+                if (frm_pktsent) {
+                    for (uint32_t m = to_lost; m; m &= m - 1)
+                        frame_stat_lost(sb.Frame(seq + ctz64(m)), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost);
                 }
             }
+            i += n;
+            seq += n;
         }
+        sb.AckedUpTo(begin_seq + num_reports - 1);
         return num_rtt;
     }
-    uint16_t set_stat(count_tp &seq, count_tp maxseq, time_tp now, time_tp *recvtime, ecn_tp *recvecn, pktrecv_tp *recvseq, size_tp maxpkt) {
+    uint16_t set_stat(count_tp &seq, count_tp maxseq, time_tp now, RecvScoreboard &rb, size_tp maxpkt) {
         uint16_t rptsize = sizeof(type) + sizeof(begin_seq) + sizeof(num_reports);
         uint16_t reports = maxseq - seq > (count_tp)((maxpkt - rptsize) / sizeof(uint16_t)) ?
                            (count_tp)((maxpkt - rptsize) / sizeof(uint16_t)) :
                            maxseq - seq;
         begin_seq = seq;
-        for (uint16_t i = 0; i < reports; i++, seq++) {
-            uint16_t idx = (begin_seq + i) % PKT_BUFFER_SIZE;
-            if (recvseq[idx] == rcv_recv || (recvseq[idx] == rcv_ackd && recvtime[idx] + RCV_TIMEOUT - now > 0)) {
-                report[i] = htons((0x1 << 15) + ((recvecn[idx] & ecn_ce) << 13) + (((now - recvtime[idx] + (1 << 9)) >> 10) & 0x1FFF));
-                recvseq[idx] = rcv_ackd;
+        // encode per block of packets that share a bitmap word of the receiver scoreboard
+        for (uint32_t i = 0; i < reports; ) {
+            uint32_t n = 32 - (uint32_t(seq) & 31);
+            if (n > reports - i)
+                n = reports - i;
+            uint32_t recv = rb.Classify(seq, n, now, RCV_TIMEOUT);
+            if (recv) {
+                rfc8888_encode(now, rb.Records(seq), n, recv, report + i);
             } else {
-                report[i] = htons(0);
-                recvseq[idx] = rcv_lost;
+                for (uint32_t j = 0; j < n; j++)  // a run of missing packets
+                    report[i + j] = 0;
             }
-            rptsize += sizeof(uint16_t);
+            rb.Reported(seq, n, recv);
+            i += n;
+            seq += n;
         }
+        rptsize += reports * sizeof(uint16_t);
 
         type = RFC8888_ACK_TYPE;
         begin_seq = htonl(begin_seq);
@@ -267,6 +379,199 @@ struct rfc8888ack_t {
         return rptsize;
     }
 };
+
+// Run-length compressed feedback: same information as rfc8888ack_t, but runs of packets with the same received flag,
+// ECN and arrival time offset (ATO) share a single 16-bit run header (received:1, ECN:2, length-1:13 bits), followed
+// for received runs by the zigzag varint coded ATO delta to the previous received run (in 2^ato_shift µs units).
+struct rleack_t {
+    uint8_t type;
+    count_tp begin_seq;        // Use 32-bit sequence number
+    uint16_t num_reports;      // number of packets covered by the runs
+    uint16_t num_runs;
+    uint8_t ato_shift;         // ATO resolution in 2^ato_shift µs
+    uint8_t runs[BUFFER_SIZE - 10];
+
+    uint16_t get_size(uint16_t runsize) {
+        return runsize + sizeof(type) + sizeof(begin_seq) + sizeof(num_reports) + sizeof(num_runs) + sizeof(ato_shift);
+    }
+    uint16_t put_run(uint16_t pos, uint16_t hdr, uint32_t len, int32_t delta) {
+        uint16_t start = pos;
+        hdr |= uint16_t(len - 1);
+        runs[pos++] = uint8_t(hdr >> 8);
+        runs[pos++] = uint8_t(hdr);
+        if (hdr & 0x8000) {
+            uint32_t v = (uint32_t(delta) << 1) ^ uint32_t(delta >> 31);  // zigzag
+            while (v >= 0x80) {
+                runs[pos++] = uint8_t(v | 0x80);
+                v >>= 7;
+            }
+            runs[pos++] = uint8_t(v);
+        }
+        return pos - start;
+    }
+    bool get_run(uint16_t &pos, uint16_t size, uint16_t &hdr, uint32_t &len, time_tp &ato) {
+        if (pos + 2 > size)
+            return false;
+        hdr = uint16_t((runs[pos] << 8) | runs[pos + 1]);
+        pos += 2;
+        len = (hdr & 0x1FFF) + 1;
+        if (hdr & 0x8000) {
+            uint32_t v = 0;
+            for (uint8_t shift = 0; ; shift += 7) {
+                if (pos >= size || shift > 28)
+                    return false;
+                v |= uint32_t(runs[pos] & 0x7F) << shift;
+                if (!(runs[pos++] & 0x80))
+                    break;
+            }
+            ato += time_tp(v >> 1) ^ -time_tp(v & 1);  // un-zigzag
+        }
+        return true;
+    }
+    uint16_t get_stat(time_tp now, Scoreboard &sb, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark, bool &error,
+                      size_tp msg_size) {
+        count_tp no_frame = 0;
+        return get_frame_stat(now, sb, pkts_rtt, rcvd, lost, mark, error, msg_size, false, 0, no_frame, no_frame, NULL, NULL);
+    }
+    // frm_pktsent/frm_pktlost can be NULL if frames are not used
+    uint16_t get_frame_stat(time_tp now, Scoreboard &sb, time_tp *pkts_rtt, count_tp &rcvd, count_tp &lost, count_tp &mark, bool &error,
+                            size_tp msg_size, bool is_sending, count_tp frm_sending, count_tp &recv_frame, count_tp &lost_frame,
+                            count_tp *frm_pktsent, count_tp *frm_pktlost) {
+        uint16_t num_rtt = 0;
+        uint16_t size = (msg_size > get_size(0)) ? uint16_t(msg_size - get_size(0)) : 0;
+        begin_seq = htonl(begin_seq);
+        num_reports = htons(num_reports);
+        num_runs = htons(num_runs);
+        if (num_reports > REPORT_SIZE)
+            num_reports = REPORT_SIZE;  // never more RTT samples than pkts_rtt can hold
+        if (ato_shift > RLE_MAX_ATO_SHIFT) {
+            num_reports = 0;  // malformed feedback, the ATOs cannot be decoded
+            return 0;
+        }
+        auto on_lost = [&](count_tp seq) {
+            frame_stat_lost(sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost); };
+        // packets before begin_seq that were not reported yet are lost
+        if (frm_pktsent)
+            lost += sb.MarkLost(sb.LastAck() + 1, begin_seq, on_lost);
+        else
+            lost += sb.MarkLost(sb.LastAck() + 1, begin_seq);
+        uint16_t pos = 0, hdr = 0, i = 0;
+        uint32_t len = 0;
+        time_tp ato = 0;
+        for (uint16_t r = 0; r < num_runs && i < num_reports; r++) {
+            if (!get_run(pos, size, hdr, len, ato))
+                break;  // malformed or truncated feedback
+            if (len > uint32_t(num_reports - i))
+                len = num_reports - i;
+            count_tp seq = begin_seq + i;
+            i += uint16_t(len);
+            if (!(hdr & 0x8000)) {
+                // a lost run is marked as a whole
+                if (frm_pktsent)
+                    lost += sb.MarkLost(seq, seq + count_tp(len), on_lost);
+                else
+                    lost += sb.MarkLost(seq, seq + count_tp(len));
+                continue;
+            }
+            // all packets of a received run share the ECN and ATO, count them in locals
+            time_tp rtt_base = now - time_tp(uint32_t(ato) << ato_shift);
+            count_tp nrcvd = 0, nrecovered = 0;
+            for (count_tp end = begin_seq + i; seq != end; seq++) {
+                pktsend_tp state = sb.Received(seq);
+                if (state == snd_sent || state == snd_lost) {
+                    nrcvd++;
+                    nrecovered += (state == snd_lost);
+                    pkts_rtt[num_rtt++] = rtt_base - sb.SendTime(seq);
+                    if (frm_pktsent)
+                        frame_stat_recv(state, sb.Frame(seq), is_sending, frm_sending, recv_frame, lost_frame, frm_pktsent, frm_pktlost);
+                }
+            }
+            rcvd += nrcvd;
+            lost -= nrecovered;
+            if (nrcvd) {
+                mark += ((hdr & 0x6000) >> 13 == ecn_ce) ? nrcvd : 0;
+                error |= ((hdr & 0x2000) >> 13 == 0x0);
+            }
+        }
+        num_reports = i;  // the reports actually processed (for logging)
+        sb.AckedUpTo(begin_seq + i - 1);
+        return num_rtt;
+    }
+    // Encode the reports from seq up to maxseq (or until maxpkt is reached), and count what is reported in rcvd/mark/lost/ato_sum
+    uint16_t set_stat(count_tp &seq, count_tp maxseq, time_tp now, RecvScoreboard &rb, size_tp maxpkt,
+                      uint8_t shift, count_tp &rcvd, count_tp &mark, count_tp &lost, rate_tp &ato_sum) {
+        size_tp limit = (maxpkt > get_size(0)) ? maxpkt - get_size(0) : 0;
+        if (limit > sizeof(runs))
+            limit = sizeof(runs);
+        count_tp reports = (maxseq - seq > REPORT_SIZE) ? REPORT_SIZE : maxseq - seq;
+        uint16_t size = 0, nruns = 0, run_hdr = 0;
+        uint32_t run_len = 0;
+        time_tp run_ato = 0, prev_ato = 0;
+        count_tp i = 0;
+        bool full = false;
+        begin_seq = seq;
+        // classify per block of packets that share a bitmap word of the receiver scoreboard
+        while (i < reports && !full) {
+            count_tp bseq = begin_seq + i;
+            uint32_t n = 32 - (uint32_t(bseq) & 31);
+            if (n > uint32_t(reports - i))
+                n = reports - i;
+            uint32_t recv = rb.Classify(bseq, n, now, RCV_TIMEOUT);
+            const uint32_t *rec = rb.Records(bseq);
+            uint32_t j = 0;
+            if (!recv && run_len && !run_hdr && run_len + n <= RLE_MAX_RUN) {
+                run_len += n;  // a run of missing packets continues
+                lost += n;
+                j = n;
+            }
+            for (; j < n; j++) {
+                uint16_t hdr = 0;
+                time_tp ato = 0;
+                if ((recv >> j) & 1) {
+                    hdr = uint16_t((0x1 << 15) + ((rec[j] & ecn_ce) << 13));
+                    ato = rfc8888_ato(now, rec[j], shift);
+                }
+                if (!run_len || hdr != run_hdr || ato != run_ato || run_len == RLE_MAX_RUN) {
+                    if (run_len) {
+                        size += put_run(size, run_hdr, run_len, run_ato - prev_ato);
+                        nruns++;
+                        if (run_hdr & 0x8000)
+                            prev_ato = run_ato;
+                    }
+                    if (size_tp(size + RLE_MAX_RUN_SIZE) > limit) {
+                        full = true;  // no room for another run
+                        break;
+                    }
+                    run_hdr = hdr;
+                    run_ato = ato;
+                    run_len = 0;
+                }
+                run_len++;
+                if (hdr) {
+                    rcvd++;
+                    mark += ((rec[j] & ecn_ce) == ecn_ce);
+                    ato_sum += rate_tp(ato) << shift;
+                } else {
+                    lost++;
+                }
+            }
+            rb.Reported(bseq, j, (j == 32) ? recv : recv & ((1U << j) - 1));
+            i += j;
+        }
+        if (!full && run_len) {
+            size += put_run(size, run_hdr, run_len, run_ato - prev_ato);
+            nruns++;
+        }
+        seq = begin_seq + i;
+
+        type = RLE_ACK_TYPE;
+        begin_seq = htonl(begin_seq);
+        num_reports = htons(uint16_t(i));
+        num_runs = htons(nruns);
+        ato_shift = shift;
+        return get_size(size);
+    }
+};
 #pragma pack(pop)
 
 #endif //PKT_FORMAT_H
@@ -70,6 +70,10 @@ const count_tp MIN_PKT_BURST = 1;          // 1 packet
 const count_tp MIN_PKT_WIN = 2;            // 2 packets
 const uint8_t RATE_OFFSET = 3;             // +3% and -3% for non-RTmode transfer during 1st and 2nd halve vrtt
 const count_tp MIN_FRAME_WIN = 2;          // 2 frames
+const time_tp INIT_PTO = 1000000;          // 1s probe timeout before an RTT is measured
+const time_tp TIMER_GRANULARITY = 1000;    // 1ms minimum RTT variation margin of the probe timeout
+const time_tp MIN_RTO = 200000;            // 200ms minimum timeout before the window is collapsed
+const time_tp MAX_RTO = 60000000;          // 60s maximum backed-off timeout
 
 time_tp PragueCC::Now() // Returns number of µs since first call
 {
@@ -129,7 +133,15 @@ PragueCC::PragueCC(
     m_ts_remote = 0;    // to keep the frozen timestamp from the peer, and echo it back defrosted
     m_rtt = 0;          // last reported rtt (only for stats)
     m_srtt = 0;         // our own measured and smoothed RTT (smoothing factor = 1/8)
+    m_rttvar = 0;       // our own measured RTT variation (smoothing factor = 1/4)
     m_vrtt = 0;         // our own virtual RTT = max(srtt, 25ms)
+    m_min_rtt = 0;      // our own windowed min RTT, the base RTT estimate
+    m_qdelay = 0;       // our own queueing delay estimate = srtt - min_rtt
+    for (int i = 0; i < 3; i++) {
+        m_min_rtt_win[i] = 0;
+        m_min_rtt_ts[i] = 0;
+    }
+    m_min_rtt_valid = false;  // no RTT sample in the min filter yet
 // receiver end variables (to be echoed to sender)
     m_r_prev_ts = 0;      // used to see if an ack isn't older than the previous ack
     m_r_packets_received = 0; // as a receiver, keep counters to echo back
@@ -185,16 +197,61 @@ PragueCC::PragueCC(
 PragueCC::~PragueCC()
 {}
 
-bool PragueCC::RFC8888Received(size_t num_rtt, time_tp *pkts_rtt)
+void PragueCC::RTTSample(time_tp rtt, time_tp now)
 {
-    for (size_t i = 0; i < num_rtt; i++) {
-        m_rtt = pkts_rtt[i];
-        if (m_cc_state != cs_init)
-            m_srtt += (m_rtt - m_srtt) >> 3;
-        else
-            m_srtt = m_rtt;
-        m_vrtt = (m_srtt > get_ref_rtt()) ? m_srtt : get_ref_rtt();
+    m_rtt = rtt;
+    if (m_cc_state != cs_init) {
+        m_rttvar += (((m_rtt > m_srtt) ? m_rtt - m_srtt : m_srtt - m_rtt) - m_rttvar) >> 2;  // before srtt is updated
+        m_srtt += (m_rtt - m_srtt) >> 3;  // smooth with EWMA of 1/8th
+    } else {
+        m_srtt = m_rtt;
+        m_rttvar = m_rtt >> 1;
     }
+    m_vrtt = (m_srtt > get_ref_rtt()) ? m_srtt : get_ref_rtt(); // calculate the virtual RTT (if srtt < 25ms reference RTT)
+    if (m_rtt <= 0)  // not a base RTT (RFC8888 ATO quantisation), keep it out of min_rtt and qdelay
+        return;
+    // windowed min filter (as in BBR): the best sample of the window, and the best of its last 3/4 and last 1/2
+    if (!m_min_rtt_valid || m_rtt <= m_min_rtt_win[0] || now - m_min_rtt_ts[2] > PRAGUE_MINRTTWIN) {
+        m_min_rtt_valid = true;
+        for (int i = 0; i < 3; i++) {  // new min or nothing valid left in the window: restart with only this sample
+            m_min_rtt_win[i] = m_rtt;
+            m_min_rtt_ts[i] = now;
+        }
+    } else {
+        if (m_rtt <= m_min_rtt_win[1]) {
+            m_min_rtt_win[2] = m_min_rtt_win[1] = m_rtt;
+            m_min_rtt_ts[2] = m_min_rtt_ts[1] = now;
+        } else if (m_rtt <= m_min_rtt_win[2]) {
+            m_min_rtt_win[2] = m_rtt;
+            m_min_rtt_ts[2] = now;
+        }
+        time_tp age = now - m_min_rtt_ts[0];
+        if (age > PRAGUE_MINRTTWIN) {  // the best expired, promote the next ones
+            for (int n = 0; n < 2 && now - m_min_rtt_ts[0] > PRAGUE_MINRTTWIN; n++) {
+                m_min_rtt_win[0] = m_min_rtt_win[1];
+                m_min_rtt_ts[0] = m_min_rtt_ts[1];
+                m_min_rtt_win[1] = m_min_rtt_win[2];
+                m_min_rtt_ts[1] = m_min_rtt_ts[2];
+                m_min_rtt_win[2] = m_rtt;
+                m_min_rtt_ts[2] = now;
+            }
+        } else if (m_min_rtt_ts[1] == m_min_rtt_ts[0] && age > PRAGUE_MINRTTWIN / 4) {
+            m_min_rtt_win[2] = m_min_rtt_win[1] = m_rtt;  // take a 2nd choice from the 2nd quarter of the window
+            m_min_rtt_ts[2] = m_min_rtt_ts[1] = now;
+        } else if (m_min_rtt_ts[2] == m_min_rtt_ts[1] && age > PRAGUE_MINRTTWIN / 2) {
+            m_min_rtt_win[2] = m_rtt;  // take a 3rd choice from the 2nd half of the window
+            m_min_rtt_ts[2] = now;
+        }
+    }
+    m_min_rtt = m_min_rtt_win[0];
+    m_qdelay = (m_srtt > m_min_rtt) ? m_srtt - m_min_rtt : 0;
+}
+
+bool PragueCC::RFC8888Received(size_t num_rtt, time_tp *pkts_rtt)
+{
+    time_tp ts = Now();
+    for (size_t i = 0; i < num_rtt; i++)
+        RTTSample(pkts_rtt[i], ts);
     return true;
 }
 
@@ -207,12 +264,8 @@ bool PragueCC::PacketReceived(         // call this when a packet is received fr
         return false;
     time_tp ts = Now();
     m_ts_remote = ts - timestamp;  // freeze the remote timestamp
-    m_rtt = ts - echoed_timestamp; // calculate the new rtt sample
-    if (m_cc_state != cs_init)
-        m_srtt += (m_rtt - m_srtt) >> 3;  // smooth with EWMA of 1/8th
-    else
-        m_srtt = m_rtt;
-    m_vrtt = (m_srtt > get_ref_rtt()) ? m_srtt : get_ref_rtt(); // calculate the virtual RTT (if srtt < 25ms reference RTT)
+    if (echoed_timestamp)  // 0 if the peer has nothing to echo (yet), for instance with RFC8888 feedback
+        RTTSample(ts - echoed_timestamp, ts); // calculate and process the new rtt sample
     m_r_prev_ts = timestamp;
     return true;
 }
@@ -518,6 +571,53 @@ void PragueCC::GetCCInfo(     // when the sending-app needs to send a packet
     packet_size = m_packet_size;
 }
 
+void PragueCC::GetACKFreqInfo( // when the sending-app wants the receiver to thin its ACKs
+    count_tp &ack_window,      // number of packets the receiver can receive before it must ACK
+    time_tp &ack_delay,        // maximum time [µs] the receiver can hold back an ACK
+    count_tp acks_per_rtt)     // targeted number of ACKs (or RFC8888 feedback packets) per window/srtt
+{
+    if (acks_per_rtt < 1)
+        acks_per_rtt = 1;
+    if (m_cc_state == cs_init) {
+        ack_window = 1;  // ACK every packet until the window and srtt are known
+        ack_delay = 0;
+        return;
+    }
+    ack_window = m_packet_window / acks_per_rtt;
+    if (ack_window < 1)
+        ack_window = 1;
+    // allow twice the time needed to pace an ack_window, but never more than a fraction of the srtt
+    ack_delay = time_tp(2 * ack_window * m_packet_size * 1000000 / m_pacing_rate);
+    if (ack_delay > m_srtt / acks_per_rtt)
+        ack_delay = m_srtt / acks_per_rtt;
+    if (ack_delay <= 0)
+        ack_delay = 1;
+}
+
+void PragueCC::GetTimeoutInfo( // when the sending-app is window-limited and waits for feedback
+    time_tp &timeout,          // time [µs] to wait: the probe timeout (PTO) first, a backed-off retransmission timeout after
+    count_tp timeouts,         // consecutive timeouts without feedback so far
+    time_tp max_ack_delay)     // maximum time [µs] the receiver can hold back feedback
+{
+    if (m_srtt <= 0) {
+        timeout = INIT_PTO;
+    } else {
+        time_tp margin = 4 * m_rttvar;
+        timeout = m_srtt + ((margin > TIMER_GRANULARITY) ? margin : TIMER_GRANULARITY) + max_ack_delay;
+    }
+    // double the timeout for every timeout, but wait at least MIN_RTO (also doubled) once the probe was not answered
+    time_tp min_rto = MIN_RTO;
+    for (count_tp i = 0; i < timeouts && timeout < MAX_RTO; i++) {
+        timeout *= 2;
+        if (i > 0 && min_rto < MAX_RTO)
+            min_rto *= 2;
+    }
+    if (timeouts > 0 && timeout < min_rto)
+        timeout = min_rto;
+    if (timeout > MAX_RTO)
+        timeout = MAX_RTO;
+}
+
 void PragueCC::GetCCInfoVideo( // when the sending app needs to send a frame
     rate_tp &pacing_rate,      // rate to pace the packets
     size_tp &frame_size,       // the size of a single frame in Bytes
@@ -23,6 +23,8 @@ static const size_tp  PRAGUE_INITMTU  = 1400;        // Prague initial MTU size
 static const rate_tp  PRAGUE_INITRATE = 12500;       // Prague initial rate 12500 Byte/s (equiv. 100kbps)
 static const rate_tp  PRAGUE_MINRATE  = 12500;       // Prague minimum rate 12500 Byte/s (equiv. 100kbps)
 static const rate_tp  PRAGUE_MAXRATE  = 12500000000; // Prague maximum rate 12500000000 Byte/s (equiv. 100Gbps)
+static const count_tp PRAGUE_ACKSPERRTT = 4;         // Prague default number of (thinned) ACKs or feedback packets per RTT
+static const time_tp  PRAGUE_MINRTTWIN = 10000000;   // Prague window of the min RTT filter 10s
 
 struct PragueState {
     time_tp   m_start_ref;  // used to have a start time of 0
@@ -79,6 +81,13 @@ struct PragueState {
     count_tp  m_packet_burst;
     size_tp   m_packet_size;
     count_tp  m_packet_window;
+// added later, kept at the end so the layout of the fields above stays the same for existing readers
+    time_tp   m_rttvar;        // our own measured RTT variation (smoothing factor = 1/4)
+    time_tp   m_min_rtt;       // our own windowed min RTT over the last PRAGUE_MINRTTWIN, the base RTT estimate
+    time_tp   m_qdelay;        // our own queueing delay estimate = srtt - min_rtt
+    time_tp   m_min_rtt_win[3];// best, 2nd best and 3rd best min RTT sample of the windowed min filter (Kathleen Nichols)
+    time_tp   m_min_rtt_ts[3]; // and when they were taken
+    bool      m_min_rtt_valid; // the min filter holds a valid RTT sample, so min_rtt and qdelay can be used
 };
 
 class PragueCC: private PragueState {
@@ -152,6 +161,16 @@ public:
         count_tp &packets_lost,    // lost counter to echo (if used)
         bool &error_L4S);          // bleached/error ECN status to echo
 
+    void GetACKFreqInfo(       // when the sending-app wants the receiver to thin its ACKs (like QUIC ACK_FREQUENCY)
+        count_tp &ack_window,      // number of packets the receiver can receive before it must ACK
+        time_tp &ack_delay,        // maximum time [µs] the receiver can hold back an ACK
+        count_tp acks_per_rtt = PRAGUE_ACKSPERRTT); // targeted number of ACKs (or RFC8888 feedback packets) per window/srtt
+
+    void GetTimeoutInfo(       // when the sending-app is window-limited and waits for feedback
+        time_tp &timeout,          // time [µs] to wait: the probe timeout (PTO) first, a backed-off retransmission timeout after
+        count_tp timeouts = 0,     // consecutive timeouts without feedback so far
+        time_tp max_ack_delay = 0);// maximum time [µs] the receiver can hold back feedback
+
     void GetCCInfoVideo(       // when the sending app needs to send a frame
         rate_tp &pacing_rate,      // rate to pace the packets
         size_tp &frame_size,       // the size of a single frame in Bytes
@@ -166,8 +185,14 @@ public:
 
     const PragueState* GetStatePtr() // For logging purposes
     {
-        return this;  // gives a const pointer for reading the live state
+        return this;  // gives a const pointer for reading the live state (only from the CC thread,
+                      // other threads and processes can read a prague_snapshot_t from prague_snapshot.h)
     }
 
+private:
+    void RTTSample(            // updates srtt, rttvar, vrtt, and with a positive sample min_rtt and qdelay
+        time_tp rtt,               // the new RTT sample
+        time_tp now);              // when the sample was taken
+
 };
 #endif //PRAGUE_CC_H
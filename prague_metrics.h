@@ -0,0 +1,298 @@
+#ifndef PRAGUE_METRICS_H
+#define PRAGUE_METRICS_H
+
+// prague_metrics.h:
+// OpenMetrics endpoint for the PragueCC state of a flow. The CC thread only publishes a prague_snapshot_t and updates
+// a few single-writer counters and histogram buckets in prague_metrics_t; a separate server thread answers scrapes
+// (HTTP GET on a loopback TCP port or on a unix socket) from those, so scraping never touches the datapath.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "prague_snapshot.h"
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0  // macOS: SO_NOSIGPIPE is set on the socket instead
+#endif
+
+#define METRICS_BUCKETS 14
+// histogram bucket upper bounds in us, the last bucket is +Inf
+static const time_tp METRICS_BOUNDS[METRICS_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+// single-writer (CC thread) counters, readable from any thread
+struct prague_histogram_t {
+    std::atomic<uint64_t> buckets[METRICS_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;  // in us
+
+    void init()
+    {
+        for (int i = 0; i < METRICS_BUCKETS; i++)
+            buckets[i].store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+    }
+    void observe(time_tp v)
+    {
+        int i = 0;
+        while (i < METRICS_BUCKETS - 1 && v > METRICS_BOUNDS[i])
+            i++;
+        // only one writer, so no atomic read-modify-write is needed
+        buckets[i].store(buckets[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum.store(sum.load(std::memory_order_relaxed) + uint64_t(v > 0 ? v : 0), std::memory_order_relaxed);
+    }
+};
+
+struct prague_metrics_t {
+    enum {m_sent, m_received, m_CE, m_lost, m_counters};
+    std::atomic<uint64_t> counters[m_counters];        // 64-bit totals of the wrapping PragueCC packet counters
+    std::atomic<uint64_t> transitions[cs_in_cwr + 1];  // transitions into each cc_state
+    prague_histogram_t rtt;                            // RTT samples, one per observed update
+    prague_histogram_t qdelay;                         // queueing delay estimates (srtt - min_rtt)
+    count_tp prev[m_counters];
+    cs_tp prev_state;
+
+    void init()
+    {
+        for (int i = 0; i < m_counters; i++) {
+            counters[i].store(0, std::memory_order_relaxed);
+            prev[i] = 0;
+        }
+        for (int i = 0; i <= cs_in_cwr; i++)
+            transitions[i].store(0, std::memory_order_relaxed);
+        rtt.init();
+        qdelay.init();
+        prev_state = cs_init;
+    }
+    // CC thread: call with the live state after each update that is also published in the snapshot
+    void observe(const PragueState &state, bool sender)
+    {
+        count_tp cur[m_counters] = {sender ? state.m_packets_sent : 0,
+                                    sender ? state.m_packets_received : state.m_r_packets_received,
+                                    sender ? state.m_packets_CE : state.m_r_packets_CE,
+                                    sender ? state.m_packets_lost : state.m_r_packets_lost};
+        for (int i = 0; i < m_counters; i++) {
+            if (cur[i] - prev[i] > 0)
+                counters[i].store(counters[i].load(std::memory_order_relaxed) + uint32_t(cur[i] - prev[i]), std::memory_order_relaxed);
+            prev[i] = cur[i];
+        }
+        if (state.m_cc_state != prev_state) {
+            transitions[state.m_cc_state].store(transitions[state.m_cc_state].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            prev_state = state.m_cc_state;
+        }
+        if (state.m_rtt > 0) {
+            rtt.observe(state.m_rtt);
+            if (state.m_min_rtt_valid)
+                qdelay.observe(state.m_qdelay);
+        }
+    }
+};
+
+#ifndef _WIN32
+// Serves the OpenMetrics text of one flow from its own thread
+class MetricsServer {
+public:
+    MetricsServer(): m_fd(-1), m_stop(false), m_snapshot(NULL), m_metrics(NULL), m_sender(false) {}
+    ~MetricsServer() { Stop(); }
+
+    // addr is a loopback TCP port, or unix:<path> for a unix socket
+    void Start(const char *addr, const char *flow, bool sender, const prague_snapshot_t *snapshot, const prague_metrics_t *metrics)
+    {
+        std::string a = addr;
+        if (a.compare(0, 5, "unix:") == 0) {
+            sockaddr_un sa = sockaddr_un();
+            sa.sun_family = AF_UNIX;
+            if (a.size() - 5 >= sizeof(sa.sun_path))
+                throw std::system_error(ENAMETOOLONG, std::system_category(), "Metrics socket path too long");
+            a.copy(sa.sun_path, a.size() - 5, 5);
+            m_path = sa.sun_path;
+            unlink(m_path.c_str());
+            Listen(AF_UNIX, (sockaddr*)&sa, sizeof(sa));
+        } else {
+            char *p;
+            unsigned long port = strtoul(addr, &p, 10);
+            if (*p != '\0' || !port || port > 65535)
+                throw std::system_error(EINVAL, std::system_category(), "Invalid metrics port or unix:<path>");
+            sockaddr_in sa = sockaddr_in();
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons(uint16_t(port));
+            sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            Listen(AF_INET, (sockaddr*)&sa, sizeof(sa));
+        }
+        m_flow = flow;
+        m_sender = sender;
+        m_snapshot = snapshot;
+        m_metrics = metrics;
+        m_thread = std::thread(&MetricsServer::Run, this);
+    }
+    void Stop()
+    {
+        if (m_fd < 0)
+            return;
+        m_stop = true;
+        m_thread.join();
+        close(m_fd);
+        m_fd = -1;
+        if (!m_path.empty())
+            unlink(m_path.c_str());
+    }
+    // the OpenMetrics text exposition of the current snapshot and counters
+    std::string Format() const
+    {
+        std::string out;
+        char label[160];
+        snprintf(label, sizeof(label), "flow=\"%s\",role=\"%s\"", m_flow.c_str(), m_sender ? "sender" : "receiver");
+        PragueState s;
+        time_tp ts;
+        if (m_snapshot->read(s, ts)) {
+            Gauge(out, "prague_pacing_rate_bytes_per_second", "Pacing rate", label, double(s.m_pacing_rate));
+            Gauge(out, "prague_window_bytes", "Congestion window", label, double(s.m_fractional_window / 1000000));
+            Gauge(out, "prague_window_packets", "Congestion window in packets", label, double(s.m_packet_window));
+            Gauge(out, "prague_packet_size_bytes", "Packet size", label, double(s.m_packet_size));
+            Gauge(out, "prague_srtt_seconds", "Smoothed RTT", label, s.m_srtt / 1e6);
+            Gauge(out, "prague_rttvar_seconds", "RTT variation", label, s.m_rttvar / 1e6);
+            Gauge(out, "prague_min_rtt_seconds", "Windowed minimum RTT", label, s.m_min_rtt / 1e6);
+            Gauge(out, "prague_qdelay_seconds", "Queueing delay estimate srtt - min_rtt", label, s.m_qdelay / 1e6);
+            Gauge(out, "prague_alpha", "Prague alpha (CE fraction EWMA)", label, s.m_alpha / 1048576.0);
+            Gauge(out, "prague_error_l4s", "L4S ECN error detected", label, double(m_sender ? s.m_error_L4S : s.m_r_error_L4S));
+            static const char *const names[] = {"init", "cong_avoid", "in_loss", "in_cwr"};
+            out += "# TYPE prague_cc_state stateset\n# HELP prague_cc_state Congestion control state\n";
+            for (int i = 0; i <= cs_in_cwr; i++)
+                Line(out, "prague_cc_state", label, "prague_cc_state", names[i], s.m_cc_state == i ? 1 : 0);
+            out += "# TYPE prague_cc_state_transitions counter\n# HELP prague_cc_state_transitions Transitions into a cc_state\n";
+            for (int i = 0; i <= cs_in_cwr; i++)
+                Line(out, "prague_cc_state_transitions_total", label, "to", names[i], double(m_metrics->transitions[i].load(std::memory_order_relaxed)));
+        }
+        Counter(out, "prague_packets_sent", "Packets sent", label, m_metrics->counters[prague_metrics_t::m_sent]);
+        Counter(out, "prague_packets_received", "Packets received (as reported by the receiver)", label, m_metrics->counters[prague_metrics_t::m_received]);
+        Counter(out, "prague_packets_ce", "Packets with a CE mark", label, m_metrics->counters[prague_metrics_t::m_CE]);
+        Counter(out, "prague_packets_lost", "Packets lost", label, m_metrics->counters[prague_metrics_t::m_lost]);
+        Histogram(out, "prague_rtt_seconds", "RTT samples", label, m_metrics->rtt);
+        Histogram(out, "prague_queue_delay_seconds", "Queueing delay estimates", label, m_metrics->qdelay);
+        out += "# EOF\n";
+        return out;
+    }
+
+private:
+    void Listen(int family, sockaddr *sa, socklen_t len)
+    {
+        m_fd = socket(family, SOCK_STREAM, 0);
+        if (m_fd < 0)
+            throw std::system_error(errno, std::system_category(), "Could not create metrics socket");
+        int one = 1;
+        if (family == AF_INET)
+            setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(m_fd, sa, len) < 0 || listen(m_fd, 8) < 0) {
+            int err = errno;
+            close(m_fd);
+            m_fd = -1;
+            throw std::system_error(err, std::system_category(), "Could not listen on metrics socket");
+        }
+    }
+    void Run()
+    {
+        while (!m_stop) {
+            pollfd pfd = {m_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0)
+                continue;
+            int c = accept(m_fd, NULL, NULL);
+            if (c < 0)
+                continue;
+#ifdef SO_NOSIGPIPE
+            int one = 1;
+            setsockopt(c, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            // a scraper sends one GET, read it up to the end of the headers (or give up after 1s)
+            std::string req;
+            char buf[1024];
+            while (req.find("\r\n\r\n") == std::string::npos && req.size() < 8192) {
+                pollfd cfd = {c, POLLIN, 0};
+                if (poll(&cfd, 1, 1000) <= 0)
+                    break;
+                ssize_t n = recv(c, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    break;
+                req.append(buf, size_t(n));
+            }
+            std::string body = Format();
+            std::string resp;
+            if (req.compare(0, 4, "GET ") == 0) {
+                resp = "HTTP/1.1 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Connection: close\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+            } else {
+                resp = "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            }
+            for (size_t off = 0; off < resp.size();) {
+                ssize_t n = send(c, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                off += size_t(n);
+            }
+            close(c);
+        }
+    }
+    static void Line(std::string &out, const char *name, const char *label, const char *key, const char *value, double v)
+    {
+        char line[384];
+        if (key)
+            snprintf(line, sizeof(line), "%s{%s,%s=\"%s\"} %.17g\n", name, label, key, value, v);
+        else
+            snprintf(line, sizeof(line), "%s{%s} %.17g\n", name, label, v);
+        out += line;
+    }
+    static void Gauge(std::string &out, const char *name, const char *help, const char *label, double v)
+    {
+        out += std::string("# TYPE ") + name + " gauge\n# HELP " + name + " " + help + "\n";
+        Line(out, name, label, NULL, NULL, v);
+    }
+    static void Counter(std::string &out, const char *name, const char *help, const char *label, const std::atomic<uint64_t> &v)
+    {
+        out += std::string("# TYPE ") + name + " counter\n# HELP " + name + " " + help + "\n";
+        Line(out, (std::string(name) + "_total").c_str(), label, NULL, NULL, double(v.load(std::memory_order_relaxed)));
+    }
+    static void Histogram(std::string &out, const char *name, const char *help, const char *label, const prague_histogram_t &h)
+    {
+        out += std::string("# TYPE ") + name + " histogram\n# HELP " + name + " " + help + "\n";
+        std::string bucket = std::string(name) + "_bucket";
+        uint64_t cum = 0;
+        char le[32];
+        for (int i = 0; i < METRICS_BUCKETS; i++) {
+            cum += h.buckets[i].load(std::memory_order_relaxed);
+            if (i < METRICS_BUCKETS - 1)
+                snprintf(le, sizeof(le), "%g", METRICS_BOUNDS[i] / 1e6);
+            else
+                snprintf(le, sizeof(le), "+Inf");
+            Line(out, bucket.c_str(), label, "le", le, double(cum));
+        }
+        // count equals the +Inf bucket, the buckets may be read while the CC thread updates them
+        Line(out, (std::string(name) + "_count").c_str(), label, NULL, NULL, double(cum));
+        Line(out, (std::string(name) + "_sum").c_str(), label, NULL, NULL, h.sum.load(std::memory_order_relaxed) / 1e6);
+    }
+
+    int m_fd;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+    std::string m_path;
+    std::string m_flow;
+    const prague_snapshot_t *m_snapshot;
+    const prague_metrics_t *m_metrics;
+    bool m_sender;
+};
+#endif
+#endif //PRAGUE_METRICS_H
@@ -0,0 +1,238 @@
+#ifndef PRAGUE_REPLAY_H
+#define PRAGUE_REPLAY_H
+
+// prague_replay.h:
+// Recording and bit-exact replay of the inputs of a sender-side PragueCC. PragueRecorder is a PragueCC that appends
+// every state-changing call (PacketReceived, ACKReceived, RFC8888Received and ResetCCInfo) with its arguments and the
+// Now() it used to a recording file, and the state after it to a golden trajectory file. PragueReplay feeds a
+// recording into a fresh PragueCC through its overridden Now(), so udp_prague_replay can compare the trajectory of
+// the current PragueCC against the golden one.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <cerrno>
+#include "prague_cc.h"
+
+#define REPLAY_MAGIC   0x50524752  // "PRGR", recorded events
+#define GOLDEN_MAGIC   0x50524747  // "PRGG", state trajectory
+#define REPLAY_VERSION 1
+#define REPLAY_MAX_RTT 65535       // max RTT samples in one RFC8888 event
+
+enum replay_tp: uint8_t {
+    rpl_packet = 1,     // PacketReceived: v = timestamp, echoed_timestamp
+    rpl_ack,            // ACKReceived: v = packets_received, packets_CE, packets_lost, packets_sent, inflight, flag = error_L4S
+    rpl_rfc8888,        // RFC8888Received: followed by count RTT samples
+    rpl_reset           // ResetCCInfo
+};
+
+// the PragueCC constructor arguments, in the header of both files
+struct replay_hdr_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;          // sizeof(replay_event_t) or sizeof(replay_state_t)
+    uint64_t max_packet_size;
+    uint64_t init_rate;
+    uint64_t min_rate;
+    uint64_t max_rate;
+    int32_t  init_window;
+    int32_t  frame_budget;
+    uint8_t  fps;
+    uint8_t  reserved[7];
+};
+
+struct replay_event_t {
+    replay_tp type;
+    uint8_t   flag;
+    uint16_t  count;            // RFC8888 RTT samples (time_tp) following the event
+    time_tp   now;              // what Now() returned during the call
+    int32_t   v[5];
+};
+
+// the state after an event
+struct replay_state_t {
+    time_tp   now;
+    replay_tp type;
+    uint8_t   result;           // the call returned true
+    uint8_t   cc_state;
+    uint8_t   cca_mode;
+    count_tp  packet_window;
+    count_tp  packet_burst;
+    count_tp  inflight;         // ACKReceived inflight output
+    time_tp   srtt;
+    time_tp   min_rtt;
+    int32_t   reserved;
+    uint64_t  pacing_rate;
+    uint64_t  fractional_window;
+    uint64_t  packet_size;
+    int64_t   alpha;
+
+    void set(const PragueState &s, time_tp ts, replay_tp t, bool r, count_tp in)
+    {
+        memset(this, 0, sizeof(*this));
+        now = ts;
+        type = t;
+        result = r;
+        cc_state = uint8_t(s.m_cc_state);
+        cca_mode = uint8_t(s.m_cca_mode);
+        packet_window = s.m_packet_window;
+        packet_burst = s.m_packet_burst;
+        inflight = in;
+        srtt = s.m_srtt;
+        min_rtt = s.m_min_rtt;
+        pacing_rate = s.m_pacing_rate;
+        fractional_window = s.m_fractional_window;
+        packet_size = s.m_packet_size;
+        alpha = s.m_alpha;
+    }
+    bool operator==(const replay_state_t &o) const { return memcmp(this, &o, sizeof(*this)) == 0; }
+};
+
+// a PragueCC that records its inputs (after Record()) and its state trajectory
+class PragueRecorder: public PragueCC {
+public:
+    PragueRecorder(size_tp max_packet_size = PRAGUE_INITMTU, fps_tp fps = 0, time_tp frame_budget = 0,
+                   rate_tp init_rate = PRAGUE_INITRATE, count_tp init_window = PRAGUE_INITWIN,
+                   rate_tp min_rate = PRAGUE_MINRATE, rate_tp max_rate = PRAGUE_MAXRATE):
+        PragueCC(max_packet_size, fps, frame_budget, init_rate, init_window, min_rate, max_rate),
+        m_events(NULL), m_golden(NULL), m_now(0)
+    {
+        memset(&m_hdr, 0, sizeof(m_hdr));
+        m_hdr.version = REPLAY_VERSION;
+        m_hdr.max_packet_size = max_packet_size;
+        m_hdr.init_rate = init_rate;
+        m_hdr.min_rate = min_rate;
+        m_hdr.max_rate = max_rate;
+        m_hdr.init_window = init_window;
+        m_hdr.frame_budget = fps ? frame_budget : 0;
+        m_hdr.fps = fps;
+    }
+    virtual ~PragueRecorder() { Stop(); }
+
+    // start recording to filename, and the golden trajectory to filename.golden
+    void Record(const char *filename)
+    {
+        Stop();
+        m_events = Open(filename, REPLAY_MAGIC, sizeof(replay_event_t));
+        m_golden = Open((std::string(filename) + ".golden").c_str(), GOLDEN_MAGIC, sizeof(replay_state_t));
+    }
+    void Stop()
+    {
+        if (m_events)
+            fclose(m_events);
+        if (m_golden)
+            fclose(m_golden);
+        m_events = m_golden = NULL;
+    }
+
+    virtual time_tp Now()
+    {
+        m_now = PragueCC::Now();
+        return m_now;
+    }
+    bool PacketReceived(time_tp timestamp, time_tp echoed_timestamp)
+    {
+        bool r = PragueCC::PacketReceived(timestamp, echoed_timestamp);
+        if (m_events) {
+            replay_event_t ev = {rpl_packet, 0, 0, m_now, {timestamp, echoed_timestamp, 0, 0, 0}};
+            Write(ev, NULL, r, 0);
+        }
+        return r;
+    }
+    bool ACKReceived(count_tp packets_received, count_tp packets_CE, count_tp packets_lost, count_tp packets_sent,
+                     bool error_L4S, count_tp &inflight)
+    {
+        count_tp in = inflight;
+        bool r = PragueCC::ACKReceived(packets_received, packets_CE, packets_lost, packets_sent, error_L4S, inflight);
+        if (m_events) {
+            replay_event_t ev = {rpl_ack, error_L4S, 0, m_now, {packets_received, packets_CE, packets_lost, packets_sent, in}};
+            Write(ev, NULL, r, inflight);
+        }
+        return r;
+    }
+    bool RFC8888Received(size_t num_rtt, time_tp *pkts_rtt)
+    {
+        bool r = PragueCC::RFC8888Received(num_rtt, pkts_rtt);
+        if (m_events) {
+            replay_event_t ev = {rpl_rfc8888, 0, uint16_t(num_rtt), m_now, {0, 0, 0, 0, 0}};
+            Write(ev, pkts_rtt, r, 0);
+        }
+        return r;
+    }
+    void ResetCCInfo()
+    {
+        PragueCC::ResetCCInfo();
+        if (m_events) {
+            replay_event_t ev = {rpl_reset, 0, 0, m_now, {0, 0, 0, 0, 0}};
+            Write(ev, NULL, true, 0);
+        }
+    }
+
+private:
+    FILE *Open(const char *filename, uint32_t magic, uint16_t rec_size)
+    {
+        FILE *fp = fopen(filename, "wb");
+        if (!fp)
+            throw std::system_error(errno, std::system_category(), std::string("Could not open recording file ") + filename);
+        setvbuf(fp, NULL, _IOFBF, 1 << 20);
+        m_hdr.magic = magic;
+        m_hdr.rec_size = rec_size;
+        fwrite(&m_hdr, sizeof(m_hdr), 1, fp);
+        return fp;
+    }
+    void Write(const replay_event_t &ev, const time_tp *samples, bool result, count_tp inflight)
+    {
+        fwrite(&ev, sizeof(ev), 1, m_events);
+        if (samples && ev.count)
+            fwrite(samples, sizeof(time_tp), ev.count, m_events);
+        replay_state_t st;
+        st.set(*GetStatePtr(), ev.now, ev.type, result, inflight);
+        fwrite(&st, sizeof(st), 1, m_golden);
+    }
+
+    replay_hdr_t m_hdr;
+    FILE *m_events;
+    FILE *m_golden;
+    time_tp m_now;              // the last Now(), used by the call being recorded
+};
+
+// a fresh PragueCC driven by recorded events, its clock is the recorded Now() of the event
+class PragueReplay: public PragueCC {
+public:
+    PragueReplay(const replay_hdr_t &hdr):
+        PragueCC(hdr.max_packet_size, hdr.fps, hdr.frame_budget, hdr.init_rate, hdr.init_window, hdr.min_rate,
+                 hdr.max_rate),
+        m_now(1) {}
+
+    virtual time_tp Now() { return m_now; }
+
+    // apply an event (with samples for rpl_rfc8888), and return the state after it
+    void Apply(const replay_event_t &ev, const time_tp *samples, replay_state_t &st)
+    {
+        m_now = ev.now;
+        bool r = true;
+        count_tp inflight = 0;
+        switch (ev.type) {
+        case rpl_packet:
+            r = PacketReceived(ev.v[0], ev.v[1]);
+            break;
+        case rpl_ack:
+            inflight = ev.v[4];
+            r = ACKReceived(ev.v[0], ev.v[1], ev.v[2], ev.v[3], ev.flag != 0, inflight);
+            break;
+        case rpl_rfc8888:
+            r = RFC8888Received(ev.count, const_cast<time_tp*>(samples));
+            break;
+        case rpl_reset:
+            ResetCCInfo();
+            break;
+        }
+        st.set(*GetStatePtr(), ev.now, ev.type, r, inflight);
+    }
+
+private:
+    time_tp m_now;
+};
+#endif //PRAGUE_REPLAY_H
@@ -0,0 +1,372 @@
+#ifndef PRAGUE_SENDER_H
+#define PRAGUE_SENDER_H
+
+// prague_sender.h:
+// Reusable bulk sending engine: a PragueCC paced and window-limited sender of application messages over a UDPSocket,
+// with the same packet and feedback formats as udp_prague_sender (per-packet ACKs, RFC8888 or RLE feedback, so it
+// works with udp_prague_receiver). Messages are copied into a bounded ring (Enqueue), or referenced in application
+// memory (EnqueueRange), and are segmented into packets of the PragueCC packet size without coalescing, so every
+// message starts a packet. Writable() is the backpressure signal: the queue is limited to the larger of the window
+// and the pacing rate times the queue delay target, so the application only queues what can leave within about that
+// delay. Pump() sends what the window and pacing allow and handles the timeouts, OnFeedback() processes a feedback
+// packet, and Step() combines both with a wait on the socket for a simple event loop.
+//
+
+#include <deque>
+#include <vector>
+#include <cstring>
+#include "udpsocket.h"
+#include "pkt_format.h"
+
+#define SND_QUEUE_SIZE  (4 << 20)   // default max queued bytes, also the copy ring size
+#define SND_QUEUE_DELAY 50000       // default queue delay target in us of the backpressure
+#define SND_FB_PERIOD   25000       // RFC8888 feedback period of the receiver (its --rfc8888ackperiod) in us
+#define SND_IDLE_WAIT   100000      // max wait in us of Step() when there is nothing to send or wait for
+
+class PragueSender {
+public:
+    PragueSender(UDPSocket &socket, size_tp max_packet_size = PRAGUE_INITMTU, rate_tp max_rate = PRAGUE_MAXRATE,
+                 size_tp queue_size = SND_QUEUE_SIZE, time_tp queue_delay = SND_QUEUE_DELAY, bool rack = false,
+                 bool ack_freq = false, count_tp acks_per_rtt = PRAGUE_ACKSPERRTT, time_tp fb_period = SND_FB_PERIOD):
+        m_socket(socket), m_cc(max_packet_size, 0, 0, PRAGUE_INITRATE, PRAGUE_INITWIN, PRAGUE_MINRATE, max_rate),
+        m_sb(false, SB_MAX_SIZE, rack), m_rack(rack), m_ack_freq(ack_freq), m_acks_per_rtt(acks_per_rtt),
+        m_fb_period(fb_period), m_queue_size(queue_size), m_queue_delay(queue_delay),
+        m_ring_head(0), m_ring_tail(0), m_ring_used(0), m_queued(0), m_enqueued(0), m_sent_bytes(0),
+        m_backlogged(false), m_seqnr(0), m_inflight(0), m_ack_window(1), m_ack_delay(0), m_pkts_received(0),
+        m_pkts_CE(0), m_pkts_lost(0), m_err_L4S(false), m_rfc8888(false), m_num_timeout(0), m_timeouts(0), m_probe(false), m_loss_timer(false),
+        m_loss_timeout(0)
+    {
+        m_now = m_cc.Now();
+        m_next_send = m_now;
+        m_timeout_start = m_now;
+        m_cc.GetCCInfo(m_pacing_rate, m_packet_window, m_packet_burst, m_packet_size);
+        m_cc.GetTimeoutInfo(m_ack_timeout, 0, 0);
+    }
+
+    // Queue a copy of a message, false (nothing queued) if it does not fit in Writable() or the ring. A message
+    // larger than Writable() is still accepted in an empty queue, so no message size blocks forever.
+    bool Enqueue(const char *data, size_tp len)
+    {
+        if (!len || !Fits(len))
+            return false;
+        size_tp off, charged;
+        if (!RingAlloc(len, off, charged))
+            return false;
+        if (m_ring.empty())
+            m_ring.resize(m_queue_size);
+        memcpy(&m_ring[off], data, len);
+        Push(&m_ring[off], len, charged);
+        return true;
+    }
+    // Queue a range of application memory without copying, false if it does not fit in Writable(). The range must
+    // stay unchanged until ReleasedOffset() reaches Enqueued() after this call: on a zero-copy socket (SetZeroCopy)
+    // the kernel may still read it after it is sent.
+    bool EnqueueRange(const char *data, size_tp len)
+    {
+        if (!len || !Fits(len))
+            return false;
+        Push(data, len, 0);
+        return true;
+    }
+    // bytes that can be queued now: the queue limit (the window or the pacing rate times the queue delay target,
+    // capped by the queue size) minus what is queued
+    size_tp Writable() const
+    {
+        size_tp limit = size_tp(m_packet_window) * m_packet_size;
+        size_tp delay_bytes = size_tp(m_pacing_rate * m_queue_delay / 1000000);
+        if (delay_bytes > limit)
+            limit = delay_bytes;
+        if (limit > m_queue_size)
+            limit = m_queue_size;
+        return (limit > m_queued) ? limit - m_queued : 0;
+    }
+    // expected delay in us of a message queued now until it is sent, at the current pacing rate
+    time_tp QueueDelay() const { return time_tp(m_queued * 1000000 / m_pacing_rate); }
+    // how long the oldest queued message is waiting, 0 if the queue is empty
+    time_tp OldestDelay() { return m_queue.empty() ? 0 : m_cc.Now() - m_queue.front().enq; }
+    size_tp Queued() const { return m_queued; }
+    // stream offsets of the message bytes queued and sent so far
+    uint64_t Enqueued() const { return m_enqueued; }
+    uint64_t SentOffset() const { return m_sent_bytes; }
+    // stream offset up to which the kernel no longer reads the sent message bytes, SentOffset() without zero-copy
+    uint64_t ReleasedOffset()
+    {
+        while (!m_zc_sends.empty() && m_socket.ZeroCopyReleased(m_zc_sends.front().id))
+            m_zc_sends.pop_front();
+        return m_zc_sends.empty() ? m_sent_bytes : m_zc_sends.front().offset;
+    }
+
+    // Send the packets the window and pacing allow, after handling the expired loss detection and feedback timeouts.
+    // Returns the PragueCC::Now() time at which Pump needs to run again if no feedback arrives before.
+    time_tp Pump()
+    {
+        m_now = m_cc.Now();
+        HandleTimeouts();
+        if (m_ack_freq)
+            m_cc.GetACKFreqInfo(m_ack_window, m_ack_delay, m_acks_per_rtt);
+        // a burst sent late while data was waiting is compensated in the next pacing interval
+        time_tp comp = (m_backlogged && m_inflight > 0 && m_next_send - m_now < 0) ? m_next_send - m_now : 0;
+        time_tp start_send = 0;
+        size_tp burst_bytes = 0;
+        count_tp inburst = 0;
+        while (!m_queue.empty() && (m_inflight < m_packet_window || m_probe) && inburst < m_packet_burst &&
+               m_next_send - m_now <= 0) {
+            sndmsg_t &msg = m_queue.front();
+            size_tp len = msg.len - msg.sent;
+            if (len > m_packet_size - sizeof(datamessage_t))
+                len = m_packet_size - sizeof(datamessage_t);
+            datamessage_t hdr;
+            ecn_tp ecn;
+            m_cc.GetTimeInfo(hdr.timestamp, hdr.echoed_timestamp, ecn);
+            if (!start_send)
+                start_send = m_now;
+            hdr.seq_nr = ++m_seqnr;
+            hdr.ack_window = m_ack_window;
+            hdr.ack_delay = m_ack_delay;
+            hdr.hton();
+            burst_bytes += m_socket.Send((char*)(&hdr), sizeof(hdr), msg.data + msg.sent, len, ecn);
+            if (m_socket.ZeroCopyId()) {
+                zcsend_t zc = {m_socket.ZeroCopyId(), m_sent_bytes};
+                m_zc_sends.push_back(zc);
+            }
+            m_sb.Sent(m_seqnr, start_send);
+            m_timeout_start = m_now;
+            m_probe = false;
+            inburst++;
+            m_inflight++;
+            msg.sent += len;
+            m_queued -= len;
+            m_sent_bytes += len;
+            if (msg.sent == msg.len)
+                Pop();
+        }
+        m_backlogged = !m_queue.empty();
+        if (start_send) {
+            time_tp interval = time_tp(burst_bytes * 1000000 / m_pacing_rate);
+            m_next_send = (comp + interval <= 0) ? time_tp(start_send + 1) : time_tp(start_send + comp + interval);
+        }
+        return Deadline();
+    }
+    // Process a received packet (in a buffer of BUFFER_SIZE), true if it was feedback. It is byte swapped in place.
+    bool OnFeedback(char *buf, size_tp len)
+    {
+        m_now = m_cc.Now();
+        ackmessage_t &ack_msg = (ackmessage_t&)(*buf);
+        rfc8888ack_t &rfc8888_msg = (rfc8888ack_t&)(*buf);
+        rleack_t &rle_msg = (rleack_t&)(*buf);
+        if (buf[0] == PKT_ACK_TYPE && len >= sizeof(ack_msg)) {
+            m_rfc8888 = false;
+            ack_msg.get_stat(m_sb, m_pkts_lost);
+            m_pkts_received = ack_msg.packets_received;
+            m_pkts_CE = ack_msg.packets_CE;
+            m_err_L4S = ack_msg.error_L4S;
+            if (m_rack)
+                m_sb.DetectLost(m_now);  // the echoed lost count stays consistent with the echoed received and CE counts
+            m_cc.PacketReceived(ack_msg.timestamp, ack_msg.echoed_timestamp);
+            m_cc.ACKReceived(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, m_seqnr, ack_msg.error_L4S, m_inflight);
+        } else if ((buf[0] == RFC8888_ACK_TYPE && len >= rfc8888_msg.get_size(0)) ||
+                   (buf[0] == RLE_ACK_TYPE && len >= rle_msg.get_size(0))) {
+            m_rfc8888 = true;
+            uint16_t num_rtt;
+            if (buf[0] == RLE_ACK_TYPE)
+                num_rtt = rle_msg.get_stat(m_now, m_sb, m_pkts_rtt, m_pkts_received, m_pkts_lost, m_pkts_CE, m_err_L4S, len);
+            else
+                num_rtt = rfc8888_msg.get_stat(m_now, m_sb, m_pkts_rtt, m_pkts_received, m_pkts_lost, m_pkts_CE, m_err_L4S);
+            count_tp newly_lost = m_rack ? m_sb.DetectLost(m_now) : 0;
+            m_pkts_lost += newly_lost;
+            if (num_rtt || newly_lost) {
+                m_cc.RFC8888Received(num_rtt, m_pkts_rtt);
+                m_cc.ACKReceived(m_pkts_received, m_pkts_CE, m_pkts_lost, m_seqnr, m_err_L4S, m_inflight);
+            }
+        } else {
+            return false;
+        }
+        m_num_timeout = 0;
+        m_probe = false;
+        m_timeout_start = m_now;
+        m_cc.GetCCInfo(m_pacing_rate, m_packet_window, m_packet_burst, m_packet_size);
+        return true;
+    }
+    // Pump, then wait up to max_wait us for feedback on the socket until the deadline of the next Pump, and process
+    // it. Returns the received bytes, 0 if the wait ended without a packet.
+    size_tp Step(time_tp max_wait = SND_IDLE_WAIT)
+    {
+        time_tp deadline = Pump();
+        m_now = m_cc.Now();
+        if (deadline - m_now > max_wait)
+            deadline = m_now + max_wait;
+        ecn_tp ecn;
+        size_tp bytes = m_socket.ReceiveUntil(m_rcvbuf, sizeof(m_rcvbuf), ecn, deadline, m_now);
+        if (bytes)
+            OnFeedback(m_rcvbuf, bytes);
+        return bytes;
+    }
+
+    PragueCC &CC() { return m_cc; }
+    count_tp Inflight() const { return m_inflight; }
+    count_tp SentPackets() const { return m_seqnr; }
+    count_tp Timeouts() const { return m_timeouts; }     // retransmission timeouts (PragueCC resets) so far
+    count_tp ConsecutiveTimeouts() const { return m_num_timeout; }
+
+private:
+    struct sndmsg_t {
+        const char *data;
+        size_tp len;
+        size_tp sent;           // bytes of the message sent
+        size_tp charged;        // ring bytes released with the message (with a skipped ring end), 0 if referenced
+        time_tp enq;
+    };
+    struct zcsend_t {
+        uint32_t id;            // UDPSocket::ZeroCopyId() of the send
+        uint64_t offset;        // stream offset of its first message byte
+    };
+    struct ringfree_t {
+        uint64_t end;           // stream offset after the message
+        size_tp head;           // ring head after the message
+        size_tp charged;
+    };
+
+    bool Fits(size_tp len) const { return len <= Writable() || (m_queue.empty() && len <= m_queue_size); }
+    // contiguous ring space for len bytes, skipping (and charging) the ring end if it is too short
+    bool RingAlloc(size_tp len, size_tp &off, size_tp &charged)
+    {
+        // the ring space of sent messages is only reused once the kernel released it
+        uint64_t released = ReleasedOffset();
+        while (!m_ring_free.empty() && m_ring_free.front().end <= released) {
+            m_ring_head = m_ring_free.front().head;
+            m_ring_used -= m_ring_free.front().charged;
+            m_ring_free.pop_front();
+        }
+        if (!m_ring_used)
+            m_ring_head = m_ring_tail = 0;
+        if (m_ring_tail >= m_ring_head && m_ring_used < m_queue_size) {
+            if (m_queue_size - m_ring_tail >= len) {
+                off = m_ring_tail;
+                charged = len;
+            } else if (m_ring_head >= len) {
+                off = 0;
+                charged = m_queue_size - m_ring_tail + len;
+            } else {
+                return false;
+            }
+        } else if (m_ring_head - m_ring_tail >= len) {
+            off = m_ring_tail;
+            charged = len;
+        } else {
+            return false;
+        }
+        m_ring_tail = (off + len) % m_queue_size;
+        m_ring_used += charged;
+        return true;
+    }
+    void Push(const char *data, size_tp len, size_tp charged)
+    {
+        sndmsg_t msg = {data, len, 0, charged, m_cc.Now()};
+        m_queue.push_back(msg);
+        m_queued += len;
+        m_enqueued += len;
+    }
+    void Pop()
+    {
+        const sndmsg_t &msg = m_queue.front();
+        if (msg.charged) {
+            ringfree_t rf = {m_sent_bytes, (size_tp(msg.data - &m_ring[0]) + msg.len) % m_queue_size, msg.charged};
+            m_ring_free.push_back(rf);
+        }
+        m_queue.pop_front();
+    }
+    // the window is waited on while it is full, or while packets are in flight and nothing is queued
+    bool WaitingForFeedback() const { return m_inflight > 0 && (m_inflight >= m_packet_window || m_queue.empty()); }
+    time_tp Deadline()
+    {
+        m_cc.GetTimeoutInfo(m_ack_timeout, m_num_timeout, (m_rfc8888 && !m_ack_freq) ? m_fb_period : m_ack_delay);
+        time_tp deadline;
+        if (!m_queue.empty() && (m_inflight < m_packet_window || m_probe))
+            deadline = m_next_send;
+        else if (WaitingForFeedback())
+            deadline = m_timeout_start + m_ack_timeout;
+        else
+            deadline = m_now + SND_IDLE_WAIT;
+        m_loss_timer = m_rack && m_sb.LossTimer(m_loss_timeout) && (deadline - m_loss_timeout > 0);
+        return m_loss_timer ? m_loss_timeout : deadline;
+    }
+    void HandleTimeouts()
+    {
+        if (m_loss_timer && m_now - m_loss_timeout >= 0) {
+            // no feedback in time, but outstanding packets passed the reordering-tolerant loss detection deadline
+            m_loss_timer = false;
+            count_tp newly_lost = m_sb.DetectLost(m_now);
+            if (newly_lost && m_rfc8888) {
+                m_pkts_lost += newly_lost;
+                m_cc.ACKReceived(m_pkts_received, m_pkts_CE, m_pkts_lost, m_seqnr, m_err_L4S, m_inflight);
+                m_cc.GetCCInfo(m_pacing_rate, m_packet_window, m_packet_burst, m_packet_size);
+            }
+        }
+        if (!WaitingForFeedback() || m_now - (m_timeout_start + m_ack_timeout) < 0)
+            return;
+        if (!m_num_timeout) {
+            // probe timeout: send a probe packet beyond the window first, its feedback avoids collapsing the window
+            m_probe = true;
+            m_next_send = m_now;
+        } else {
+            // retransmission timeout: the probe was not answered either
+            m_cc.ResetCCInfo();
+            m_inflight = 0;
+            m_timeouts++;
+            m_cc.GetCCInfo(m_pacing_rate, m_packet_window, m_packet_burst, m_packet_size);
+            m_next_send = m_now;
+        }
+        m_timeout_start = m_now;
+        m_num_timeout++;
+    }
+
+    UDPSocket &m_socket;
+    PragueCC m_cc;
+    Scoreboard m_sb;
+    bool m_rack;
+    bool m_ack_freq;
+    count_tp m_acks_per_rtt;
+    time_tp m_fb_period;
+    // send queue: messages in order, the copied ones in a ring
+    size_tp m_queue_size;
+    time_tp m_queue_delay;
+    std::deque<sndmsg_t> m_queue;
+    std::vector<char> m_ring;
+    size_tp m_ring_head;
+    size_tp m_ring_tail;
+    size_tp m_ring_used;
+    std::deque<ringfree_t> m_ring_free; // sent messages of the ring, freed when the kernel released them
+    std::deque<zcsend_t> m_zc_sends;    // zero-copy sends the kernel did not release yet
+    size_tp m_queued;           // unsent message bytes
+    uint64_t m_enqueued;
+    uint64_t m_sent_bytes;
+    // pacing and window state
+    time_tp m_now;
+    time_tp m_next_send;
+    bool m_backlogged;          // data was queued at the end of the last Pump
+    count_tp m_seqnr;           // sequence number of the last sent packet
+    count_tp m_inflight;
+    rate_tp m_pacing_rate;
+    count_tp m_packet_window;
+    count_tp m_packet_burst;
+    size_tp m_packet_size;
+    count_tp m_ack_window;
+    time_tp m_ack_delay;
+    // feedback state
+    count_tp m_pkts_received;
+    count_tp m_pkts_CE;
+    count_tp m_pkts_lost;
+    bool m_err_L4S;
+    bool m_rfc8888;             // the receiver sends RFC8888 or RLE feedback
+    time_tp m_pkts_rtt[REPORT_SIZE];
+    char m_rcvbuf[BUFFER_SIZE];
+    // timeouts
+    count_tp m_num_timeout;     // consecutive timeouts without feedback
+    count_tp m_timeouts;
+    bool m_probe;
+    time_tp m_timeout_start;    // time of the last packet sent or feedback received
+    time_tp m_ack_timeout;
+    bool m_loss_timer;
+    time_tp m_loss_timeout;
+};
+#endif //PRAGUE_SENDER_H
@@ -0,0 +1,204 @@
+#ifndef PRAGUE_SNAPSHOT_H
+#define PRAGUE_SNAPSHOT_H
+
+// prague_snapshot.h:
+// Lock-free snapshots of the PragueCC state for monitoring threads and other processes. The CC thread publishes a
+// copy of its PragueState after each ACK into a seqlock without ever waiting; readers copy it and retry when the
+// publisher was busy, so reading never blocks or slows down the datapath. The snapshot can be a normal object shared
+// between threads, or live in a named shared-memory segment (POSIX shm or a Windows file mapping) for other processes.
+//
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <system_error>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "prague_cc.h"
+
+#define SNAPSHOT_MAGIC   0x50524753  // "PRGS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_WORDS   ((sizeof(PragueState) + 3) / 4)
+
+// Seqlock-protected copy of a PragueState, with a layout that can be shared between processes.
+// There must be only one publisher; any number of readers.
+struct prague_snapshot_t {
+    uint32_t magic;                          // SNAPSHOT_MAGIC once initialized
+    uint16_t version;                        // SNAPSHOT_VERSION
+    uint16_t state_size;                     // sizeof(PragueState) of the publisher, a reader must have the same
+    std::atomic<uint32_t> seq;               // odd while the publisher is copying, +2 for each published snapshot
+    std::atomic<int32_t> ts;                 // publisher time of the snapshot
+    std::atomic<uint32_t> words[SNAPSHOT_WORDS]; // the PragueState, copied with relaxed 32-bit atomic accesses
+
+    void init()
+    {
+        seq.store(0, std::memory_order_relaxed);
+        ts.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+            words[i].store(0, std::memory_order_relaxed);
+        magic = SNAPSHOT_MAGIC;
+        version = SNAPSHOT_VERSION;
+        state_size = uint16_t(sizeof(PragueState));
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    bool valid() const
+    {
+        return magic == SNAPSHOT_MAGIC && version == SNAPSHOT_VERSION && state_size == sizeof(PragueState);
+    }
+    // publisher side: never waits, costs a copy of the state
+    void publish(const PragueState &state, time_tp now)
+    {
+        uint32_t buf[SNAPSHOT_WORDS] = {0};
+        memcpy(buf, &state, sizeof(PragueState));
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        ts.store(now, std::memory_order_relaxed);
+        for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+            words[i].store(buf[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+    // reader side: returns false if no consistent copy was made in max_tries, or nothing was published yet
+    bool read(PragueState &state, time_tp &now, uint32_t max_tries = 1000) const
+    {
+        uint32_t buf[SNAPSHOT_WORDS];
+        for (uint32_t n = 0; n < max_tries; n++) {
+            uint32_t s1 = seq.load(std::memory_order_acquire);
+            if (s1 & 1)
+                continue;
+            if (!s1)
+                return false;
+            time_tp t = ts.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+                buf[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s1) {
+                memcpy(&state, buf, sizeof(PragueState));
+                now = t;
+                return true;
+            }
+        }
+        return false;
+    }
+    uint32_t published() const
+    {
+        return seq.load(std::memory_order_relaxed) >> 1;
+    }
+};
+
+// Named shared-memory segment holding one prague_snapshot_t.
+// Create() by the publisher (removed again on destruction), Open() read-only by a reader.
+class SnapshotShm {
+public:
+    SnapshotShm(): m_snapshot(NULL), m_owner(false)
+#ifdef _WIN32
+        , m_mapping(NULL)
+#endif
+    {}
+    ~SnapshotShm() { Close(); }
+
+    prague_snapshot_t* Create(const char *name)
+    {
+        Close();
+        std::string shm_name = ShmName(name);
+#ifdef _WIN32
+        m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(prague_snapshot_t), shm_name.c_str());
+        if (!m_mapping)
+            throw std::system_error(GetLastError(), std::system_category(), "Could not create snapshot mapping");
+        void *p = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(prague_snapshot_t));
+        if (!p)
+            throw std::system_error(GetLastError(), std::system_category(), "Could not map snapshot");
+#else
+        int fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "Could not create shared memory " + shm_name);
+        if (ftruncate(fd, sizeof(prague_snapshot_t)) < 0) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::system_category(), "Could not size shared memory " + shm_name);
+        }
+        void *p = mmap(NULL, sizeof(prague_snapshot_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::system_error(errno, std::system_category(), "Could not map shared memory " + shm_name);
+        m_name = shm_name;
+#endif
+        m_snapshot = static_cast<prague_snapshot_t*>(p);
+        m_snapshot->init();
+        m_owner = true;
+        return m_snapshot;
+    }
+    const prague_snapshot_t* Open(const char *name)
+    {
+        Close();
+        std::string shm_name = ShmName(name);
+#ifdef _WIN32
+        m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, shm_name.c_str());
+        if (!m_mapping)
+            throw std::system_error(GetLastError(), std::system_category(), "Could not open snapshot mapping");
+        void *p = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, sizeof(prague_snapshot_t));
+        if (!p)
+            throw std::system_error(GetLastError(), std::system_category(), "Could not map snapshot");
+#else
+        int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "Could not open shared memory " + shm_name);
+        struct stat st;
+        if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(prague_snapshot_t)) {
+            close(fd);
+            throw std::system_error(EINVAL, std::system_category(), "Shared memory too small " + shm_name);
+        }
+        void *p = mmap(NULL, sizeof(prague_snapshot_t), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::system_error(errno, std::system_category(), "Could not map shared memory " + shm_name);
+#endif
+        m_snapshot = static_cast<prague_snapshot_t*>(p);
+        m_owner = false;
+        if (!m_snapshot->valid()) {
+            Close();
+            throw std::system_error(EINVAL, std::system_category(), "Incompatible snapshot in " + shm_name);
+        }
+        return m_snapshot;
+    }
+    void Close()
+    {
+        if (!m_snapshot)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_snapshot);
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+#else
+        munmap(m_snapshot, sizeof(prague_snapshot_t));
+        if (m_owner)
+            shm_unlink(m_name.c_str());
+#endif
+        m_snapshot = NULL;
+    }
+
+private:
+    static std::string ShmName(const char *name)
+    {
+#ifdef _WIN32
+        return std::string("Local\\") + name;
+#else
+        return (name[0] == '/') ? std::string(name) : "/" + std::string(name);
+#endif
+    }
+
+    prague_snapshot_t *m_snapshot;
+    bool m_owner;
+    std::string m_name;
+#ifdef _WIN32
+    HANDLE m_mapping;
+#endif
+};
+#endif //PRAGUE_SNAPSHOT_H
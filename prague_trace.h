@@ -0,0 +1,201 @@
+#ifndef PRAGUE_TRACE_H
+#define PRAGUE_TRACE_H
+
+// prague_trace.h:
+// Binary per-packet trace: fixed-size records appended to a ring in a memory-mapped file, without any formatting in
+// the datapath. When the ring is full the oldest records are overwritten. udp_prague_trace converts a trace file to
+// the verbose (-v) CSV layout or to JSON lines.
+//
+
+#include <cstring>
+#include <string>
+#include <system_error>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "prague_cc.h"
+
+#define TRACE_MAGIC   0x50524754  // "PRGT"
+#define TRACE_VERSION 1
+#define TRACE_SIZE    1048576     // default ring size in records (power of 2)
+#define TRACE_FIELDS  14
+
+enum trace_tp: uint8_t {
+    trc_none = 0,
+    trc_send,          // sender data packet:  u = pacing_rate, v = timestamp, echoed_timestamp, seqnr, packet_size,
+                       //                      packet_window, packet_burst, packet_inflight, packet_inburst, nextSend - now
+    trc_send_frame,    // sender RT data packet: u = pacing_rate, v = timestamp, echoed_timestamp, seqnr, packet_size,
+                       //                      frame_window, frame_size, packet_burst, frame_inflight, frame_sent, packet_inburst, nextSend - now
+    trc_recv_ack,      // sender per-packet ACK: u = bytes_received, v = timestamp, echoed_timestamp, seqnr, pkts_received, pkts_CE,
+                       //                      pkts_lost, error_L4S, packet_inflight, packet_inburst, nextSend - now
+                       //                      (RT: frame_inflight, frame_sending, sent_frame, lost_frame, recv_frame, nextSend - now)
+    trc_recv_rfc8888,  // sender RFC8888 feedback: u = bytes_received, v = begin_seq, num_reports, seqnr, pkts_received, pkts_CE,
+                       //                      pkts_lost, error_L4S, then the same as trc_recv_ack
+    trc_cc_state,      // PragueCC state after feedback (or a timeout) at the sender, after sending feedback at the receiver:
+                       //                      u = pacing_rate, v = packet_window, packet_burst, packet_size, srtt, rttvar, min_rtt, qdelay, alpha, cc_state, cca_mode,
+                       //                      packets_sent, packets_received, packets_CE, packets_lost
+    trc_recv_data,     // receiver data packet: u = bytes_received, v = timestamp, echoed_timestamp, seqnr
+    trc_send_ack,      // receiver per-packet ACK: u = packet_size, v = timestamp, echoed_timestamp, seqnr, pkts_received, pkts_CE,
+                       //                      pkts_lost, error_L4S
+    trc_send_rfc8888,  // receiver RFC8888 feedback: u = packet_size, v = seqnr, begin_seq, num_reports
+    trc_send_rle,      // receiver run-length compressed feedback: u = packet_size, v = seqnr, begin_seq, num_reports, num_runs
+    trc_types
+};
+
+struct trace_rec_t {
+    trace_tp type;
+    uint8_t  rt_mode;
+    uint16_t reserved;
+    time_tp  now;
+    uint64_t u;                 // rate or size
+    int32_t  v[TRACE_FIELDS];   // per type, see trace_tp
+};
+
+struct trace_hdr_t {
+    uint32_t magic;             // TRACE_MAGIC
+    uint16_t version;           // TRACE_VERSION
+    uint16_t rec_size;          // sizeof(trace_rec_t)
+    uint8_t  sender;            // written by a sender (1) or a receiver (0)
+    uint8_t  rt_mode;           // written in RT mode
+    uint8_t  rfc8888_ack;       // RFC8888 feedback was used
+    uint8_t  reserved;
+    uint32_t reserved2;
+    uint64_t size;              // ring size in records
+    uint64_t head;              // records written so far, the last min(head, size) are in the ring
+    uint8_t  pad[32];           // the records start cache line aligned
+};
+
+class TraceRing {
+public:
+    TraceRing(): m_hdr(NULL), m_recs(NULL), m_mask(0), m_len(0)
+#ifdef _WIN32
+        , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+    {}
+    ~TraceRing() { Close(); }
+
+    bool Active() const { return m_recs != NULL; }
+
+    // create (or overwrite) a trace file for writing with a ring of size records (rounded up to a power of 2)
+    void Create(const char *filename, uint64_t size, bool sender, bool rt_mode, bool rfc8888_ack)
+    {
+        uint64_t pow2 = 1;
+        while (pow2 < size)
+            pow2 <<= 1;
+        Map(filename, sizeof(trace_hdr_t) + pow2 * sizeof(trace_rec_t), true);
+        memset(m_hdr, 0, sizeof(trace_hdr_t));
+        m_hdr->magic = TRACE_MAGIC;
+        m_hdr->version = TRACE_VERSION;
+        m_hdr->rec_size = sizeof(trace_rec_t);
+        m_hdr->sender = sender;
+        m_hdr->rt_mode = rt_mode;
+        m_hdr->rfc8888_ack = rfc8888_ack;
+        m_hdr->size = pow2;
+        m_mask = pow2 - 1;
+    }
+    // map an existing trace file read-only
+    const trace_hdr_t* Open(const char *filename)
+    {
+        Map(filename, 0, false);
+        if (m_len < sizeof(trace_hdr_t) || m_hdr->magic != TRACE_MAGIC || m_hdr->version != TRACE_VERSION ||
+            m_hdr->rec_size != sizeof(trace_rec_t) || !m_hdr->size || (m_hdr->size & (m_hdr->size - 1)) ||
+            m_len < sizeof(trace_hdr_t) + m_hdr->size * sizeof(trace_rec_t)) {
+            Close();
+            throw std::system_error(EINVAL, std::system_category(), std::string("Invalid trace file ") + filename);
+        }
+        m_mask = m_hdr->size - 1;
+        return m_hdr;
+    }
+    // writer: claim the next record, the caller fills u and v
+    trace_rec_t& Next(trace_tp type, time_tp now, uint8_t rt_mode)
+    {
+        trace_rec_t &rec = m_recs[m_hdr->head++ & m_mask];
+        rec.type = type;
+        rec.rt_mode = rt_mode;
+        rec.now = now;
+        return rec;
+    }
+    // reader: the first still available and one beyond the last written record index
+    uint64_t First() const { return (m_hdr->head > m_hdr->size) ? m_hdr->head - m_hdr->size : 0; }
+    uint64_t Last() const { return m_hdr->head; }
+    const trace_rec_t& At(uint64_t i) const { return m_recs[i & m_mask]; }
+
+    void Close()
+    {
+        if (!m_hdr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_hdr);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        munmap(m_hdr, m_len);
+#endif
+        m_hdr = NULL;
+        m_recs = NULL;
+    }
+
+private:
+    void Map(const char *filename, size_t len, bool write)
+    {
+        Close();
+#ifdef _WIN32
+        m_file = CreateFileA(filename, write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, NULL,
+                             write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::system_error(GetLastError(), std::system_category(), std::string("Could not open trace file ") + filename);
+        if (!write) {
+            LARGE_INTEGER fsize;
+            GetFileSizeEx(m_file, &fsize);
+            len = size_t(fsize.QuadPart);
+        }
+        m_mapping = CreateFileMappingA(m_file, NULL, write ? PAGE_READWRITE : PAGE_READONLY, DWORD(uint64_t(len) >> 32), DWORD(len), NULL);
+        void *p = m_mapping ? MapViewOfFile(m_mapping, write ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, len) : NULL;
+        if (!p)
+            throw std::system_error(GetLastError(), std::system_category(), std::string("Could not map trace file ") + filename);
+#else
+        int fd = open(filename, write ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), std::string("Could not open trace file ") + filename);
+        struct stat st;
+        if ((write && ftruncate(fd, len) < 0) || (!write && fstat(fd, &st) < 0)) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::system_category(), std::string("Could not size trace file ") + filename);
+        }
+        if (!write)
+            len = size_t(st.st_size);
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (write)
+            flags |= MAP_POPULATE;  // no page faults in the datapath
+#endif
+        void *p = len ? mmap(NULL, len, write ? (PROT_READ | PROT_WRITE) : PROT_READ, flags, fd, 0) : MAP_FAILED;
+        int err = len ? errno : EINVAL;
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::system_error(err, std::system_category(), std::string("Could not map trace file ") + filename);
+#endif
+        m_len = len;
+        m_hdr = static_cast<trace_hdr_t*>(p);
+        m_recs = reinterpret_cast<trace_rec_t*>(m_hdr + 1);
+    }
+
+    trace_hdr_t *m_hdr;
+    trace_rec_t *m_recs;
+    uint64_t m_mask;
+    size_t m_len;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
+#endif //PRAGUE_TRACE_H
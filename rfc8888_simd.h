@@ -0,0 +1,228 @@
+#ifndef RFC8888_SIMD_H
+#define RFC8888_SIMD_H
+
+// rfc8888_simd.h:
+// Bulk helpers to encode and decode the RFC8888 report blocks (16-bit big-endian reports: received:1, ECN:2, ATO:13),
+// using AVX2, SSE2 or (AArch64) NEON when the compiler targets them, with a scalar fallback.
+//
+
+#include "prague_cc.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RFC8888_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RFC8888_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RFC8888_NEON
+#endif
+
+#define RFC8888_ATO_MASK 0x1FFF
+
+inline uint16_t rfc8888_swap(uint16_t r)
+{
+    return uint16_t((r << 8) | (r >> 8));
+}
+
+// Classify a block of 32 network-order reports into the received, CE and not-ECT (error) masks, with a bit per report
+inline void rfc8888_classify32(const uint16_t *report, uint32_t &recv, uint32_t &ce, uint32_t &notect)
+{
+#if defined(RFC8888_AVX2)
+    const __m256i ce_bits = _mm256_set1_epi16(0x6000);
+    const __m256i ect_bit = _mm256_set1_epi16(0x2000);
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)report), swap);
+    __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(report + 16)), swap);
+    // packs works per 128-bit lane, the permute restores the report order
+    recv = uint32_t(_mm256_movemask_epi8(_mm256_permute4x64_epi64(
+        _mm256_packs_epi16(_mm256_srai_epi16(a, 15), _mm256_srai_epi16(b, 15)), 0xD8)));
+    ce = uint32_t(_mm256_movemask_epi8(_mm256_permute4x64_epi64(
+        _mm256_packs_epi16(_mm256_cmpeq_epi16(_mm256_and_si256(a, ce_bits), ce_bits),
+                           _mm256_cmpeq_epi16(_mm256_and_si256(b, ce_bits), ce_bits)), 0xD8)));
+    notect = uint32_t(_mm256_movemask_epi8(_mm256_permute4x64_epi64(
+        _mm256_packs_epi16(_mm256_cmpeq_epi16(_mm256_and_si256(a, ect_bit), _mm256_setzero_si256()),
+                           _mm256_cmpeq_epi16(_mm256_and_si256(b, ect_bit), _mm256_setzero_si256())), 0xD8)));
+#elif defined(RFC8888_SSE2)
+    const __m128i ce_bits = _mm_set1_epi16(0x6000);
+    const __m128i ect_bit = _mm_set1_epi16(0x2000);
+    recv = ce = notect = 0;
+    for (uint32_t i = 0; i < 32; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(report + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(report + i + 8));
+        a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+        recv |= uint32_t(_mm_movemask_epi8(_mm_packs_epi16(_mm_srai_epi16(a, 15), _mm_srai_epi16(b, 15)))) << i;
+        ce |= uint32_t(_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(_mm_and_si128(a, ce_bits), ce_bits),
+                                                         _mm_cmpeq_epi16(_mm_and_si128(b, ce_bits), ce_bits)))) << i;
+        notect |= uint32_t(_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(_mm_and_si128(a, ect_bit), _mm_setzero_si128()),
+                                                             _mm_cmpeq_epi16(_mm_and_si128(b, ect_bit), _mm_setzero_si128())))) << i;
+    }
+#elif defined(RFC8888_NEON)
+    static const uint16_t lane_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t weights = vld1q_u16(lane_bits);
+    const uint16x8_t ce_bits = vdupq_n_u16(0x6000);
+    const uint16x8_t ect_bit = vdupq_n_u16(0x2000);
+    recv = ce = notect = 0;
+    for (uint32_t i = 0; i < 32; i += 8) {
+        uint16x8_t a = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(vld1q_u16(report + i))));
+        recv |= uint32_t(vaddvq_u16(vandq_u16(vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(a), 15)), weights))) << i;
+        ce |= uint32_t(vaddvq_u16(vandq_u16(vceqq_u16(vandq_u16(a, ce_bits), ce_bits), weights))) << i;
+        notect |= uint32_t(vaddvq_u16(vandq_u16(vceqq_u16(vandq_u16(a, ect_bit), vdupq_n_u16(0)), weights))) << i;
+    }
+#else
+    recv = ce = notect = 0;
+    for (uint32_t i = 0; i < 32; i++) {
+        uint16_t r = rfc8888_swap(report[i]);
+        recv |= uint32_t(r >> 15) << i;
+        ce |= uint32_t((r & 0x6000) == 0x6000) << i;
+        notect |= uint32_t((r & 0x2000) == 0) << i;
+    }
+#endif
+}
+
+// Same for n <= 32 reports, avail being the number of reports that can be read from report
+inline void rfc8888_classify(const uint16_t *report, uint32_t n, uint32_t avail, uint32_t &recv, uint32_t &ce, uint32_t &notect)
+{
+    if (avail >= 32) {
+        rfc8888_classify32(report, recv, ce, notect);
+        if (n < 32) {
+            recv &= (1U << n) - 1;
+            ce &= (1U << n) - 1;
+            notect &= (1U << n) - 1;
+        }
+        return;
+    }
+    recv = ce = notect = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t r = rfc8888_swap(report[i]);
+        recv |= uint32_t(r >> 15) << i;
+        ce |= uint32_t((r & 0x6000) == 0x6000) << i;
+        notect |= uint32_t((r & 0x2000) == 0) << i;
+    }
+}
+
+// RTT samples for n network-order reports of packets with consecutive send times:
+// rtt[j] = now - (ATO(report[j]) << 10) - sendtime[j]
+inline void rfc8888_rtt(time_tp now, const uint16_t *report, const time_tp *sendtime, uint32_t n, time_tp *rtt)
+{
+    uint32_t j = 0;
+#if defined(RFC8888_AVX2)
+    const __m256i vnow = _mm256_set1_epi32(now);
+    const __m256i mask = _mm256_set1_epi32(RFC8888_ATO_MASK);
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; j + 8 <= n; j += 8) {
+        __m128i r = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(report + j)), swap);
+        __m256i ato = _mm256_and_si256(_mm256_cvtepu16_epi32(r), mask);
+        __m256i st = _mm256_loadu_si256((const __m256i *)(sendtime + j));
+        _mm256_storeu_si256((__m256i *)(rtt + j), _mm256_sub_epi32(_mm256_sub_epi32(vnow, _mm256_slli_epi32(ato, 10)), st));
+    }
+#elif defined(RFC8888_SSE2)
+    const __m128i vnow = _mm_set1_epi32(now);
+    const __m128i mask = _mm_set1_epi32(RFC8888_ATO_MASK);
+    for (; j + 4 <= n; j += 4) {
+        __m128i r = _mm_loadl_epi64((const __m128i *)(report + j));
+        r = _mm_or_si128(_mm_slli_epi16(r, 8), _mm_srli_epi16(r, 8));
+        __m128i ato = _mm_and_si128(_mm_unpacklo_epi16(r, _mm_setzero_si128()), mask);
+        __m128i st = _mm_loadu_si128((const __m128i *)(sendtime + j));
+        _mm_storeu_si128((__m128i *)(rtt + j), _mm_sub_epi32(_mm_sub_epi32(vnow, _mm_slli_epi32(ato, 10)), st));
+    }
+#elif defined(RFC8888_NEON)
+    const int32x4_t vnow = vdupq_n_s32(now);
+    const uint32x4_t mask = vdupq_n_u32(RFC8888_ATO_MASK);
+    for (; j + 4 <= n; j += 4) {
+        uint16x4_t r = vreinterpret_u16_u8(vrev16_u8(vreinterpret_u8_u16(vld1_u16(report + j))));
+        int32x4_t ato = vreinterpretq_s32_u32(vandq_u32(vmovl_u16(r), mask));
+        vst1q_s32(rtt + j, vsubq_s32(vsubq_s32(vnow, vshlq_n_s32(ato, 10)), vld1q_s32(sendtime + j)));
+    }
+#endif
+    for (; j < n; j++)
+        rtt[j] = now - ((rfc8888_swap(report[j]) & RFC8888_ATO_MASK) << 10) - sendtime[j];
+}
+
+// Arrival time offset in 2^shift µs units (rounded) for a packed arrival record (arrival time << 2 | ECN)
+inline time_tp rfc8888_ato(time_tp now, uint32_t rec, uint8_t shift)
+{
+    time_tp age = time_tp((uint32_t(now) << 2) - (rec & ~3U)) >> 2;
+    return (age + ((1 << shift) >> 1)) >> shift;
+}
+
+// Encode n network-order reports from consecutive packed arrival records (arrival time << 2 | ECN): the packets with
+// their bit set in recv are reported as received with their ECN and ATO, the others as not received.
+inline void rfc8888_encode(time_tp now, const uint32_t *rec, uint32_t n, uint32_t recv, uint16_t *report)
+{
+    uint32_t j = 0;
+#if defined(RFC8888_AVX2)
+    const __m256i vnow = _mm256_set1_epi32(int32_t(uint32_t(now) << 2));
+    const __m256i time_bits = _mm256_set1_epi32(~3);
+    const __m256i ecn_bits = _mm256_set1_epi32(3);
+    const __m256i half = _mm256_set1_epi32(1 << 9);
+    const __m256i mask = _mm256_set1_epi32(RFC8888_ATO_MASK);
+    const __m256i lane_bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; j + 16 <= n; j += 16) {
+        __m256i r[2];
+        for (int k = 0; k < 2; k++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(rec + j + 8 * k));
+            __m256i age = _mm256_srai_epi32(_mm256_sub_epi32(vnow, _mm256_and_si256(v, time_bits)), 2);
+            __m256i ato = _mm256_and_si256(_mm256_srai_epi32(_mm256_add_epi32(age, half), 10), mask);
+            r[k] = _mm256_or_si256(ato, _mm256_slli_epi32(_mm256_and_si256(v, ecn_bits), 13));
+        }
+        __m256i rpt = _mm256_permute4x64_epi64(_mm256_packs_epi32(r[0], r[1]), 0xD8);
+        rpt = _mm256_or_si256(rpt, _mm256_set1_epi16(int16_t(0x8000)));
+        __m256i sel = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(int16_t(recv >> j)), lane_bits), lane_bits);
+        _mm256_storeu_si256((__m256i *)(report + j), _mm256_shuffle_epi8(_mm256_and_si256(rpt, sel), swap));
+    }
+#elif defined(RFC8888_SSE2)
+    const __m128i vnow = _mm_set1_epi32(int32_t(uint32_t(now) << 2));
+    const __m128i time_bits = _mm_set1_epi32(~3);
+    const __m128i ecn_bits = _mm_set1_epi32(3);
+    const __m128i half = _mm_set1_epi32(1 << 9);
+    const __m128i mask = _mm_set1_epi32(RFC8888_ATO_MASK);
+    const __m128i lane_bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    for (; j + 8 <= n; j += 8) {
+        __m128i r[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(rec + j + 4 * k));
+            __m128i age = _mm_srai_epi32(_mm_sub_epi32(vnow, _mm_and_si128(v, time_bits)), 2);
+            __m128i ato = _mm_and_si128(_mm_srai_epi32(_mm_add_epi32(age, half), 10), mask);
+            r[k] = _mm_or_si128(ato, _mm_slli_epi32(_mm_and_si128(v, ecn_bits), 13));
+        }
+        __m128i rpt = _mm_or_si128(_mm_packs_epi32(r[0], r[1]), _mm_set1_epi16(int16_t(0x8000)));
+        __m128i sel = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(int16_t((recv >> j) & 0xFF)), lane_bits), lane_bits);
+        rpt = _mm_and_si128(rpt, sel);
+        _mm_storeu_si128((__m128i *)(report + j), _mm_or_si128(_mm_slli_epi16(rpt, 8), _mm_srli_epi16(rpt, 8)));
+    }
+#elif defined(RFC8888_NEON)
+    static const uint16_t lane_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t weights = vld1q_u16(lane_bits);
+    const uint32x4_t vnow = vdupq_n_u32(uint32_t(now) << 2);
+    const uint32x4_t time_bits = vdupq_n_u32(~3U);
+    const uint32x4_t ecn_bits = vdupq_n_u32(3);
+    const int32x4_t half = vdupq_n_s32(1 << 9);
+    const uint32x4_t mask = vdupq_n_u32(RFC8888_ATO_MASK);
+    for (; j + 8 <= n; j += 8) {
+        uint16x4_t r[2];
+        for (int k = 0; k < 2; k++) {
+            uint32x4_t v = vld1q_u32(rec + j + 4 * k);
+            int32x4_t age = vshrq_n_s32(vreinterpretq_s32_u32(vsubq_u32(vnow, vandq_u32(v, time_bits))), 2);
+            uint32x4_t ato = vandq_u32(vreinterpretq_u32_s32(vshrq_n_s32(vaddq_s32(age, half), 10)), mask);
+            r[k] = vmovn_u32(vorrq_u32(ato, vshlq_n_u32(vandq_u32(v, ecn_bits), 13)));
+        }
+        uint16x8_t rpt = vorrq_u16(vcombine_u16(r[0], r[1]), vdupq_n_u16(0x8000));
+        rpt = vandq_u16(rpt, vtstq_u16(vdupq_n_u16(uint16_t((recv >> j) & 0xFF)), weights));
+        vst1q_u16(report + j, vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(rpt))));
+    }
+#endif
+    for (; j < n; j++) {
+        uint16_t r = 0;
+        if ((recv >> j) & 1)
+            r = uint16_t(0x8000 | ((rec[j] & ecn_ce) << 13) | (rfc8888_ato(now, rec[j], 10) & RFC8888_ATO_MASK));
+        report[j] = rfc8888_swap(r);
+    }
+}
+
+#endif //RFC8888_SIMD_H
@@ -0,0 +1,509 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+// scoreboard.h:
+// Sender-side per-packet state (sent/received/lost), send time and frame number, and receiver-side per-packet state
+// (received/reported/lost) and arrival record, kept in rings that are sized to the packets in flight instead of fixed
+// 65536-entry arrays. The packet states are a 2-bit-per-packet bitmap, so the state of a whole range of packets can be
+// changed and counted 32 packets at a time.
+//
+
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#include "prague_cc.h"
+
+#define SB_INIT_SIZE 256      // initial ring size in packets (power of 2, multiple of 32)
+#define SB_MAX_SIZE  131072   // maximum ring size in packets: 65536 packets in flight plus the same history
+
+enum pktsend_tp {snd_init = 0, snd_sent, snd_recv, snd_lost};
+enum pktrecv_tp {rcv_init = 0, rcv_recv, rcv_ackd, rcv_lost};
+
+inline uint32_t popcount64(uint64_t v)
+{
+#ifdef _MSC_VER
+    return uint32_t(__popcnt64(v));
+#else
+    return uint32_t(__builtin_popcountll(v));
+#endif
+}
+
+inline uint32_t ctz64(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return uint32_t(i);
+#else
+    return uint32_t(__builtin_ctzll(v));
+#endif
+}
+
+inline uint32_t msb64(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return uint32_t(i);
+#else
+    return uint32_t(63 - __builtin_clzll(v));
+#endif
+}
+
+// Move bit j of v to bit 2j (one bit per 2-bit packet state)
+inline uint64_t spread_bits(uint32_t v)
+{
+#ifdef __BMI2__
+    return _pdep_u64(v, 0x5555555555555555ULL);
+#else
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    return (x | (x << 1)) & 0x5555555555555555ULL;
+#endif
+}
+
+// Move bit 2j of v to bit j (the inverse of spread_bits)
+inline uint32_t compact_bits(uint64_t v)
+{
+#ifdef __BMI2__
+    return uint32_t(_pext_u64(v, 0x5555555555555555ULL));
+#else
+    uint64_t x = v & 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    return uint32_t(x | (x >> 16));
+#endif
+}
+
+class Scoreboard {
+    std::vector<uint64_t> m_state;     // 2 bits per packet, 32 packets per word
+    std::vector<time_tp> m_sendtime;
+    std::vector<count_tp> m_frame;     // only allocated when frames are used
+    uint32_t m_size;                   // ring size in packets, power of 2
+    uint32_t m_max_size;
+    count_tp m_head;                   // next sequence number to be sent
+    count_tp m_last_ack;               // last sequence number covered by feedback
+    // reordering statistics and reordering-tolerant (RACK-style) loss detection
+    bool m_rack;                       // packets reported missing stay outstanding until DetectLost() finds them lost
+    bool m_rack_new;                   // a later sent packet was delivered since the last DetectLost()
+    count_tp m_rack_seq;               // highest delivered sequence number
+    time_tp m_rack_sendtime;           // and its send time
+    time_tp m_rack_rtt;                // RTT of the latest delivered packet, including the feedback delay
+    time_tp m_rack_srtt;
+    time_tp m_rack_min_rtt;
+    time_tp m_rack_timeout;            // when the oldest outstanding packet will be found lost
+    bool m_rack_armed;                 // m_rack_timeout is valid
+    count_tp m_rack_first;             // the packets before it are not outstanding below m_rack_seq anymore
+    time_tp m_reo_extent;              // largest send time difference a late delivered packet was overtaken by
+    time_tp m_reo_ts;                  // last time the reordering was seen (or the extent was decayed)
+    count_tp m_reo_seen;               // m_reordered at m_reo_ts
+    count_tp m_reo_steps;              // reorder window in quarters of the minimum RTT, increased on spurious losses
+    time_tp m_reo_step_ts;
+    count_tp m_spurious_seen;          // m_spurious at m_reo_step_ts
+    count_tp m_reordered;              // packets delivered after a later sent packet
+    count_tp m_spurious;               // packets found lost, but delivered later
+    count_tp m_detected;               // packets found lost by DetectLost()
+
+    static const uint64_t LO_BITS = 0x5555555555555555ULL;
+
+    uint32_t index(count_tp seq) const { return uint32_t(seq) & (m_size - 1); }
+    bool valid(count_tp seq) const { return m_head - seq > 0 && m_head - seq <= count_tp(m_size); }
+    void put(count_tp seq, pktsend_tp state) {
+        uint32_t idx = index(seq);
+        uint64_t &w = m_state[idx >> 5];
+        w = (w & ~(3ULL << ((idx & 31) * 2))) | (uint64_t(state) << ((idx & 31) * 2));
+    }
+    void grow() {
+        std::vector<uint64_t> state;
+        std::vector<time_tp> sendtime;
+        std::vector<count_tp> frame;
+        state.swap(m_state);
+        sendtime.swap(m_sendtime);
+        frame.swap(m_frame);
+        uint32_t old_mask = m_size - 1;
+        count_tp first = m_head - count_tp(m_size);
+        m_size *= 2;
+        m_state.assign(m_size / 32, 0);
+        m_sendtime.assign(m_size, 0);
+        if (!frame.empty())
+            m_frame.assign(m_size, 0);
+        for (count_tp seq = first; seq != m_head; seq++) {
+            uint32_t old_idx = uint32_t(seq) & old_mask;
+            put(seq, pktsend_tp((state[old_idx >> 5] >> ((old_idx & 31) * 2)) & 3));
+            m_sendtime[index(seq)] = sendtime[old_idx];
+            if (!m_frame.empty())
+                m_frame[index(seq)] = frame[old_idx];
+        }
+    }
+    // Register the newly delivered packets seq + j for the bits j of mask (packets sharing one bitmap word). Those sent
+    // before the highest delivered packet of previous feedback are reordered, and the send time difference is the extent.
+    void delivered(count_tp seq, uint32_t mask) {
+        if (!mask)
+            return;
+        if (m_rack_seq - seq > 0) {
+            uint32_t below = (m_rack_seq - seq >= 32) ? mask : mask & ((1U << (m_rack_seq - seq)) - 1);
+            if (below) {
+                m_reordered += popcount64(below);
+                time_tp extent = m_rack_sendtime - SendTime(seq + count_tp(ctz64(below)));
+                if (extent > m_reo_extent)
+                    m_reo_extent = extent;
+            }
+        }
+        count_tp hi = seq + count_tp(msb64(mask));
+        if (hi - m_rack_seq > 0) {
+            m_rack_seq = hi;
+            m_rack_sendtime = SendTime(hi);
+            m_rack_new = true;
+        }
+    }
+    // Move all sent packets in [begin, end) to state to (snd_recv or snd_lost), calling changed(seq) for each of them.
+    // Works a word (32 packets) at a time, only the changed packets are visited. With reordering-tolerant loss
+    // detection, packets are not moved to lost here.
+    template <typename F>
+    count_tp transition(count_tp begin, count_tp end, pktsend_tp to, F changed) {
+        count_tp count = 0;
+        if (to == snd_lost && m_rack)
+            return 0;
+        if (!valid(begin))
+            begin = (m_head - begin > 0) ? m_head - count_tp(m_size) : m_head;
+        if (m_head - end < 0)
+            end = m_head;
+        while (end - begin > 0) {
+            uint32_t idx = index(begin);
+            uint32_t bit = idx & 31;
+            uint32_t n = (end - begin < count_tp(32 - bit)) ? uint32_t(end - begin) : 32 - bit;
+            uint64_t range = (n == 32) ? ~0ULL : ((1ULL << (2 * n)) - 1) << (2 * bit);
+            uint64_t &w = m_state[idx >> 5];
+            uint64_t sent = w & ~(w >> 1) & LO_BITS & range;  // 0b01 slots
+            if (sent) {
+                w ^= (to == snd_lost) ? (sent << 1) : (sent | (sent << 1));
+                count += popcount64(sent);
+                if (to == snd_recv)
+                    delivered(begin, compact_bits(sent >> (2 * bit)));
+                for (uint64_t m = sent; m; m &= m - 1)
+                    changed(begin + count_tp(ctz64(m) / 2 - bit));
+            }
+            begin += n;
+        }
+        return count;
+    }
+    struct no_change { void operator()(count_tp) const {} };
+
+public:
+    Scoreboard(bool frames = false, uint32_t max_size = SB_MAX_SIZE, bool rack = false) :
+        m_state(SB_INIT_SIZE / 32, 0), m_sendtime(SB_INIT_SIZE, 0), m_frame(frames ? SB_INIT_SIZE : 0, 0),
+        m_size(SB_INIT_SIZE), m_max_size(max_size < SB_INIT_SIZE ? SB_INIT_SIZE : max_size), m_head(1), m_last_ack(0),
+        m_rack(rack), m_rack_new(false), m_rack_seq(0), m_rack_sendtime(0), m_rack_rtt(0), m_rack_srtt(0), m_rack_min_rtt(0),
+        m_rack_timeout(0), m_rack_armed(false), m_rack_first(1), m_reo_extent(0), m_reo_ts(0), m_reo_seen(0),
+        m_reo_steps(1), m_reo_step_ts(0), m_spurious_seen(0),
+        m_reordered(0), m_spurious(0), m_detected(0) {}
+
+    // Register packet seq as sent. The ring is doubled while the packets after the last feedback (or the oldest
+    // outstanding packet the loss detection waits for) do not fit in half of it, so the other half keeps the history
+    // for late feedback.
+    void Sent(count_tp seq, time_tp sendtime, count_tp frame = 0) {
+        count_tp oldest = (m_rack && m_rack_first - 1 - m_last_ack < 0) ? m_rack_first - 1 : m_last_ack;
+        while (2 * (seq - oldest) > count_tp(m_size) && m_size < m_max_size)
+            grow();
+        if (seq - m_head > 0 && seq - m_head < count_tp(m_size)) {
+            for (count_tp s = m_head; s != seq; s++)  // skipped sequence numbers were never sent
+                put(s, snd_init);
+        }
+        put(seq, snd_sent);
+        m_sendtime[index(seq)] = sendtime;
+        if (!m_frame.empty())
+            m_frame[index(seq)] = frame;
+        if (seq + 1 - m_head > 0)
+            m_head = seq + 1;
+    }
+    pktsend_tp State(count_tp seq) const {
+        if (!valid(seq))
+            return snd_init;
+        uint32_t idx = index(seq);
+        return pktsend_tp((m_state[idx >> 5] >> ((idx & 31) * 2)) & 3);
+    }
+    void SetState(count_tp seq, pktsend_tp state) {
+        if (valid(seq))
+            put(seq, state);
+    }
+    // Mark packet seq as received (if it was sent or lost) or lost (if it was sent), returning its previous state
+    pktsend_tp Received(count_tp seq) {
+        if (!valid(seq))
+            return snd_init;
+        uint32_t idx = index(seq);
+        uint32_t shift = (idx & 31) * 2;
+        uint64_t &w = m_state[idx >> 5];
+        pktsend_tp prev = pktsend_tp((w >> shift) & 3);
+        if (prev == snd_sent || prev == snd_lost) {
+            w = (w & ~(3ULL << shift)) | (uint64_t(snd_recv) << shift);
+            m_spurious += (prev == snd_lost);
+            delivered(seq, 1);
+        }
+        return prev;
+    }
+    pktsend_tp Lost(count_tp seq) {
+        if (!valid(seq))
+            return snd_init;
+        uint32_t idx = index(seq);
+        uint32_t shift = (idx & 31) * 2;
+        uint64_t &w = m_state[idx >> 5];
+        pktsend_tp prev = pktsend_tp((w >> shift) & 3);
+        if (prev == snd_sent && !m_rack)
+            w |= uint64_t(snd_lost) << shift;
+        return prev;
+    }
+    // Apply per packet feedback to the n packets from seq, which must share one bitmap word (n <= 32 - seq % 32).
+    // Bit j of recv is set if packet seq + j was received. Sent or lost packets that were received become received,
+    // sent packets that were not become lost (unless the loss detection is reordering-tolerant). Returns the masks of
+    // the packets that became received, of those that were lost before, and of the packets that became lost.
+    void Apply(count_tp seq, uint32_t n, uint32_t recv, uint32_t &to_recv, uint32_t &from_lost, uint32_t &to_lost) {
+        uint32_t bit = uint32_t(seq) & 31;
+        uint64_t range = ((n == 32) ? ~0ULL : (1ULL << (2 * n)) - 1) << (2 * bit);
+        if (!valid(seq) || !valid(seq + count_tp(n) - 1)) {
+            for (uint32_t j = 0; j < n; j++)  // partly outside the ring
+                if (!valid(seq + count_tp(j)))
+                    range &= ~(3ULL << (2 * (bit + j)));
+        }
+        uint64_t &w = m_state[index(seq) >> 5];
+        uint64_t lo = w & LO_BITS & range;
+        uint64_t hi = (w >> 1) & LO_BITS & range;
+        uint64_t r = spread_bits(recv) << (2 * bit);
+        uint64_t rcv = r & lo;         // sent (01) or lost (11) to received (10)
+        uint64_t rec = rcv & hi;       // lost to received
+        uint64_t lst = m_rack ? 0 : ~r & lo & ~hi;  // sent to lost (11)
+        if (rcv | lst)
+            w ^= rcv | (((rcv & ~hi) | lst) << 1);
+        to_recv = compact_bits(rcv >> (2 * bit));
+        from_lost = compact_bits(rec >> (2 * bit));
+        to_lost = compact_bits(lst >> (2 * bit));
+        if (to_recv) {
+            m_spurious += popcount64(from_lost);
+            delivered(seq, to_recv);
+        }
+    }
+    // Send times of the packets from seq, consecutive up to the end of its bitmap word
+    const time_tp *SendTimes(count_tp seq) const { return &m_sendtime[index(seq)]; }
+    time_tp SendTime(count_tp seq) const { return m_sendtime[index(seq)]; }
+    count_tp Frame(count_tp seq) const { return m_frame.empty() ? 0 : m_frame[index(seq)]; }
+    count_tp LastAck() const { return m_last_ack; }
+    void AckedUpTo(count_tp seq) {
+        if (seq - m_last_ack > 0)
+            m_last_ack = seq;
+    }
+
+    // Mark the sent packets in [begin, end) as lost/received, returning how many changed
+    count_tp MarkLost(count_tp begin, count_tp end) { return transition(begin, end, snd_lost, no_change()); }
+    count_tp MarkRecv(count_tp begin, count_tp end) { return transition(begin, end, snd_recv, no_change()); }
+    template <typename F>
+    count_tp MarkLost(count_tp begin, count_tp end, F changed) { return transition(begin, end, snd_lost, changed); }
+    template <typename F>
+    count_tp MarkRecv(count_tp begin, count_tp end, F changed) { return transition(begin, end, snd_recv, changed); }
+
+    // Reordering-tolerant loss detection (RACK, RFC8985): an outstanding packet sent before the highest delivered one
+    // is lost when it is still not delivered after the RTT of that delivered packet plus the reorder window. Call after
+    // every feedback (only then the RTT is sampled) and when LossTimer() expires. Returns the packets found lost,
+    // calling changed(seq) for each of them.
+    count_tp DetectLost(time_tp now) { return DetectLost(now, no_change()); }
+    template <typename F>
+    count_tp DetectLost(time_tp now, F changed) {
+        if (m_rack_new) {
+            m_rack_new = false;
+            m_rack_rtt = now - m_rack_sendtime;
+            m_rack_srtt = m_rack_srtt ? m_rack_srtt + ((m_rack_rtt - m_rack_srtt) >> 3) : m_rack_rtt;
+            if (!m_rack_min_rtt || m_rack_rtt < m_rack_min_rtt)
+                m_rack_min_rtt = m_rack_rtt;
+        }
+        if (m_spurious != m_spurious_seen && now - m_reo_step_ts - m_rack_srtt >= 0) {
+            m_spurious_seen = m_spurious;  // the window was too small, widen it at most once per RTT
+            m_reo_steps++;
+            m_reo_step_ts = now;
+        }
+        if (m_reordered != m_reo_seen) {
+            m_reo_seen = m_reordered;
+            m_reo_ts = now;
+        } else if ((m_reo_extent || m_reo_steps > 1) && now - m_reo_ts - 16 * m_rack_srtt > 0) {
+            m_reo_extent /= 2;  // no reordering for 16 RTTs
+            if (m_reo_steps > 1)
+                m_reo_steps--;
+            m_reo_ts = now;
+        }
+        m_rack_armed = false;
+        if (!m_rack)
+            return 0;
+        time_tp wait = m_rack_rtt + ReorderWindow();
+        count_tp count = 0;
+        if (!valid(m_rack_first))
+            m_rack_first = (m_head - m_rack_first > 0) ? m_head - count_tp(m_size) : m_head;
+        while (m_rack_seq - m_rack_first > 0) {
+            uint32_t idx = index(m_rack_first);
+            uint32_t bit = idx & 31;
+            uint32_t n = (m_rack_seq - m_rack_first < count_tp(32 - bit)) ? uint32_t(m_rack_seq - m_rack_first) : 32 - bit;
+            uint64_t range = (n == 32) ? ~0ULL : ((1ULL << (2 * n)) - 1) << (2 * bit);
+            uint64_t &w = m_state[idx >> 5];
+            for (uint64_t sent = w & ~(w >> 1) & LO_BITS & range; sent; sent &= sent - 1) {
+                count_tp seq = m_rack_first + count_tp(ctz64(sent) / 2 - bit);
+                time_tp expire = m_sendtime[index(seq)] + wait;
+                if (expire - now >= 0) {
+                    // the send times increase with the sequence numbers, so the later packets are not lost either
+                    m_rack_first = seq;
+                    m_rack_timeout = expire + 1;
+                    m_rack_armed = true;
+                    m_detected += count;
+                    return count;
+                }
+                w |= (sent & (~sent + 1)) << 1;
+                count++;
+                changed(seq);
+            }
+            m_rack_first += count_tp(n);
+        }
+        m_detected += count;
+        return count;
+    }
+    // The time DetectLost() should be called if no feedback arrives earlier
+    bool LossTimer(time_tp &timeout) const {
+        if (m_rack_armed)
+            timeout = m_rack_timeout;
+        return m_rack_armed;
+    }
+    // The extent of the observed reordering, at least a quarter of the minimum RTT (times the steps) and at most the
+    // smoothed RTT
+    time_tp ReorderWindow() const {
+        time_tp wnd = (m_reo_extent > m_reo_steps * (m_rack_min_rtt / 4)) ? m_reo_extent : m_reo_steps * (m_rack_min_rtt / 4);
+        return (wnd > m_rack_srtt) ? m_rack_srtt : wnd;
+    }
+    count_tp Reordered() const { return m_reordered; }
+    count_tp Spurious() const { return m_spurious; }
+    count_tp DetectedLost() const { return m_detected; }
+};
+
+// Receiver-side packet states and arrival records (arrival time << 2 | ECN, the time wraps every 2^30 µs)
+class RecvScoreboard {
+    std::vector<uint64_t> m_state;     // 2 bits per packet, 32 packets per word
+    std::vector<uint32_t> m_record;
+    uint32_t m_size;                   // ring size in packets, power of 2
+    uint32_t m_max_size;
+    count_tp m_head;                   // highest received sequence number + 1
+    count_tp m_reported;               // first sequence number not reported yet
+    bool m_started;
+
+    static const uint64_t LO_BITS = 0x5555555555555555ULL;
+
+    uint32_t index(count_tp seq) const { return uint32_t(seq) & (m_size - 1); }
+    bool valid(count_tp seq) const { return m_head - seq > 0 && m_head - seq <= count_tp(m_size); }
+    pktrecv_tp get(count_tp seq) const {
+        uint32_t idx = index(seq);
+        return pktrecv_tp((m_state[idx >> 5] >> ((idx & 31) * 2)) & 3);
+    }
+    void put(count_tp seq, pktrecv_tp state) {
+        uint32_t idx = index(seq);
+        uint64_t &w = m_state[idx >> 5];
+        w = (w & ~(3ULL << ((idx & 31) * 2))) | (uint64_t(state) << ((idx & 31) * 2));
+    }
+    void grow() {
+        std::vector<uint64_t> state;
+        std::vector<uint32_t> record;
+        state.swap(m_state);
+        record.swap(m_record);
+        uint32_t old_mask = m_size - 1;
+        count_tp first = m_head - count_tp(m_size);
+        m_size *= 2;
+        m_state.assign(m_size / 32, 0);
+        m_record.assign(m_size, 0);
+        for (count_tp seq = first; seq != m_head; seq++) {
+            uint32_t old_idx = uint32_t(seq) & old_mask;
+            put(seq, pktrecv_tp((state[old_idx >> 5] >> ((old_idx & 31) * 2)) & 3));
+            m_record[index(seq)] = record[old_idx];
+        }
+    }
+    // 2-bit mask of the valid packets of the n packets from seq, which share one bitmap word
+    uint64_t valid_range(count_tp seq, uint32_t n) const {
+        uint32_t bit = uint32_t(seq) & 31;
+        uint64_t range = ((n == 32) ? ~0ULL : (1ULL << (2 * n)) - 1) << (2 * bit);
+        if (!valid(seq) || !valid(seq + count_tp(n) - 1)) {
+            for (uint32_t j = 0; j < n; j++)  // partly outside the ring
+                if (!valid(seq + count_tp(j)))
+                    range &= ~(3ULL << (2 * (bit + j)));
+        }
+        return range;
+    }
+    // The states of [begin, end) (at most one ring) become rcv_init, a word at a time
+    void clear(count_tp begin, count_tp end) {
+        while (end - begin > 0) {
+            uint32_t idx = index(begin);
+            uint32_t bit = idx & 31;
+            uint32_t n = (end - begin < count_tp(32 - bit)) ? uint32_t(end - begin) : 32 - bit;
+            m_state[idx >> 5] &= ~(((n == 32) ? ~0ULL : (1ULL << (2 * n)) - 1) << (2 * bit));
+            begin += n;
+        }
+    }
+
+public:
+    RecvScoreboard(uint32_t max_size = SB_MAX_SIZE) :
+        m_state(SB_INIT_SIZE / 32, 0), m_record(SB_INIT_SIZE, 0), m_size(SB_INIT_SIZE),
+        m_max_size(max_size < SB_INIT_SIZE ? SB_INIT_SIZE : max_size), m_head(0), m_reported(0), m_started(false) {}
+
+    // Register the arrival of packet seq. A duplicate keeps its first arrival time, but a CE mark is kept.
+    // The ring is doubled while the packets not reported yet do not fit in half of it.
+    void Received(count_tp seq, time_tp now, ecn_tp ecn) {
+        if (!m_started) {
+            m_head = m_reported = seq;
+            m_started = true;
+        }
+        while (2 * (seq + 1 - m_reported) > count_tp(m_size) && m_size < m_max_size)
+            grow();
+        if (seq - m_head >= 0) {
+            clear(m_head, (seq - m_head < count_tp(m_size)) ? seq + 1 : m_head + count_tp(m_size));  // not received (yet)
+            m_head = seq + 1;
+        } else if (!valid(seq)) {
+            return;  // too old
+        }
+        uint32_t &rec = m_record[index(seq)];
+        if (get(seq) != rcv_recv) {
+            rec = (uint32_t(now) << 2) | (ecn & ecn_ce);
+            put(seq, rcv_recv);
+        } else if (ecn == ecn_ce) {
+            rec |= ecn_ce;
+        }
+    }
+    // Classify the n packets from seq, which must share one bitmap word (n <= 32 - seq % 32), for a feedback report:
+    // returns the mask of the packets to report as received (received, or reported before within timeout).
+    uint32_t Classify(count_tp seq, uint32_t n, time_tp now, time_tp timeout) const {
+        uint32_t bit = uint32_t(seq) & 31;
+        uint64_t w = m_state[index(seq) >> 5] & valid_range(seq, n);
+        if (!w)
+            return 0;  // nothing received
+        uint64_t lo = w & LO_BITS;
+        uint64_t hi = (w >> 1) & LO_BITS;
+        uint32_t recv = compact_bits((lo & ~hi) >> (2 * bit));
+        uint32_t ackd = compact_bits((hi & ~lo) >> (2 * bit));
+        const uint32_t *rec = &m_record[index(seq)];
+        for (; ackd; ackd &= ackd - 1) {  // only when feedback is repeated for reordered packets
+            uint32_t j = ctz64(ackd);
+            if (time_tp((rec[j] & ~3U) + (uint32_t(timeout) << 2) - (uint32_t(now) << 2)) > 0)
+                recv |= 1U << j;
+        }
+        return recv;
+    }
+    // Mark the n packets from seq (sharing one bitmap word) as reported: the ones in recv as rcv_ackd, the others as lost
+    void Reported(count_tp seq, uint32_t n, uint32_t recv) {
+        uint32_t bit = uint32_t(seq) & 31;
+        uint64_t range = valid_range(seq, n);
+        uint64_t &w = m_state[index(seq) >> 5];
+        w = (w & ~range) | (range & ~LO_BITS) | (range & LO_BITS & ~(spread_bits(recv) << (2 * bit)));
+        if (seq + count_tp(n) - m_reported > 0)
+            m_reported = seq + count_tp(n);
+    }
+    // Arrival records of the packets from seq, consecutive up to the end of its bitmap word
+    const uint32_t *Records(count_tp seq) const { return &m_record[index(seq)]; }
+};
+
+#endif //SCOREBOARD_H
@@ -18,7 +18,7 @@ local udpprague_p  = Proto.new("udpprague", "UdpPrague")
 local f            = udpprague_p.fields
 
 -- New types
-local udpprague_t  = { [1]="Bulk sender", [2]="Real-Time sender", [17]="Per-pkt ACK receiver", [18]="RFC-8888 ACK receiver" }
+local udpprague_t  = { [1]="Bulk sender", [2]="Real-Time sender", [3]="File sender", [4]="Real-Time sender with FEC", [5]="Bidirectional peer", [17]="Per-pkt ACK receiver", [18]="RFC-8888 ACK receiver", [19]="RLE ACK receiver" }
 local ipecn_t      = { [0]="Not ECN-Capable Transport", [1]="ECN-Capable Transport (1)", [2]="ECN-Capable Transport (0)", [3]="Congestion Experienced" }
 
 -- ProtoField.new(name, abbr, type, [valuestring], [base], [mask], [description])
@@ -32,12 +32,28 @@ f.echoed_ts   = ProtoField.int32( "udpprague.echo_ts",     "Echo Timestamp",
 
 -- For Bulk data, Real-time data
 f.seq_nr      = ProtoField.int32( "udpprague.seq_nr",      "Sequence Number",   base.DEC,  nil,         nil, "Packet sequence number")
+f.ack_window  = ProtoField.int32( "udpprague.ack_window",  "ACK Window",        base.DEC,  nil,         nil, "Requested ACK frequency in packets")
+f.ack_delay   = ProtoField.int32( "udpprague.ack_delay",   "ACK Delay",         base.DEC,  nil,         nil, "Requested maximum ACK delay in us")
 
 -- For Real-time data
 f.frame_nr    = ProtoField.int32( "udpprague.frame_nr",    "Frame Number",      base.DEC,  nil,         nil, "Frame sequence number")
 f.frame_sent  = ProtoField.int32( "udpprague.frame_sent",  "Frame Sent",        base.DEC,  nil,         nil, "Frame sent in bytes")
 f.frame_size  = ProtoField.int32( "udpprague.frame_size",  "Frame Size",        base.DEC,  nil,         nil, "Frame size in bytes")
 
+-- For Real-time data with FEC
+local fecscheme_t  = { [1]="XOR", [2]="Reed-Solomon" }
+f.fec_scheme  = ProtoField.uint8( "udpprague.fec_scheme",  "FEC Scheme",        base.DEC,  fecscheme_t, nil, "FEC scheme")
+f.fec_block   = ProtoField.uint8( "udpprague.fec_block",   "FEC Block",         base.DEC,  nil,         nil, "FEC block of the frame")
+f.fec_k       = ProtoField.uint8( "udpprague.fec_k",       "FEC Data Packets",  base.DEC,  nil,         nil, "Data packets of the FEC block")
+f.fec_m       = ProtoField.uint8( "udpprague.fec_m",       "FEC Parity Packets", base.DEC, nil,         nil, "Parity packets of the FEC block")
+f.fec_index   = ProtoField.uint8( "udpprague.fec_index",   "FEC Index",         base.DEC,  nil,         nil, "Position in the FEC block, data first")
+f.fec_blocks  = ProtoField.uint8( "udpprague.fec_blocks",  "FEC Blocks",        base.DEC,  nil,         nil, "FEC blocks of the frame")
+
+-- For File data
+f.chunk       = ProtoField.int32( "udpprague.chunk",       "Chunk",             base.DEC,  nil,         nil, "File chunk index")
+f.chunk_size  = ProtoField.uint32("udpprague.chunk_size",  "Chunk Size",        base.DEC,  nil,         nil, "Size of every chunk but the last in bytes")
+f.file_size   = ProtoField.uint64("udpprague.file_size",   "File Size",         base.DEC,  nil,         nil, "File size in bytes")
+
 -- For Per-pkt ACK
 f.ack_seq     = ProtoField.int32( "udpprague.ack_seq",     "Ack Sequence",      base.DEC,  nil,         nil, "Acked sequence number")
 f.pkt_rcvd    = ProtoField.int32( "udpprague.pkts_revd",   "Packets Received",  base.DEC,  nil,         nil, "Packets received counter")
@@ -55,6 +71,17 @@ f.rfc8888_rpt_rcv = ProtoField.uint16("udpprague.rfc8888_rpt_rcv", "RFC8888 Repo
 f.rfc8888_rpt_ecn = ProtoField.uint16("udpprague.rfc8888_rpt_ecn", "RFC8888 Report received ECN",    base.DEC,  ipecn_t, 0x6000)
 f.rfc8888_rpt_ato = ProtoField.uint16("udpprague.rfc8888_rpt_ato", "RFC8888 Report air time offset", base.DEC,  nil,     0x1FFF)
 
+-- For RLE ACK
+f.rle_seq     = ProtoField.int32( "udpprague.rle_seq",     "RLE Sequence",      base.DEC,  nil,         nil, "Start sequence in RLE ACK")
+f.rle_num     = ProtoField.uint16("udpprague.rle_num",     "RLE Number",        base.DEC,  nil,         nil, "Report numbers in RLE ACK")
+f.rle_runs    = ProtoField.uint16("udpprague.rle_runs",    "RLE Runs",          base.DEC,  nil,         nil, "Run numbers in RLE ACK")
+f.rle_shift   = ProtoField.uint8( "udpprague.rle_shift",   "RLE ATO Shift",     base.DEC,  nil,         nil, "ATO resolution in 2^shift us")
+f.rle_run     = ProtoField.uint16("udpprague.rle_run",     "RLE Run",           base.HEX,  nil,         nil, "Run in RLE ACK")
+f.rle_run_rcv = ProtoField.uint16("udpprague.rle_run_rcv", "RLE Run receive flag", base.DEC, nil,       0x8000)
+f.rle_run_ecn = ProtoField.uint16("udpprague.rle_run_ecn", "RLE Run received ECN", base.DEC, ipecn_t,   0x6000)
+f.rle_run_len = ProtoField.uint16("udpprague.rle_run_len", "RLE Run length - 1",   base.DEC, nil,       0x1FFF)
+f.rle_run_ato = ProtoField.int32( "udpprague.rle_run_ato", "RLE Run ATO delta",    base.DEC, nil,       nil, "Zigzag decoded ATO delta")
+
 function udpprague_p.dissector(buffer, pinfo, tree)
 
 	-- Changing the value in the protocol column (the Wireshark pane that displays a list of packets)
@@ -67,14 +94,16 @@ function udpprague_p.dissector(buffer, pinfo, tree)
 	local payload_len = buffer:len()
 
 	if msg_type == 1 then
-		if payload_len >= 13 then
+		if payload_len >= 21 then
 			offset = 0
-			length = 13
+			length = 21
 			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
 			subtree:add(f.type,       buffer(offset, 1)); offset = offset + 1
 			subtree:add(f.timestamp,  buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.echoed_ts,  buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.seq_nr,     buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_window, buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_delay,  buffer(offset, 4)); offset = offset + 4
 		else
 			offset = 0
 			length = 0
@@ -84,14 +113,16 @@ function udpprague_p.dissector(buffer, pinfo, tree)
 		local data_buffer = buffer:range(offset, payload_len - length):tvb()
 		Dissector.get("data"):call(data_buffer, pinfo, tree)
 	elseif msg_type == 2 then
-		if payload_len >= 25 then
+		if payload_len >= 33 then
 			offset = 0
-			length = 25
+			length = 33
 			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
 			subtree:add(f.type,        buffer(offset, 1)); offset = offset + 1
 			subtree:add(f.timestamp,   buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.echoed_ts,   buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.seq_nr,      buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_window,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_delay,   buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.frame_nr,    buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.frame_sent,  buffer(offset, 4)); offset = offset + 4
 			subtree:add(f.frame_size,  buffer(offset, 4)); offset = offset + 4
@@ -103,6 +134,78 @@ function udpprague_p.dissector(buffer, pinfo, tree)
 		-- Handover remaining part to data dissector
 		local data_buffer = buffer:range(offset, payload_len - length):tvb()
 		Dissector.get("data"):call(data_buffer, pinfo, tree)
+	elseif msg_type == 4 then
+		if payload_len >= 39 then
+			offset = 0
+			length = 39
+			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
+			subtree:add(f.type,        buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.timestamp,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.echoed_ts,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.seq_nr,      buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_window,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_delay,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.frame_nr,    buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.frame_sent,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.frame_size,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.fec_scheme,  buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.fec_block,   buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.fec_k,       buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.fec_m,       buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.fec_index,   buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.fec_blocks,  buffer(offset, 1)); offset = offset + 1
+		else
+			offset = 0
+			length = 0
+			--subtree:add_expert_info(PI_MALFORMED, PI_ERROR, "Invalid real-time FEC data length: " .. payload_len .. " bytes")
+		end
+		-- Handover remaining part to data dissector
+		local data_buffer = buffer:range(offset, payload_len - length):tvb()
+		Dissector.get("data"):call(data_buffer, pinfo, tree)
+	elseif msg_type == 5 then
+		if payload_len >= 30 then
+			offset = 0
+			length = 30
+			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
+			subtree:add(f.type,        buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.timestamp,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.echoed_ts,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.seq_nr,      buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_seq,     buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.pkt_rcvd,    buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.pkt_ce,      buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.pkt_lost,    buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.error_l4s,   buffer(offset, 1)); offset = offset + 1
+		else
+			offset = 0
+			length = 0
+			--subtree:add_expert_info(PI_MALFORMED, PI_ERROR, "Invalid bidirectional data length: " .. payload_len .. " bytes")
+		end
+		-- Handover remaining part to data dissector
+		local data_buffer = buffer:range(offset, payload_len - length):tvb()
+		Dissector.get("data"):call(data_buffer, pinfo, tree)
+	elseif msg_type == 3 then
+		if payload_len >= 37 then
+			offset = 0
+			length = 37
+			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
+			subtree:add(f.type,        buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.timestamp,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.echoed_ts,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.seq_nr,      buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_window,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.ack_delay,   buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.chunk,       buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.chunk_size,  buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.file_size,   buffer(offset, 8)); offset = offset + 8
+		else
+			offset = 0
+			length = 0
+			--subtree:add_expert_info(PI_MALFORMED, PI_ERROR, "Invalid file data length: " .. payload_len .. " bytes")
+		end
+		-- Handover remaining part to data dissector
+		local data_buffer = buffer:range(offset, payload_len - length):tvb()
+		Dissector.get("data"):call(data_buffer, pinfo, tree)
 	elseif msg_type == 17 then
 		if payload_len == 26 then
 			offset = 0
@@ -153,6 +256,42 @@ function udpprague_p.dissector(buffer, pinfo, tree)
 			local data_buffer = buffer:range(offset, payload_len - length):tvb()
 			Dissector.get("data"):call(data_buffer, pinfo, tree)
 		end
+	elseif msg_type == 19 then
+		if payload_len >= 10 then
+			offset = 0
+			length = payload_len
+			local subtree = tree:add(udpprague_p, buffer(offset, length), "UDP Prague Protocol")
+			subtree:add(f.type,        buffer(offset, 1)); offset = offset + 1
+			subtree:add(f.rle_seq,     buffer(offset, 4)); offset = offset + 4
+			subtree:add(f.rle_num,     buffer(offset, 2)); offset = offset + 2
+			local num_runs = buffer(offset, 2):uint()
+			subtree:add(f.rle_runs,    buffer(offset, 2)); offset = offset + 2
+			subtree:add(f.rle_shift,   buffer(offset, 1)); offset = offset + 1
+			for i = 1,num_runs,1 do
+				if offset + 2 > payload_len then break end
+				local hdr = buffer(offset, 2):uint()
+				local run_start = offset
+				offset = offset + 2
+				local v = 0
+				local mult = 1
+				if hdr >= 0x8000 then
+					repeat
+						local b = buffer(offset, 1):uint()
+						v = v + (b % 128) * mult
+						mult = mult * 128
+						offset = offset + 1
+					until b < 128 or offset >= payload_len
+				end
+				local subsubstree = subtree:add(f.rle_run, buffer(run_start, offset - run_start), hdr)
+				subsubstree:add(f.rle_run_rcv, buffer(run_start, 2))
+				subsubstree:add(f.rle_run_ecn, buffer(run_start, 2))
+				subsubstree:add(f.rle_run_len, buffer(run_start, 2))
+				if hdr >= 0x8000 then
+					local delta = (v % 2 == 0) and (v / 2) or (-(v + 1) / 2)
+					subsubstree:add(f.rle_run_ato, buffer(run_start + 2, offset - run_start - 2), delta)
+				end
+			end
+		end
 	end
 end
 
@@ -0,0 +1,75 @@
+// udp_prague_monitor.cpp:
+// An example of a monitoring process that reads the PragueCC state snapshots a sender publishes with --shm <name>,
+// without synchronizing with (or slowing down) the sender
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "prague_snapshot.h"
+
+static const char *cc_state_name(cs_tp state)
+{
+    switch (state) {
+    case cs_init:       return "init";
+    case cs_cong_avoid: return "cong_avoid";
+    case cs_in_loss:    return "in_loss";
+    case cs_in_cwr:     return "in_cwr";
+    }
+    return "?";
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = NULL;
+    uint32_t interval = 1000000;  // report interval in us
+    uint32_t count = 0;           // number of reports, 0 is unlimited
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc) {
+            interval = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = strtoul(argv[++i], NULL, 10);
+        } else if (arg[0] != '-' && !name) {
+            name = argv[i];
+        } else {
+            name = NULL;
+            break;
+        }
+    }
+    if (!name || !interval) {
+        printf("UDP Prague monitor usage:\n"
+               "    udp_prague_monitor <shared-memory name given to the sender with --shm> [options]\n"
+               "    -i <report interval, def: 1000000 us>\n"
+               "    -n <number of reports, def: 0 (unlimited)>\n");
+        exit(1);
+    }
+
+    SnapshotShm shm;
+    const prague_snapshot_t *snapshot = shm.Open(name);
+    PragueState state;
+    time_tp ts;
+    uint32_t prev_published = 0;
+    for (uint32_t n = 0; !count || n < count; n++) {
+        if (n)
+            std::this_thread::sleep_for(std::chrono::microseconds(interval));
+        uint32_t published = snapshot->published();
+        if (!snapshot->read(state, ts)) {
+            printf("[MONITOR]: no snapshot published yet\n");
+            continue;
+        }
+        printf("[MONITOR]: %.2f sec, Snapshots: %u, State: %s, Pacing rate: %.3f Mbps, Window: %d packets, "
+               "Packet size: %llu B, Alpha: %.3f, SRTT/Var: %.3f/%.3f ms, MinRTT: %.3f ms, QDelay: %.3f ms, "
+               "Sent: %d, Rcvd: %d, CE: %d, Lost: %d, L4S error: %d\n",
+               ts / 1000000.0f, published - prev_published, cc_state_name(state.m_cc_state),
+               8.0f * state.m_pacing_rate / 1000000.0, state.m_packet_window, (unsigned long long)state.m_packet_size,
+               state.m_alpha / 1048576.0, state.m_srtt / 1000.0f, state.m_rttvar / 1000.0f, state.m_min_rtt / 1000.0f,
+               state.m_qdelay / 1000.0f, state.m_packets_sent, state.m_packets_received, state.m_packets_CE,
+               state.m_packets_lost, state.m_error_L4S);
+        fflush(stdout);
+        prev_published = published;
+    }
+    return 0;
+}
@@ -0,0 +1,806 @@
+// udp_prague_pcap.cpp:
+// Offline analyzer of udp_prague traffic in pcap or pcapng captures. The capture file is memory-mapped and parsed in
+// one pass, and the packets are handed in batches to worker threads, each owning a share of the flows. Per flow and
+// report interval it reconstructs the throughput, the RTT seen from the capture point (data packet to the feedback
+// that reports it), the CE fraction, loss, reordering and, for frame-based senders, frame completion
+//
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "udpsocket.h"
+#include "mapped_file.h"
+#include "pkt_format.h"
+#include "hdr_histogram.h"
+#include "json_writer.h"
+
+#define PCAP_PORT     8080    // default UDP port of the flows (the default of the apps), 0 accepts any port
+#define PCAP_INTERVAL 1000000 // default report interval in us
+#define PCAP_BATCH    4096    // packets handed to a worker at once
+#define PCAP_QUEUE    64      // batches queued per worker before the parser waits
+
+// to avoid int64 printf incompatibility between platforms:
+#define C_STR(i) std::to_string(i).c_str()
+
+// both directions of a flow have the same key: the lower address (and port) first
+struct flow_key_t {
+    uint8_t addr[2][16];
+    uint16_t port[2];
+    uint8_t family;           // 4 or 6
+    uint8_t pad;
+
+    bool operator==(const flow_key_t &other) const { return memcmp(this, &other, sizeof(*this)) == 0; }
+    size_t hash() const
+    {
+        // FNV-1a
+        const uint8_t *b = reinterpret_cast<const uint8_t*>(this);
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < sizeof(*this); i++)
+            h = (h ^ b[i]) * 1099511628211ULL;
+        return size_t(h ^ (h >> 32));
+    }
+    std::string str(int side) const
+    {
+        char buf[INET6_ADDRSTRLEN + 8];
+        char addrstr[INET6_ADDRSTRLEN];
+        inet_ntop((family == 4) ? AF_INET : AF_INET6, (void*)addr[side], addrstr, sizeof(addrstr));
+        snprintf(buf, sizeof(buf), (family == 4) ? "%s:%u" : "[%s]:%u", addrstr, port[side]);
+        return buf;
+    }
+};
+struct flow_key_hash {
+    size_t operator()(const flow_key_t &k) const { return k.hash(); }
+};
+
+// a captured udp_prague packet, the payload points into the mapped capture file
+struct pkt_rec_t {
+    uint64_t ts;              // us since the first packet of the capture
+    const uint8_t *payload;   // captured part of the UDP payload
+    uint32_t caplen;          // captured payload bytes
+    uint32_t len;             // payload bytes on the wire
+    flow_key_t key;
+    uint8_t dir;              // sent from key.addr[dir]
+    uint8_t ecn;              // IP-ECN codepoint
+};
+
+// counters of a report interval (or of the whole flow)
+struct interval_t {
+    uint64_t start;           // us since the first packet of the capture
+    uint64_t data_pkts;
+    uint64_t data_bytes;
+    uint64_t fb_pkts;
+    uint64_t fb_bytes;
+    uint64_t ip_ce;           // data packets CE-marked at the capture point
+    uint64_t fb_rcvd;         // packets reported received, CE-marked and lost by the feedback
+    uint64_t fb_ce;
+    uint64_t fb_lost;
+    uint64_t seq_gaps;        // data packets missing at the capture point
+    uint64_t reordered;       // data packets captured after a later sent packet
+    uint64_t frames_done;     // frames captured completely
+    uint64_t frames_incomplete;
+    uint64_t rtt_count;
+    time_tp rtt_p50, rtt_p90, rtt_p99, rtt_max;
+    time_tp frame_p99;        // time between the first and the last packet of a completed frame
+
+    void add(const interval_t &o)
+    {
+        data_pkts += o.data_pkts; data_bytes += o.data_bytes; fb_pkts += o.fb_pkts; fb_bytes += o.fb_bytes;
+        ip_ce += o.ip_ce; fb_rcvd += o.fb_rcvd; fb_ce += o.fb_ce; fb_lost += o.fb_lost; seq_gaps += o.seq_gaps;
+        reordered += o.reordered; frames_done += o.frames_done; frames_incomplete += o.frames_incomplete;
+    }
+};
+
+struct seq_rec_t {
+    count_tp seq;             // 0 if the feedback for it was seen already
+    uint32_t ts;              // capture time in us (lower 32 bits)
+};
+
+struct flow_t {
+    flow_key_t key;
+    uint64_t first_ts;
+    uint64_t last_ts;
+    int sender;               // side of key.addr[] that sends the data, -1 if no data captured yet
+    uint8_t data_type;        // BULK_DATA_TYPE, RT_DATA_TYPE, FILE_DATA_TYPE or RT_FEC_TYPE, 0 if none
+    uint8_t fb_type;          // PKT_ACK_TYPE, RFC8888_ACK_TYPE or RLE_ACK_TYPE, 0 if none
+    interval_t cur;
+    interval_t total;
+    HdrHistogram rtt, frame_time, total_rtt, total_frame_time;
+    std::vector<interval_t> rows;
+    std::vector<seq_rec_t> sent; // capture time per data packet, to match with the feedback
+    bool any_seq;
+    count_tp max_seq;
+    bool any_ack;             // per-packet ACK counters of the previous ACK
+    count_tp prev_rcvd, prev_ce, prev_lost;
+    bool any_frame;           // frame being captured
+    bool frame_done;
+    count_tp frame_nr;
+    uint64_t frame_size, frame_seen, frame_ts;
+
+    flow_t(const flow_key_t &k, uint64_t ts):
+        key(k), first_ts(ts), last_ts(ts), sender(-1), data_type(0), fb_type(0), any_seq(false), max_seq(0),
+        any_ack(false), prev_rcvd(0), prev_ce(0), prev_lost(0), any_frame(false), frame_done(false), frame_nr(0),
+        frame_size(0), frame_seen(0), frame_ts(0)
+    {
+        memset(&cur, 0, sizeof(cur));
+        memset(&total, 0, sizeof(total));
+    }
+};
+
+class Worker {
+public:
+    Worker(uint64_t interval): m_interval(interval), m_stop(false) { m_thread = std::thread(&Worker::Run, this); }
+    ~Worker() { Finish(); }
+
+    // hand a batch of packets to the worker, waits if it is too far behind
+    void Push(std::vector<pkt_rec_t> &batch)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_space.wait(lock, [this] { return m_queue.size() < PCAP_QUEUE; });
+        m_queue.push_back(std::vector<pkt_rec_t>());
+        m_queue.back().swap(batch);
+        lock.unlock();
+        m_cv.notify_one();
+    }
+    // process the queued batches and close the last interval of the flows
+    void Finish()
+    {
+        if (!m_thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+        for (size_t i = 0; i < m_flows.size(); i++)
+            Close(*m_flows[i]);
+    }
+    std::vector<std::unique_ptr<flow_t>> &Flows() { return m_flows; }
+
+private:
+    void Run()
+    {
+        std::vector<pkt_rec_t> batch;
+        std::unique_lock<std::mutex> lock(m_mtx);
+        for (;;) {
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+            batch.swap(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+            m_space.notify_one();
+            flow_t *flow = NULL;
+            for (size_t i = 0; i < batch.size(); i++) {
+                const pkt_rec_t &r = batch[i];
+                if (!flow || !(flow->key == r.key))
+                    flow = Find(r);
+                Process(*flow, r);
+            }
+            batch.clear();
+            lock.lock();
+        }
+    }
+    flow_t *Find(const pkt_rec_t &r)
+    {
+        std::unordered_map<flow_key_t, flow_t*, flow_key_hash>::iterator it = m_index.find(r.key);
+        if (it != m_index.end())
+            return it->second;
+        m_flows.push_back(std::unique_ptr<flow_t>(new flow_t(r.key, r.ts)));
+        m_flows.back()->cur.start = r.ts - r.ts % m_interval;
+        m_index[r.key] = m_flows.back().get();
+        return m_flows.back().get();
+    }
+    // finish the current interval
+    void Close(flow_t &f)
+    {
+        interval_t &c = f.cur;
+        if (!c.data_pkts && !c.fb_pkts)
+            return;
+        c.rtt_count = f.rtt.Count();
+        c.rtt_p50 = f.rtt.Percentile(50);
+        c.rtt_p90 = f.rtt.Percentile(90);
+        c.rtt_p99 = f.rtt.Percentile(99);
+        c.rtt_max = f.rtt.Max();
+        c.frame_p99 = f.frame_time.Percentile(99);
+        f.rows.push_back(c);
+        f.total.add(c);
+        f.total_rtt.Add(f.rtt);
+        f.total_frame_time.Add(f.frame_time);
+        f.rtt.Reset();
+        f.frame_time.Reset();
+        memset(&c, 0, sizeof(c));
+    }
+    void Sent(flow_t &f, count_tp seq, uint64_t ts)
+    {
+        if (f.sent.empty())
+            f.sent.resize(PKT_BUFFER_SIZE);
+        seq_rec_t &s = f.sent[uint32_t(seq) % PKT_BUFFER_SIZE];
+        s.seq = seq;
+        s.ts = uint32_t(ts);
+        if (!f.any_seq) {
+            f.any_seq = true;
+            f.max_seq = seq;
+        } else if (seq - f.max_seq > 0) {
+            f.cur.seq_gaps += seq - f.max_seq - 1;
+            f.max_seq = seq;
+        } else {
+            f.cur.reordered++;
+        }
+    }
+    // RTT from the capture point for the first feedback on seq, minus the time the receiver held the report back
+    void Reported(flow_t &f, count_tp seq, uint64_t ts, time_tp held)
+    {
+        if (f.sent.empty() || !seq)
+            return;
+        seq_rec_t &s = f.sent[uint32_t(seq) % PKT_BUFFER_SIZE];
+        if (s.seq != seq)
+            return;
+        s.seq = 0;
+        f.rtt.Record(time_tp(uint32_t(ts) - s.ts) - held);
+    }
+    void Process(flow_t &f, const pkt_rec_t &r)
+    {
+        if (r.ts - f.cur.start >= m_interval) {
+            Close(f);
+            f.cur.start = r.ts - r.ts % m_interval;
+        }
+        f.last_ts = r.ts;
+        uint8_t type = r.payload[0];
+        if (type == BULK_DATA_TYPE || type == RT_DATA_TYPE || type == FILE_DATA_TYPE || type == RT_FEC_TYPE) {
+            if (f.sender < 0)
+                f.sender = r.dir;
+            f.data_type = type;
+            f.cur.data_pkts++;
+            f.cur.data_bytes += r.len;
+            f.cur.ip_ce += (r.ecn == ecn_ce);
+            if ((type == BULK_DATA_TYPE || type == FILE_DATA_TYPE) && r.caplen >= sizeof(datamessage_t)) {
+                // a file chunk header starts like the bulk data header
+                datamessage_t msg;
+                memcpy(&msg, r.payload, sizeof(msg));
+                msg.hton();
+                Sent(f, msg.seq_nr, r.ts);
+            } else if ((type == RT_DATA_TYPE || type == RT_FEC_TYPE) && r.caplen >= sizeof(framemessage_t)) {
+                // an FEC header starts like the frame header, its frame size includes the parity
+                framemessage_t msg;
+                memcpy(&msg, r.payload, sizeof(msg));
+                msg.hton();
+                Sent(f, msg.seq_nr, r.ts);
+                Frame(f, msg.frame_nr, msg.frame_size, r.len, r.ts);
+            }
+            return;
+        }
+        f.fb_type = type;
+        f.cur.fb_pkts++;
+        f.cur.fb_bytes += r.len;
+        if (type == PKT_ACK_TYPE && r.caplen >= sizeof(ackmessage_t)) {
+            ackmessage_t ack;
+            memcpy(&ack, r.payload, sizeof(ack));
+            ack.ack_seq = ntohl(ack.ack_seq);
+            ack.packets_received = ntohl(ack.packets_received);
+            ack.packets_CE = ntohl(ack.packets_CE);
+            ack.packets_lost = ntohl(ack.packets_lost);
+            if (f.any_ack) {
+                f.cur.fb_rcvd += count_tp(ack.packets_received - f.prev_rcvd);
+                f.cur.fb_ce += count_tp(ack.packets_CE - f.prev_ce);
+                f.cur.fb_lost += count_tp(ack.packets_lost - f.prev_lost);
+            }
+            f.any_ack = true;
+            f.prev_rcvd = ack.packets_received;
+            f.prev_ce = ack.packets_CE;
+            f.prev_lost = ack.packets_lost;
+            Reported(f, ack.ack_seq, r.ts, 0);
+        } else if (type == RFC8888_ACK_TYPE && r.caplen >= m_rfc8888.get_size(0)) {
+            uint32_t caplen = std::min(r.caplen, uint32_t(sizeof(m_rfc8888)));
+            memcpy(&m_rfc8888, r.payload, caplen);
+            count_tp seq = ntohl(m_rfc8888.begin_seq);
+            uint16_t num_reports = ntohs(m_rfc8888.num_reports);
+            if (m_rfc8888.get_size(num_reports) > caplen)
+                num_reports = uint16_t((caplen - m_rfc8888.get_size(0)) / sizeof(uint16_t));
+            for (uint16_t i = 0; i < num_reports; i++, seq++) {
+                uint16_t rpt = ntohs(m_rfc8888.report[i]);
+                if (!(rpt & 0x8000)) {
+                    f.cur.fb_lost++;
+                    continue;
+                }
+                f.cur.fb_rcvd++;
+                f.cur.fb_ce += ((rpt & 0x6000) >> 13 == ecn_ce);
+                Reported(f, seq, r.ts, time_tp(rpt & RFC8888_ATO_MASK) << 10);
+            }
+        } else if (type == RLE_ACK_TYPE && r.caplen >= m_rle.get_size(0)) {
+            uint32_t caplen = std::min(r.caplen, uint32_t(sizeof(m_rle)));
+            memcpy(&m_rle, r.payload, caplen);
+            if (m_rle.ato_shift > RLE_MAX_ATO_SHIFT)
+                return;  // malformed feedback, the ATOs cannot be decoded
+            count_tp seq = ntohl(m_rle.begin_seq);
+            uint16_t num_reports = ntohs(m_rle.num_reports);
+            uint16_t num_runs = ntohs(m_rle.num_runs);
+            uint16_t size = uint16_t(caplen - m_rle.get_size(0));
+            uint16_t pos = 0, hdr = 0, i = 0;
+            uint32_t len = 0;
+            time_tp ato = 0;
+            for (uint16_t run = 0; run < num_runs && i < num_reports; run++) {
+                if (!m_rle.get_run(pos, size, hdr, len, ato))
+                    break;  // malformed or truncated feedback
+                if (len > uint32_t(num_reports - i))
+                    len = num_reports - i;
+                i += uint16_t(len);
+                if (!(hdr & 0x8000)) {
+                    f.cur.fb_lost += len;
+                    seq += len;
+                    continue;
+                }
+                f.cur.fb_rcvd += len;
+                f.cur.fb_ce += ((hdr & 0x6000) >> 13 == ecn_ce) ? len : 0;
+                for (; len; len--, seq++)
+                    Reported(f, seq, r.ts, time_tp(uint32_t(ato) << m_rle.ato_shift));
+            }
+        }
+    }
+    // a frame is complete when all its bytes are captured, or incomplete when the next frame starts before that
+    void Frame(flow_t &f, count_tp frame_nr, count_tp frame_size, uint32_t len, uint64_t ts)
+    {
+        if (!f.any_frame || frame_nr - f.frame_nr > 0) {
+            if (f.any_frame && !f.frame_done)
+                f.cur.frames_incomplete++;
+            f.any_frame = true;
+            f.frame_done = false;
+            f.frame_nr = frame_nr;
+            f.frame_size = uint32_t(frame_size);
+            f.frame_seen = 0;
+            f.frame_ts = ts;
+        }
+        if (frame_nr != f.frame_nr || f.frame_done)
+            return;  // late packet of an earlier frame
+        f.frame_seen += len;
+        if (f.frame_seen >= f.frame_size) {
+            f.frame_done = true;
+            f.cur.frames_done++;
+            f.frame_time.Record(time_tp(ts - f.frame_ts));
+        }
+    }
+
+    uint64_t m_interval;
+    std::thread m_thread;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::condition_variable m_space;
+    std::deque<std::vector<pkt_rec_t>> m_queue;
+    bool m_stop;
+    std::vector<std::unique_ptr<flow_t>> m_flows;
+    std::unordered_map<flow_key_t, flow_t*, flow_key_hash> m_index;
+    rfc8888ack_t m_rfc8888;  // feedback copied out of the capture (unaligned, possibly truncated)
+    rleack_t m_rle;
+};
+
+// parses the link, IP and UDP headers and hands the udp_prague packets to the worker of their flow
+class Dispatcher {
+public:
+    Dispatcher(uint32_t threads, uint64_t interval, uint16_t port):
+        m_port(port), m_base(0), m_any(false), m_frames(0), m_packets(0), m_skipped(0), m_batches(threads)
+    {
+        for (uint32_t i = 0; i < threads; i++) {
+            m_workers.push_back(std::unique_ptr<Worker>(new Worker(interval)));
+            m_batches[i].reserve(PCAP_BATCH);
+        }
+    }
+    void Frame(uint32_t linktype, uint64_t ts, const uint8_t *p, uint32_t caplen)
+    {
+        m_frames++;
+        uint32_t off = 0;
+        uint16_t ethertype = 0;
+        switch (linktype) {
+        case 1:   // Ethernet
+            if (caplen < 14)
+                return Skip();
+            ethertype = be16(p + 12);
+            off = 14;
+            while ((ethertype == 0x8100 || ethertype == 0x88A8 || ethertype == 0x9100) && caplen >= off + 4) {
+                ethertype = be16(p + off + 2);  // VLAN tag
+                off += 4;
+            }
+            if (ethertype != 0x0800 && ethertype != 0x86DD)
+                return Skip();
+            break;
+        case 0:   // BSD loopback, the address family decides, but the IP version is enough
+        case 108:
+            off = 4;
+            break;
+        case 101: // raw IPv4 or IPv6
+        case 228:
+        case 229:
+            break;
+        case 113: // Linux cooked capture
+            if (caplen < 16 || (be16(p + 14) != 0x0800 && be16(p + 14) != 0x86DD))
+                return Skip();
+            off = 16;
+            break;
+        case 276: // Linux cooked capture v2
+            if (caplen < 20 || (be16(p) != 0x0800 && be16(p) != 0x86DD))
+                return Skip();
+            off = 20;
+            break;
+        default:
+            return Skip();
+        }
+        if (caplen < off + 1)
+            return Skip();
+        IP(ts, p + off, caplen - off);
+    }
+    // hand the last batches to the workers and wait for them
+    void Finish()
+    {
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            if (!m_batches[i].empty())
+                m_workers[i]->Push(m_batches[i]);
+            m_workers[i]->Finish();
+        }
+    }
+    std::vector<std::unique_ptr<Worker>> &Workers() { return m_workers; }
+    uint64_t Frames() const { return m_frames; }
+    uint64_t Packets() const { return m_packets; }
+    uint64_t Skipped() const { return m_skipped; }
+
+private:
+    static uint16_t be16(const uint8_t *p) { return uint16_t((p[0] << 8) | p[1]); }
+    void Skip() { m_skipped++; }
+    void IP(uint64_t ts, const uint8_t *p, uint32_t caplen)
+    {
+        pkt_rec_t r;
+        memset(&r.key, 0, sizeof(r.key));
+        const uint8_t *src, *dst;
+        uint32_t off;
+        if ((p[0] >> 4) == 4) {
+            if (caplen < 20)
+                return Skip();
+            off = (p[0] & 0x0F) * 4;
+            // not UDP, or a fragment
+            if (p[9] != IPPROTO_UDP || (be16(p + 6) & 0x3FFF) || off < 20)
+                return Skip();
+            r.ecn = p[1] & 0x3;
+            r.key.family = 4;
+            src = p + 12;
+            dst = p + 16;
+        } else if ((p[0] >> 4) == 6) {
+            if (caplen < 40)
+                return Skip();
+            uint8_t next = p[6];
+            off = 40;
+            // skip the hop-by-hop, routing and destination options extension headers (a fragment is not decoded)
+            while ((next == 0 || next == 43 || next == 60) && caplen >= off + 8) {
+                next = p[off];
+                off += (p[off + 1] + 1) * 8;
+            }
+            if (next != IPPROTO_UDP)
+                return Skip();
+            r.ecn = ((p[1] >> 4) & 0x3);
+            r.key.family = 6;
+            src = p + 8;
+            dst = p + 24;
+        } else {
+            return Skip();
+        }
+        if (caplen < off + 8)
+            return Skip();
+        const uint8_t *udp = p + off;
+        uint16_t sport = be16(udp), dport = be16(udp + 2), ulen = be16(udp + 4);
+        if (ulen <= 8 || (m_port && sport != m_port && dport != m_port))
+            return Skip();
+        r.payload = udp + 8;
+        r.len = ulen - 8u;
+        r.caplen = std::min(r.len, caplen - off - 8);
+        uint8_t type = r.caplen ? r.payload[0] : 0;
+        if (type != BULK_DATA_TYPE && type != RT_DATA_TYPE && type != FILE_DATA_TYPE && type != RT_FEC_TYPE &&
+            type != PKT_ACK_TYPE && type != RFC8888_ACK_TYPE && type != RLE_ACK_TYPE)
+            return Skip();
+        size_t alen = (r.key.family == 4) ? 4 : 16;
+        int cmp = memcmp(src, dst, alen);
+        r.dir = (cmp > 0 || (cmp == 0 && sport > dport)) ? 1 : 0;
+        memcpy(r.key.addr[r.dir], src, alen);
+        memcpy(r.key.addr[1 - r.dir], dst, alen);
+        r.key.port[r.dir] = sport;
+        r.key.port[1 - r.dir] = dport;
+        if (!m_any) {
+            m_any = true;
+            m_base = ts;
+        }
+        r.ts = (ts > m_base) ? ts - m_base : 0;
+        m_packets++;
+        size_t w = r.key.hash() % m_workers.size();
+        m_batches[w].push_back(r);
+        if (m_batches[w].size() >= PCAP_BATCH) {
+            m_workers[w]->Push(m_batches[w]);
+            m_batches[w].reserve(PCAP_BATCH);
+        }
+    }
+
+    uint16_t m_port;
+    uint64_t m_base;          // capture time of the first udp_prague packet
+    bool m_any;
+    uint64_t m_frames;
+    uint64_t m_packets;
+    uint64_t m_skipped;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::vector<pkt_rec_t>> m_batches;
+};
+
+static uint32_t rd32(const uint8_t *p, bool swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? ((v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24)) : v;
+}
+
+static uint16_t rd16(const uint8_t *p, bool swap)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? uint16_t((v >> 8) | (v << 8)) : v;
+}
+
+// classic pcap, microsecond or nanosecond timestamps in either byte order
+static bool parse_pcap(const uint8_t *p, size_t len, Dispatcher &d)
+{
+    uint32_t magic;
+    memcpy(&magic, p, 4);
+    bool swap = (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1);
+    bool nsec = (magic == 0xA1B23C4D || magic == 0x4D3CB2A1);
+    uint32_t linktype = rd32(p + 20, swap) & 0x0FFFFFFF;
+    size_t off = 24;
+    while (off + 16 <= len) {
+        uint64_t ts = uint64_t(rd32(p + off, swap)) * 1000000 + (nsec ? rd32(p + off + 4, swap) / 1000 : rd32(p + off + 4, swap));
+        uint32_t caplen = rd32(p + off + 8, swap);
+        off += 16;
+        if (caplen > len - off)
+            return false;  // truncated capture
+        d.Frame(linktype, ts, p + off, caplen);
+        off += caplen;
+    }
+    return true;
+}
+
+// pcapng: section headers (in either byte order), interface descriptions and (enhanced or simple) packet blocks
+static bool parse_pcapng(const uint8_t *p, size_t len, Dispatcher &d)
+{
+    struct interface_t {
+        uint32_t linktype;
+        uint64_t units;       // timestamp units per second
+    };
+    std::vector<interface_t> ifs;
+    bool swap = false;
+    uint64_t last_ts = 0;
+    size_t off = 0;
+    while (off + 12 <= len) {
+        uint32_t type = rd32(p + off, swap);
+        if (type == 0x0A0D0D0A) {
+            // a new section, possibly in the other byte order
+            uint32_t bom;
+            memcpy(&bom, p + off + 8, 4);
+            swap = (bom == 0x4D3C2B1A);
+            ifs.clear();
+        }
+        uint32_t blen = rd32(p + off + 4, swap);
+        if (blen < 12 || blen > len - off)
+            return false;  // truncated or corrupt capture
+        const uint8_t *b = p + off + 8;
+        uint32_t bodylen = blen - 12;
+        if (type == 0x00000001 && bodylen >= 8) {
+            interface_t ifc = {rd16(b, swap), 1000000};
+            // options: if_tsresol (9) is a power of 10, or of 2 if the high bit is set
+            for (uint32_t o = 8; o + 4 <= bodylen; ) {
+                uint16_t code = rd16(b + o, swap), olen = rd16(b + o + 2, swap);
+                if (code == 0)
+                    break;
+                if (code == 9 && olen >= 1 && o + 5 <= bodylen) {
+                    uint8_t res = b[o + 4];
+                    ifc.units = 1;
+                    for (uint8_t i = 0; i < (res & 0x7F) && i < 63; i++)
+                        ifc.units *= (res & 0x80) ? 2 : 10;
+                }
+                o += 4 + ((olen + 3) & ~3u);
+            }
+            ifs.push_back(ifc);
+        } else if (type == 0x00000006 && bodylen >= 20) {
+            uint32_t ifid = rd32(b, swap);
+            uint64_t raw = (uint64_t(rd32(b + 4, swap)) << 32) | rd32(b + 8, swap);
+            uint32_t caplen = rd32(b + 12, swap);
+            if (ifid < ifs.size() && caplen <= bodylen - 20) {
+                uint64_t units = ifs[ifid].units;
+                last_ts = (raw / units) * 1000000 + (raw % units) * 1000000 / units;
+                d.Frame(ifs[ifid].linktype, last_ts, b + 20, caplen);
+            }
+        } else if (type == 0x00000003 && bodylen >= 4 && !ifs.empty()) {
+            // simple packet block: no timestamp, the previous one is used
+            uint32_t caplen = std::min(rd32(b, swap), bodylen - 4);
+            d.Frame(ifs[0].linktype, last_ts, b + 4, caplen);
+        }
+        off += blen;
+    }
+    return true;
+}
+
+static void print_row(json_writer &jw, bool json, const char *tag, size_t id, const interval_t &r, uint64_t duration)
+{
+    float rate = 8.0f * r.data_bytes / (duration ? duration : 1);
+    float ce_pct = r.data_pkts ? 100.0f * r.ip_ce / r.data_pkts : 0.0f;
+    float mark_pct = r.fb_rcvd ? 100.0f * r.fb_ce / r.fb_rcvd : 0.0f;
+    float loss_pct = (r.fb_rcvd + r.fb_lost) ? 100.0f * r.fb_lost / (r.fb_rcvd + r.fb_lost) : 0.0f;
+    if (!json) {
+        printf("%s: %s, %.6f, %s, %.3f, %s, %s, %.3f, %.3f, %.3f, %.3f, %.2f, %.2f, %s, %.2f, %s, %s, %s, %s, %.3f\n",
+               tag, C_STR(id), r.start / 1000000.0, C_STR(r.data_pkts), rate, C_STR(r.fb_pkts), C_STR(r.rtt_count),
+               r.rtt_p50 / 1000.0f, r.rtt_p90 / 1000.0f, r.rtt_p99 / 1000.0f, r.rtt_max / 1000.0f, ce_pct, mark_pct,
+               C_STR(r.fb_lost), loss_pct, C_STR(r.seq_gaps), C_STR(r.reordered), C_STR(r.frames_done),
+               C_STR(r.frames_incomplete), r.frame_p99 / 1000.0f);
+        return;
+    }
+    jw.reset();
+    jw.field("type", std::string(tag));
+    jw.field("flow", uint64_t(id));
+    jw.field("time", r.start);
+    jw.field("duration", duration);
+    jw.field("data_pkts", r.data_pkts);
+    jw.field("data_bytes", r.data_bytes);
+    jw.field("data_rate", rate);
+    jw.field("fb_pkts", r.fb_pkts);
+    jw.field("fb_bytes", r.fb_bytes);
+    jw.field("rtt_count", r.rtt_count);
+    jw.field("rtt_p50", r.rtt_p50);
+    jw.field("rtt_p90", r.rtt_p90);
+    jw.field("rtt_p99", r.rtt_p99);
+    jw.field("rtt_max", r.rtt_max);
+    jw.field("ce_pct", ce_pct);
+    jw.field("mark_pct", mark_pct);
+    jw.field("fb_rcvd", r.fb_rcvd);
+    jw.field("fb_ce", r.fb_ce);
+    jw.field("fb_lost", r.fb_lost);
+    jw.field("loss_pct", loss_pct);
+    jw.field("seq_gaps", r.seq_gaps);
+    jw.field("reordered", r.reordered);
+    jw.field("frames_done", r.frames_done);
+    jw.field("frames_incomplete", r.frames_incomplete);
+    jw.field("frame_p99", r.frame_p99);
+    jw.finalize();
+    jw.dump(true);
+}
+
+static const char *fb_name(uint8_t type)
+{
+    switch (type) {
+    case PKT_ACK_TYPE:     return "ack";
+    case RFC8888_ACK_TYPE: return "rfc8888";
+    case RLE_ACK_TYPE:     return "rle";
+    }
+    return "none";
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    const char *json_file = NULL;
+    uint64_t interval = PCAP_INTERVAL;
+    uint32_t port = PCAP_PORT;
+    uint32_t threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "-i" && i + 1 < argc) {
+            interval = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "-p" && i + 1 < argc) {
+            port = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "-t" && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (arg[0] != '-' && !filename) {
+            filename = argv[i];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (!filename || !interval || port > 65535 || !threads) {
+        printf("UDP Prague capture analyzer usage:\n"
+               "    udp_prague_pcap <pcap or pcapng capture file> [options]\n"
+               "    -p <UDP port of the flows, 0 for any port, def: %d>\n"
+               "    -i <report interval, def: %d us>\n"
+               "    -t <worker threads, def: the number of CPUs>\n"
+               "    -j <json_filename, otherwise CSV lines on stdout>\n",
+               PCAP_PORT, PCAP_INTERVAL);
+        exit(1);
+    }
+    if (threads > 256)
+        threads = 256;
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    file.Open(filename);
+    const uint8_t *p = file.Data();
+    size_t len = file.Size();
+    uint32_t magic = 0;
+    if (len >= 4)
+        memcpy(&magic, p, 4);
+    Dispatcher d(threads, interval, uint16_t(port));
+    bool complete;
+    if (len >= 24 && (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 || magic == 0xA1B23C4D || magic == 0x4D3CB2A1)) {
+        complete = parse_pcap(p, len, d);
+    } else if (len >= 28 && magic == 0x0A0D0D0A) {
+        complete = parse_pcapng(p, len, d);
+    } else {
+        fprintf(stderr, "%s is not a pcap or pcapng capture\n", filename);
+        exit(1);
+    }
+    d.Finish();
+    if (!complete)
+        fprintf(stderr, "The capture is truncated or corrupt, the analysis stopped at the last complete packet\n");
+
+    // the flows in the order they were first captured
+    std::vector<flow_t*> flows;
+    for (size_t i = 0; i < d.Workers().size(); i++)
+        for (size_t j = 0; j < d.Workers()[i]->Flows().size(); j++)
+            flows.push_back(d.Workers()[i]->Flows()[j].get());
+    std::sort(flows.begin(), flows.end(), [](const flow_t *a, const flow_t *b) {
+        return (a->first_ts != b->first_ts) ? a->first_ts < b->first_ts : memcmp(&a->key, &b->key, sizeof(a->key)) < 0;
+    });
+
+    json_writer jw;
+    bool json = (json_file != NULL);
+    if (json && jw.init(json_file, false) != 0) {
+        perror("Error opening json file");
+        exit(1);
+    }
+    if (!json) {
+        printf("flow: id, sender, receiver, data, feedback\n");
+        printf("i: id, time, data_pkts, data_rate, fb_pkts, rtt_samples, rtt_p50, rtt_p90, rtt_p99, rtt_max, ce_pct, "
+               "mark_pct, fb_lost, loss_pct, seq_gaps, reordered, frames_done, frames_incomplete, frame_p99\n");
+        printf("total: id, time, (the same as i:)\n");
+    }
+    for (size_t id = 1; id <= flows.size(); id++) {
+        flow_t &f = *flows[id - 1];
+        int snd = (f.sender < 0) ? 0 : f.sender;
+        const char *data = (f.data_type == RT_DATA_TYPE) ? "rt" : (f.data_type == BULK_DATA_TYPE) ? "bulk" :
+                           (f.data_type == FILE_DATA_TYPE) ? "file" :
+                           (f.data_type == RT_FEC_TYPE) ? "rt-fec" : "none";
+        if (!json) {
+            printf("flow: %s, %s, %s, %s, %s\n", C_STR(id), f.key.str(snd).c_str(), f.key.str(1 - snd).c_str(), data,
+                   fb_name(f.fb_type));
+        } else {
+            jw.reset();
+            jw.field("type", std::string("flow"));
+            jw.field("flow", uint64_t(id));
+            jw.field("sender", f.key.str(snd));
+            jw.field("receiver", f.key.str(1 - snd));
+            jw.field("data", std::string(data));
+            jw.field("feedback", std::string(fb_name(f.fb_type)));
+            jw.finalize();
+            jw.dump(true);
+        }
+        for (size_t i = 0; i < f.rows.size(); i++)
+            print_row(jw, json, "i", id, f.rows[i], interval);
+        interval_t &t = f.total;
+        t.start = f.first_ts;
+        t.rtt_count = f.total_rtt.Count();
+        t.rtt_p50 = f.total_rtt.Percentile(50);
+        t.rtt_p90 = f.total_rtt.Percentile(90);
+        t.rtt_p99 = f.total_rtt.Percentile(99);
+        t.rtt_max = f.total_rtt.Max();
+        t.frame_p99 = f.total_frame_time.Percentile(99);
+        print_row(jw, json, "total", id, t, f.last_ts - f.first_ts);
+    }
+    jw.close();
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%s frames, %s udp_prague packets in %s flows, %s skipped, %.3f s (%.1f MB/s) with %u threads\n",
+            C_STR(d.Frames()), C_STR(d.Packets()), C_STR(flows.size()), C_STR(d.Skipped()), secs,
+            len / 1e6 / (secs > 0 ? secs : 1), threads);
+    return 0;
+}
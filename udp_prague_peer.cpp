@@ -0,0 +1,303 @@
+// udp_prague_peer.cpp:
+// A bidirectional (dummy data) endpoint: two peers send congestion-controlled data to each other, and each data packet
+// carries the ACK of the data received from the other (bidimessage_t). One PragueCC object serves both directions:
+// it paces the own data, and counts the received data for the ACKs. A separate ACK (ackmessage_t) is only sent when
+// no own data is due within the ACK hold time. Prints the rates in both directions, the packets sent and how many of
+// them were separate ACKs every second.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include "udpsocket.h"
+#include "pkt_format.h"
+
+#define BIDI_ACK_HOLD 1000    // default time in us an ACK waits for own data to piggyback on
+
+static volatile sig_atomic_t stop = 0;
+
+static void stop_handler(int)
+{
+    stop = 1;
+}
+
+static uint64_t parse_uint(const char *arg, uint64_t max, const char *what)
+{
+    char *p;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &p, 10);
+    if (errno != 0 || p == arg || *p != '\0' || *arg == '-' || v > max) {
+        fprintf(stderr, "Error during converting %s: %s\n", what, arg);
+        exit(1);
+    }
+    return uint64_t(v);
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = NULL;
+    uint16_t port = 8080;
+    bool connect = false;
+    size_tp max_pkt = PRAGUE_INITMTU;
+    rate_tp max_rate = PRAGUE_MAXRATE;
+    time_tp ack_hold = BIDI_ACK_HOLD;
+    bool piggyback = true;
+    bool quiet = false;
+    bool usage = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-a" && i + 1 < argc) {
+            addr = argv[++i];
+        } else if (arg == "-p" && i + 1 < argc) {
+            port = uint16_t(parse_uint(argv[++i], 65535, "port"));
+        } else if (arg == "-c") {
+            connect = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            max_pkt = size_tp(parse_uint(argv[++i], BUFFER_SIZE, "max packet size"));
+        } else if (arg == "-b" && i + 1 < argc) {
+            max_rate = rate_tp(parse_uint(argv[++i], PRAGUE_MAXRATE / 125, "max bitrate")) * 125;
+        } else if (arg == "-d" && i + 1 < argc) {
+            ack_hold = time_tp(parse_uint(argv[++i], 0x7FFFFFFF, "ACK hold time"));
+        } else if (arg == "--nopiggyback") {
+            piggyback = false;
+        } else if (arg == "-q") {
+            quiet = true;
+        } else {
+            usage = true;
+            break;
+        }
+    }
+    if (usage || max_pkt < PRAGUE_MINMTU || max_pkt > BUFFER_SIZE || max_rate < PRAGUE_MINRATE ||
+        max_rate > PRAGUE_MAXRATE || ack_hold < 0) {
+        printf("UDP Prague peer usage:\n"
+               "    -a <IP address, def: 0.0.0.0 or 127.0.0.1 if client>\n"
+               "    -p <port, def: 8080>\n"
+               "    -c (connect first as a client, otherwise bind and wait for the peer)\n"
+               "    -m <max packet size, def: %s B>\n"
+               "    -b <max bitrate of the own data, def: %s kbps>\n"
+               "    -d <time an ACK waits for own data to piggyback on, def: %s us>\n"
+               "    --nopiggyback (send every ACK separately, for comparison)\n"
+               "    -q (quiet)\n",
+               std::to_string(PRAGUE_INITMTU).c_str(), std::to_string(PRAGUE_MAXRATE / 125).c_str(),
+               std::to_string(BIDI_ACK_HOLD).c_str());
+        exit(1);
+    }
+    if (!addr)
+        addr = connect ? "127.0.0.1" : "0.0.0.0";
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    UDPSocket us;
+    if (connect)
+        us.Connect(addr, port);
+    else
+        us.Bind(addr, port);
+
+    char receivebuffer[BUFFER_SIZE];
+    char payload[BUFFER_SIZE] = {0};  // dummy data
+    struct bidimessage_t& rcv_msg = (struct bidimessage_t&)(receivebuffer);  // overlaying the receive buffer
+    struct ackmessage_t& rcv_ack = (struct ackmessage_t&)(receivebuffer);   // overlaying the receive buffer
+    struct bidimessage_t bidi_msg;   // the send buffers
+    struct ackmessage_t ack_msg;
+
+    PragueCC pragueCC(max_pkt, 0, 0, PRAGUE_INITRATE, PRAGUE_INITWIN, PRAGUE_MINRATE, max_rate);
+    time_tp now = pragueCC.Now();
+    ecn_tp new_ecn;
+    ecn_tp rcv_ecn;
+    rate_tp pacing_rate;
+    count_tp packet_window;
+    count_tp packet_burst;
+    size_tp packet_size;
+    pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
+
+    // sending state
+    time_tp nextSend = now;     // time to send the next burst
+    count_tp seqnr = 0;         // sequence number of the last sent data packet
+    count_tp inflight = 0;      // own data packets in flight
+    count_tp num_timeout = 0;   // consecutive timeouts without feedback
+    bool probe = false;         // send a probe packet beyond the window after a probe timeout
+    time_tp timeoutStart = now; // time of the last packet sent or feedback received
+    time_tp ackTimeout = 0;
+    // ACK state of the received data
+    count_tp ack_seq = 0;       // sequence number of the latest received data packet
+    count_tp ack_pending = 0;   // data packets received since the last ACK (piggybacked or not)
+    time_tp ack_deadline = 0;   // time the pending packets must be ACKed
+    count_tp acked_lost = 0;    // lost counter echoed in the last ACK
+    bool last_ce = false;       // CE state of the previous data packet
+    bool started = connect;     // a peer that waits starts sending when the other one is heard
+
+    // report counters
+    time_tp start = now;
+    time_tp rept = now + 1000000;
+    uint64_t bytes_sent = 0, bytes_rcvd = 0;
+    count_tp data_sent = 0, acks_sent = 0, piggybacked = 0, data_rcvd = 0, acks_rcvd = 0;
+    uint64_t rept_sent = 0, rept_rcvd = 0;
+    count_tp rept_pkts = 0, rept_acks = 0;
+
+    if (connect) {
+        // announce ourselves with an ACK of nothing
+        pragueCC.GetTimeInfo(ack_msg.timestamp, ack_msg.echoed_timestamp, new_ecn);
+        pragueCC.GetACKInfo(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S);
+        ack_msg.ack_seq = 0;
+        ack_msg.set_stat();
+        if (us.Send((char*)(&ack_msg), sizeof(ack_msg), new_ecn) != sizeof(ack_msg)) {
+            perror("Invalid ack packet length sent");
+            exit(1);
+        }
+        acks_sent++;
+    }
+
+    while (!stop) {
+        now = pragueCC.Now();
+        // send the next burst of data, each packet carrying the ACK of the data received so far
+        count_tp inburst = 0;
+        time_tp startSend = 0;
+        while (started && (inflight < packet_window || probe) && (inburst < packet_burst) && (nextSend - now <= 0)) {
+            pragueCC.GetTimeInfo(bidi_msg.timestamp, bidi_msg.echoed_timestamp, new_ecn);
+            pragueCC.GetACKInfo(bidi_msg.packets_received, bidi_msg.packets_CE, bidi_msg.packets_lost, bidi_msg.error_L4S);
+            if (!startSend)
+                startSend = now;
+            bidi_msg.seq_nr = ++seqnr;
+            bidi_msg.ack_seq = ack_seq;
+            if (piggyback && ack_pending) {
+                piggybacked++;
+                acked_lost = bidi_msg.packets_lost;
+                ack_pending = 0;
+            }
+            bidi_msg.hton();
+            if (us.Send((char*)(&bidi_msg), sizeof(bidi_msg), payload, packet_size - sizeof(bidi_msg), new_ecn) != packet_size) {
+                perror("Invalid data packet length sent");
+                exit(1);
+            }
+            bytes_sent += packet_size;
+            data_sent++;
+            timeoutStart = now;
+            probe = false;
+            inburst++;
+            inflight++;
+        }
+        if (startSend)
+            nextSend = time_tp(startSend + packet_size * inburst * 1000000 / pacing_rate);
+
+        // a separate ACK only when no own data can carry it within the hold time
+        bool data_due = piggyback && started && (inflight < packet_window) && (nextSend - now <= ack_hold);
+        if (ack_pending && (!data_due || ack_deadline - now <= 0)) {
+            pragueCC.GetTimeInfo(ack_msg.timestamp, ack_msg.echoed_timestamp, new_ecn);
+            pragueCC.GetACKInfo(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S);
+            ack_msg.ack_seq = ack_seq;
+            acked_lost = ack_msg.packets_lost;
+            ack_pending = 0;
+            ack_msg.set_stat();
+            if (us.Send((char*)(&ack_msg), sizeof(ack_msg), new_ecn) != sizeof(ack_msg)) {
+                perror("Invalid ack packet length sent");
+                exit(1);
+            }
+            bytes_sent += sizeof(ack_msg);
+            acks_sent++;
+        }
+
+        // wait for the next burst, the pending ACK, or feedback up to the timeout when window-limited
+        pragueCC.GetTimeoutInfo(ackTimeout, num_timeout);
+        bool fb_limited = inflight >= packet_window;
+        time_tp waitTimeout = fb_limited ? timeoutStart + ackTimeout : nextSend;
+        if (ack_pending && ack_deadline - waitTimeout < 0)
+            waitTimeout = ack_deadline;
+        if (rept - waitTimeout < 0)
+            waitTimeout = rept;
+        size_tp bytes_received;
+        if (started)
+            bytes_received = us.ReceiveUntil(receivebuffer, sizeof(receivebuffer), rcv_ecn, waitTimeout, now);
+        else
+            bytes_received = us.Receive(receivebuffer, sizeof(receivebuffer), rcv_ecn, 1000000);
+        now = pragueCC.Now();
+
+        bool is_data = (receivebuffer[0] == BIDI_DATA_TYPE && bytes_received >= sizeof(rcv_msg));
+        bool is_ack = (receivebuffer[0] == PKT_ACK_TYPE && bytes_received >= sizeof(rcv_ack));
+        if (bytes_received != 0 && (is_data || is_ack)) {
+            // the timing and ACK fields are the same in both
+            time_tp timestamp, echoed_timestamp;
+            count_tp packets_received, packets_CE, packets_lost;
+            bool error_L4S;
+            if (is_data) {
+                rcv_msg.hton();  // swap byte order
+                timestamp = rcv_msg.timestamp;
+                echoed_timestamp = rcv_msg.echoed_timestamp;
+                packets_received = rcv_msg.packets_received;
+                packets_CE = rcv_msg.packets_CE;
+                packets_lost = rcv_msg.packets_lost;
+                error_L4S = rcv_msg.error_L4S;
+            } else {
+                rcv_ack.set_stat();  // swap byte order
+                timestamp = rcv_ack.timestamp;
+                echoed_timestamp = rcv_ack.echoed_timestamp;
+                packets_received = rcv_ack.packets_received;
+                packets_CE = rcv_ack.packets_CE;
+                packets_lost = rcv_ack.packets_lost;
+                error_L4S = rcv_ack.error_L4S;
+                acks_rcvd++;
+            }
+            bytes_rcvd += bytes_received;
+            started = true;
+            pragueCC.PacketReceived(timestamp, echoed_timestamp);
+            if (pragueCC.ACKReceived(packets_received, packets_CE, packets_lost, seqnr, error_L4S, inflight)) {
+                num_timeout = 0;
+                probe = false;
+                timeoutStart = now;
+            }
+            pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
+            if (is_data) {
+                pragueCC.DataReceivedSequence(rcv_ecn, rcv_msg.seq_nr);
+                data_rcvd++;
+                // hold the ACK for own data, but ACK without delay on a CE transition or a loss (or reordering) change
+                bool is_ce = ((rcv_ecn & ecn_ce) == ecn_ce);
+                count_tp lost;
+                pragueCC.GetACKInfo(packets_received, packets_CE, lost, error_L4S);
+                if (!ack_pending++)
+                    ack_deadline = now + ack_hold;
+                if ((is_ce != last_ce) || (lost != acked_lost))
+                    ack_deadline = now;
+                last_ce = is_ce;
+                ack_seq = rcv_msg.seq_nr;
+            }
+        } else if (bytes_received == 0 && started && fb_limited && now - (timeoutStart + ackTimeout) >= 0) {
+            if (!num_timeout) {
+                // probe timeout: send a probe packet beyond the window first
+                probe = true;
+            } else {
+                // retransmission timeout: the probe was not answered either
+                pragueCC.ResetCCInfo();
+                inflight = 0;
+                pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
+            }
+            nextSend = now;
+            timeoutStart = now;
+            num_timeout++;
+        }
+
+        if (now - rept >= 0) {
+            if (!quiet && started) {
+                const PragueState *st = pragueCC.GetStatePtr();
+                count_tp pkts = data_sent + acks_sent - rept_pkts;
+                printf("[PEER]: %.2f sec, Sent: %.3f Mbps, Rcvd: %.3f Mbps, Pacing rate: %.3f Mbps, Window: %d, "
+                       "InFlight: %d, SRTT: %.3f ms, Packets sent: %d, of which ACKs: %d (%.2f%%)\n",
+                       (now - start) / 1000000.0, (bytes_sent - rept_sent) * 8 / 1000000.0,
+                       (bytes_rcvd - rept_rcvd) * 8 / 1000000.0, st->m_pacing_rate * 8 / 1000000.0,
+                       st->m_packet_window, inflight, st->m_srtt / 1000.0, pkts, acks_sent - rept_acks,
+                       pkts ? (acks_sent - rept_acks) * 100.0 / pkts : 0.0);
+                fflush(stdout);
+            }
+            rept += 1000000;
+            rept_sent = bytes_sent;
+            rept_rcvd = bytes_rcvd;
+            rept_pkts = data_sent + acks_sent;
+            rept_acks = acks_sent;
+        }
+    }
+    if (!quiet)
+        printf("[PEER SUMMARY]: %.2f sec, sent %d data packets (%d replacing a separate ACK) and %d separate ACKs, "
+               "received %d data packets and %d separate ACKs\n", (pragueCC.Now() - start) / 1000000.0,
+               data_sent, piggybacked, acks_sent, data_rcvd, acks_rcvd);
+    return 0;
+}
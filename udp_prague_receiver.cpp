@@ -6,6 +6,9 @@
 #include "udpsocket.h"
 #include "app_stuff.h"
 #include "pkt_format.h"
+#include "file_transfer.h"
+#include "fec.h"
+#include "frame_deadline.h"
 
 int main(int argc, char **argv)
 {
@@ -18,9 +21,12 @@ int main(int argc, char **argv)
     else
         us.Bind(app.rcv_addr, (uint16_t)app.rcv_port);
 
-    char receivebuffer[BUFFER_SIZE];
+    char receivebuffer[MAX_DGRAM_SIZE];  // data packets can be larger than BUFFER_SIZE (sender -m)
 
     struct datamessage_t& data_msg = (struct datamessage_t&)(receivebuffer);  // overlaying the receive buffer
+    struct filemessage_t& file_msg = (struct filemessage_t&)(receivebuffer);  // overlaying the receive buffer (same begin as data)
+    struct framemessage_t& frame_msg = (struct framemessage_t&)(receivebuffer);  // overlaying the receive buffer (same begin as data)
+    struct fecmessage_t& fec_msg = (struct fecmessage_t&)(receivebuffer);  // overlaying the receive buffer (same begin as data)
     struct ackmessage_t ack_msg;     // the send buffer
 
     // create a PragueCC object. No parameters needed if only ACKs are sent
@@ -32,13 +38,45 @@ int main(int argc, char **argv)
     struct rfc8888ack_t rfc8888_ackmsg;
     count_tp start_seq = 0, end_seq = 0;
     time_tp rfc8888_acktime = now + app.rfc8888_ackperiod;
-    time_tp recvtime[PKT_BUFFER_SIZE] = {0};
-    ecn_tp recvecn[PKT_BUFFER_SIZE] = {ecn_not_ect};
-    pktrecv_tp recvseq[PKT_BUFFER_SIZE] = {rcv_init};
+    time_tp rfc8888_period = app.rfc8888_ackperiod;  // feedback period, adapted to the sender's request (if any)
+    count_tp rfc8888_window = 0;                     // send feedback as soon as this number of reports is pending
+    RecvScoreboard recvboard;                        // per packet arrival time, ECN and feedback state
+    // ACK thinning state, the ACK frequency is requested in-band by the sender
+    count_tp ack_seq = 0;          // sequence number of the latest received data packet
+    count_tp ack_pending = 0;      // packets received since the last ACK
+    time_tp ack_deadline = 0;      // time the pending packets must be ACKed
+    count_tp acked_lost = 0;       // lost counter echoed in the last ACK
+    bool last_ce = false;          // CE state of the previous data packet
+    // with --file the chunks of a file transfer are written in place to this file
+    FileReceiver file;
+    if (app.file_name)
+        file.Init(app.file_name);
+    // RT frames with FEC are repaired before they count as lost
+    FecReceiver fec;
+    // with --deadline the RT frames are released when complete, or skipped when their deadline passes first
+    FramePlayout playout;
+    playout.Init(app.rt_deadline, app.rt_fps ? 1000000 / app.rt_fps : 0);
     if (app.rfc8888_ack && app.max_pkt < rfc8888_ackmsg.get_size(1)) {
         perror("Reset maximum ACK size\n");
         app.max_pkt = rfc8888_ackmsg.get_size(1);
     }
+    if (app.rfc8888_ack && app.max_pkt > rfc8888_ackmsg.get_size(REPORT_SIZE)) {
+        perror("Reset maximum ACK size\n");
+        app.max_pkt = rfc8888_ackmsg.get_size(REPORT_SIZE);
+    }
+    count_tp rfc8888_maxrpts = count_tp((app.max_pkt - rfc8888_ackmsg.get_size(0)) / sizeof(uint16_t));  // reports per feedback packet
+
+    // Run-length compressed RFC8888 buffer
+    struct rleack_t rle_ackmsg;
+    count_tp rle_rcvd, rle_mark, rle_lost;
+    rate_tp rle_ato_sum;
+    if (app.rle_ack) {
+        app.max_pkt = (app.max_pkt > sizeof(rle_ackmsg)) ? sizeof(rle_ackmsg) : app.max_pkt;
+        if (app.max_pkt < rle_ackmsg.get_size(RLE_MAX_RUN_SIZE))
+            app.max_pkt = rle_ackmsg.get_size(RLE_MAX_RUN_SIZE);
+        rfc8888_maxrpts = REPORT_SIZE;  // runs of similar reports fit many more reports per feedback packet
+    }
+    rfc8888_window = rfc8888_maxrpts;
 
     if (app.connect) { // send a trigger ACK packet, otherwise just wait for data
         pragueCC.GetTimeInfo(ack_msg.timestamp, ack_msg.echoed_timestamp, new_ecn);
@@ -47,29 +85,72 @@ int main(int argc, char **argv)
         app.ExitIf(us.Send((char*)(&ack_msg), sizeof(ack_msg), new_ecn) != sizeof(ack_msg), "Invalid ack packet length sent.\n");
     }
 
-    while (true) {
+    while (!app.Stopped()) {
         now = pragueCC.Now();
 
         // Wait for an incoming data message
         ecn_tp rcv_ecn = ecn_not_ect;
         size_tp bytes_received = 0;
         time_tp waitTime = (app.rfc8888_ack && start_seq != end_seq) ? ((rfc8888_acktime - now > 0) ? (rfc8888_acktime - now) : 1) : 0;
+        if (!app.rfc8888_ack && ack_pending)
+            waitTime = (ack_deadline - now > 0) ? (ack_deadline - now) : 1;
+        if (waitTime == 0 && file.Complete())
+            waitTime = FILE_LINGER;  // the sender can still retransmit chunks of which it missed the feedback
+        if (app.rt_deadline && playout.Stats().frames) {
+            time_tp expire = (playout.NextDeadline() - now > 0) ? (playout.NextDeadline() - now) : 1;
+            if (waitTime == 0 || expire < waitTime)
+                waitTime = expire;
+        }
 
         do {   // repeat if timeout or interrupted
             bytes_received = us.Receive(receivebuffer, sizeof(receivebuffer), rcv_ecn, waitTime);
-        } while(bytes_received == 0 && waitTime == 0);
+        } while(bytes_received == 0 && waitTime == 0 && !app.Stopped());
+        if (app.rt_deadline)
+            playout.Expire(pragueCC.Now());
+        if (bytes_received == 0 && file.Complete() && pragueCC.Now() - file.LastData() >= FILE_LINGER)
+            break;  // file transfer finished
 
         if (bytes_received != 0) {
             // Extract the data message
             now = pragueCC.Now();
-            data_msg.hton();  // swap byte order
+            bool is_file = (receivebuffer[0] == FILE_DATA_TYPE && bytes_received >= sizeof(file_msg));
+            bool is_fec = (receivebuffer[0] == RT_FEC_TYPE && bytes_received >= sizeof(fec_msg));
+            bool is_frame = (receivebuffer[0] == RT_DATA_TYPE && bytes_received >= sizeof(frame_msg));
+            if (is_file)
+                file_msg.hton();  // swap byte order
+            else if (is_fec)
+                fec_msg.hton();  // swap byte order
+            else if (is_frame)
+                frame_msg.hton();  // swap byte order
+            else
+                data_msg.hton();  // swap byte order
+            if (is_fec)
+                fec.Received(fec_msg.frame_nr, fec_msg.fec_scheme, fec_msg.fec_block, fec_msg.fec_k, fec_msg.fec_m,
+                             fec_msg.fec_index, receivebuffer + sizeof(fec_msg), bytes_received - sizeof(fec_msg));
+            // the min one-way delay from half our min RTT, if the sender echoes our timestamps (not with RFC8888)
+            if ((is_frame || is_fec) && app.rt_deadline)
+                playout.Received(frame_msg.frame_nr, frame_msg.frame_size, bytes_received, frame_msg.timestamp, now,
+                                 pragueCC.GetStatePtr()->m_min_rtt_valid ? pragueCC.GetStatePtr()->m_min_rtt / 2 : 0,
+                                 is_fec && fec.Complete(fec_msg.frame_nr, fec_msg.fec_blocks));
+            if (is_file && app.file_name)
+                app.ExitIf(!file.Received(file_msg, receivebuffer + sizeof(file_msg), bytes_received - sizeof(file_msg), now),
+                           file.Error());
             app.LogRecvData(now, data_msg.timestamp, data_msg.echoed_timestamp, data_msg.seq_nr, bytes_received);
 
             if (app.rfc8888_ack) {
-                uint16_t seq_idx = data_msg.seq_nr % PKT_BUFFER_SIZE;
+                if (data_msg.ack_delay > 0) {
+                    // adapt the period and reports per feedback to the sender's rate and RTT, bounded by the feedback packet size
+                    rfc8888_period = data_msg.ack_delay;
+                    rfc8888_window = (data_msg.ack_window < rfc8888_maxrpts) ? data_msg.ack_window : rfc8888_maxrpts;
+                } else {
+                    // the sender no longer asks for a period, back to the configured one
+                    rfc8888_period = app.rfc8888_ackperiod;
+                    rfc8888_window = rfc8888_maxrpts;
+                }
                 if (start_seq == end_seq) {
                     start_seq = data_msg.seq_nr;
                     end_seq = data_msg.seq_nr + 1;
+                    rfc8888_acktime = now + rfc8888_period;  // first report pending, start the feedback timer
                 } else {
                     // [start_seq, end_seq) data will be ACKed
                     if (start_seq - data_msg.seq_nr <= 0 && start_seq + PKT_BUFFER_SIZE - data_msg.seq_nr > 0 && data_msg.seq_nr + 1 - end_seq > 0) {
@@ -78,41 +159,77 @@ int main(int argc, char **argv)
                       start_seq = data_msg.seq_nr;
                     }
                 }
-                if (!(recvseq[seq_idx] == rcv_recv)) {
-                    recvtime[seq_idx] = now;
-                    recvecn[seq_idx] = ecn_tp(rcv_ecn & ecn_ce);
-                    recvseq[seq_idx] = rcv_recv;
-                } else {
-                    recvecn[seq_idx] = (rcv_ecn == ecn_ce) ? ecn_ce : recvecn[seq_idx];
-                }
+                recvboard.Received(data_msg.seq_nr, now, rcv_ecn);
+                if (end_seq - start_seq >= rfc8888_window)
+                    rfc8888_acktime = now;  // a full feedback packet is pending
+                else if (rfc8888_acktime - (now + rfc8888_period) > 0)
+                    rfc8888_acktime = now + rfc8888_period;  // a shorter period is requested
             }
 
             // Pass the relevant data to the PragueCC object:
             pragueCC.PacketReceived(data_msg.timestamp, data_msg.echoed_timestamp);
             pragueCC.DataReceivedSequence(rcv_ecn, data_msg.seq_nr);
+
+            if (!app.rfc8888_ack) {
+                // Hold back the ACK if requested, but ACK immediately on a CE transition or a loss (or reordering) change
+                bool is_ce = ((rcv_ecn & ecn_ce) == ecn_ce);
+                ack_pending++;
+                if (ack_pending == 1)
+                    ack_deadline = now + data_msg.ack_delay;
+                pragueCC.GetACKInfo(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S);
+                if ((ack_pending >= data_msg.ack_window) || (is_ce != last_ce) || (ack_msg.packets_lost != acked_lost))
+                    ack_deadline = now;
+                last_ce = is_ce;
+                ack_seq = data_msg.seq_nr;
+            }
         }
 
         now = pragueCC.Now();
         if (!app.rfc8888_ack) {
+            if (!ack_pending || (ack_deadline - now > 0))
+                continue;
             // Return a corresponding acknowledge message
-            ack_msg.ack_seq = data_msg.seq_nr;
+            ack_msg.ack_seq = ack_seq;
             pragueCC.GetTimeInfo(ack_msg.timestamp, ack_msg.echoed_timestamp, new_ecn);
             pragueCC.GetACKInfo(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S);
 
-            app.LogSendACK(now, ack_msg.timestamp, ack_msg.echoed_timestamp, data_msg.seq_nr, sizeof(ack_msg),
+            app.LogSendACK(now, ack_msg.timestamp, ack_msg.echoed_timestamp, ack_seq, sizeof(ack_msg),
                 ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S);
 
+            acked_lost = ack_msg.packets_lost;
+            ack_pending = 0;
             ack_msg.set_stat();
             app.ExitIf(us.Send((char*)(&ack_msg), sizeof(ack_msg), new_ecn) != sizeof(ack_msg), "Invalid ack packet length sent.\n");
+            app.LogCCState(now, *pragueCC.GetStatePtr());
         } else if (rfc8888_acktime - now <= 0) {
+            while (app.rle_ack && start_seq != end_seq) {
+                rle_rcvd = rle_mark = rle_lost = 0;
+                rle_ato_sum = 0;
+                uint16_t rle_acksize = rle_ackmsg.set_stat(start_seq, end_seq, now, recvboard, app.max_pkt,
+                    app.ato_shift, rle_rcvd, rle_mark, rle_lost, rle_ato_sum);
+                app.ExitIf(us.Send((char*)(&rle_ackmsg), rle_acksize, ecn_l4s_id) != rle_acksize, "Invalid RLE ack packetlength sent.");
+                app.LogSendRLEACK(now, data_msg.seq_nr, rle_acksize, htonl(rle_ackmsg.begin_seq), htons(rle_ackmsg.num_reports),
+                    htons(rle_ackmsg.num_runs), rle_rcvd, rle_mark, rle_lost, rle_ato_sum);
+            }
             while (start_seq != end_seq) {
-                uint16_t rfc8888_acksize = rfc8888_ackmsg.set_stat(start_seq, end_seq, now, recvtime, recvecn, recvseq, app.max_pkt);
+                uint16_t rfc8888_acksize = rfc8888_ackmsg.set_stat(start_seq, end_seq, now, recvboard, app.max_pkt);
                 app.ExitIf(us.Send((char*)(&rfc8888_ackmsg), rfc8888_acksize, ecn_l4s_id) != rfc8888_acksize, "Invalid RFC8888 ack packetlength sent.");
                 app.LogSendRFC8888ACK(now, data_msg.seq_nr, rfc8888_acksize,
                     htonl(rfc8888_ackmsg.begin_seq), htons(rfc8888_ackmsg.num_reports), rfc8888_ackmsg.report);
             }
 
-            rfc8888_acktime = now + app.rfc8888_ackperiod;
+            rfc8888_acktime = now + rfc8888_period;
+            app.LogCCState(now, *pragueCC.GetStatePtr());
         }
     }
+    app.PrintSummary(pragueCC.Now());
+    if (app.file_name && file.Chunks())
+        app.PrintTransfer(file.FileSize(), file.Bytes(), file.Duration(), file.Chunks(), file.Duplicates(), file.Complete());
+    fec.Flush();
+    if (fec.Stats().frames)
+        app.PrintFec(fec.Stats());
+    playout.Flush();
+    if (playout.Stats().frames)
+        app.PrintDeadline(playout.Stats());
+    return 0;
 }
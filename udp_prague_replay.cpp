@@ -0,0 +1,213 @@
+// udp_prague_replay.cpp:
+// Replays PragueCC input recordings (written by udp_prague_sender --record <file>) through a fresh PragueCC and
+// compares the state after every event bit-exactly with the golden trajectory in <file>.golden, so a change to
+// PragueCC can be checked against recorded flows. Recordings are replayed in parallel by a number of threads.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "prague_replay.h"
+
+struct replay_result_t {
+    std::string error;          // the recording could not be replayed
+    uint64_t events;
+    uint64_t diffs;             // events with a different state
+    uint64_t first;             // index of the first different event
+    std::string first_msg;
+    double rate_ratio;          // replayed / golden, summed over all events
+    double window_ratio;
+};
+
+static bool read_file(const std::string &filename, std::vector<char> &buf)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf.resize(len > 0 ? size_t(len) : 0);
+    bool ok = len >= 0 && fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
+    return ok;
+}
+
+static bool valid_header(const std::vector<char> &buf, uint32_t magic, uint16_t rec_size)
+{
+    if (buf.size() < sizeof(replay_hdr_t))
+        return false;
+    const replay_hdr_t *hdr = reinterpret_cast<const replay_hdr_t*>(buf.data());
+    return hdr->magic == magic && hdr->version == REPLAY_VERSION && hdr->rec_size == rec_size;
+}
+
+// describe the first field that differs
+static std::string diff_field(const replay_state_t &g, const replay_state_t &r)
+{
+    const char *name = "padding";
+    long long e = 0, a = 0;
+#define DIFF(f) if (g.f != r.f) { name = #f; e = (long long)g.f; a = (long long)r.f; } else
+    DIFF(now) DIFF(type) DIFF(result) DIFF(cc_state) DIFF(cca_mode) DIFF(packet_window) DIFF(packet_burst)
+    DIFF(inflight) DIFF(srtt) DIFF(min_rtt) DIFF(pacing_rate) DIFF(fractional_window) DIFF(packet_size) DIFF(alpha) {}
+#undef DIFF
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s: expected %lld, got %lld", name, e, a);
+    return msg;
+}
+
+static void replay(const std::string &filename, bool generate, bool verbose, replay_result_t &res)
+{
+    res.events = res.diffs = res.first = 0;
+    res.rate_ratio = res.window_ratio = 1.0;
+    std::vector<char> rec, gold;
+    if (!read_file(filename, rec) || !valid_header(rec, REPLAY_MAGIC, sizeof(replay_event_t))) {
+        res.error = "not a valid recording";
+        return;
+    }
+    std::string golden_name = filename + ".golden";
+    if (!generate && (!read_file(golden_name, gold) || !valid_header(gold, GOLDEN_MAGIC, sizeof(replay_state_t)))) {
+        res.error = "no valid golden trajectory " + golden_name;
+        return;
+    }
+    const replay_hdr_t &hdr = *reinterpret_cast<const replay_hdr_t*>(rec.data());
+    PragueReplay cc(hdr);
+    std::vector<replay_state_t> out;
+    std::vector<time_tp> samples;
+    size_t gold_cnt = generate ? 0 : (gold.size() - sizeof(replay_hdr_t)) / sizeof(replay_state_t);
+    const replay_state_t *golden = generate ? NULL : reinterpret_cast<const replay_state_t*>(gold.data() + sizeof(replay_hdr_t));
+    double g_rate = 0, r_rate = 0, g_win = 0, r_win = 0;
+    size_t pos = sizeof(replay_hdr_t);
+    while (pos + sizeof(replay_event_t) <= rec.size()) {
+        replay_event_t ev;
+        memcpy(&ev, rec.data() + pos, sizeof(ev));
+        pos += sizeof(ev);
+        if (ev.count) {
+            if (pos + ev.count * sizeof(time_tp) > rec.size())
+                break;
+            samples.resize(ev.count);
+            memcpy(samples.data(), rec.data() + pos, ev.count * sizeof(time_tp));
+            pos += ev.count * sizeof(time_tp);
+        }
+        replay_state_t st;
+        cc.Apply(ev, samples.data(), st);
+        if (generate) {
+            out.push_back(st);
+        } else if (res.events < gold_cnt) {
+            const replay_state_t &g = golden[res.events];
+            g_rate += double(g.pacing_rate);
+            r_rate += double(st.pacing_rate);
+            g_win += double(g.packet_window);
+            r_win += double(st.packet_window);
+            if (!(st == g)) {
+                std::string msg = diff_field(g, st);
+                if (!res.diffs++) {
+                    res.first = res.events;
+                    res.first_msg = msg;
+                }
+                if (verbose)
+                    printf("%s: event %llu at %d: %s\n", filename.c_str(), (unsigned long long)res.events, ev.now, msg.c_str());
+            }
+        }
+        res.events++;
+    }
+    if (pos != rec.size()) {
+        res.error = "truncated recording";
+        return;
+    }
+    if (generate) {
+        FILE *fp = fopen(golden_name.c_str(), "wb");
+        replay_hdr_t ghdr = hdr;
+        ghdr.magic = GOLDEN_MAGIC;
+        ghdr.rec_size = sizeof(replay_state_t);
+        if (!fp || fwrite(&ghdr, sizeof(ghdr), 1, fp) != 1 ||
+            fwrite(out.data(), sizeof(replay_state_t), out.size(), fp) != out.size())
+            res.error = "could not write " + golden_name;
+        if (fp)
+            fclose(fp);
+        return;
+    }
+    if (res.events != gold_cnt && !res.diffs++) {
+        res.first = (res.events < gold_cnt) ? res.events : gold_cnt;
+        res.first_msg = "trajectory length: expected " + std::to_string(gold_cnt) + ", got " + std::to_string(res.events);
+    }
+    if (g_rate > 0)
+        res.rate_ratio = r_rate / g_rate;
+    if (g_win > 0)
+        res.window_ratio = r_win / g_win;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    bool generate = false;
+    bool verbose = false;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-g") {
+            generate = true;
+        } else if (arg == "-v") {
+            verbose = true;
+        } else if (arg == "-t" && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (arg[0] != '-') {
+            files.push_back(arg);
+        } else {
+            files.clear();
+            break;
+        }
+    }
+    if (files.empty()) {
+        printf("UDP Prague replay usage:\n"
+               "    udp_prague_replay <recording written with --record>... [options]\n"
+               "    -g (write the replayed trajectories as the new <recording>.golden files)\n"
+               "    -t <threads, def: number of CPUs>\n"
+               "    -v (print every different event)\n");
+        exit(1);
+    }
+    if (threads < 1)
+        threads = 1;
+    if (threads > files.size())
+        threads = unsigned(files.size());
+
+    std::vector<replay_result_t> results(files.size());
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < files.size(); i = next++)
+                replay(files[i], generate, verbose, results[i]);
+        });
+    for (std::thread &w : workers)
+        w.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int ret = 0;
+    uint64_t events = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        const replay_result_t &r = results[i];
+        events += r.events;
+        if (!r.error.empty()) {
+            printf("%s: ERROR %s\n", files[i].c_str(), r.error.c_str());
+            ret = 1;
+        } else if (generate) {
+            printf("%s: %llu events, golden trajectory written\n", files[i].c_str(), (unsigned long long)r.events);
+        } else if (!r.diffs) {
+            printf("%s: %llu events, identical\n", files[i].c_str(), (unsigned long long)r.events);
+        } else {
+            printf("%s: %llu events, %llu different, first at event %llu (%s), rate ratio %.4f, window ratio %.4f\n",
+                   files[i].c_str(), (unsigned long long)r.events, (unsigned long long)r.diffs,
+                   (unsigned long long)r.first, r.first_msg.c_str(), r.rate_ratio, r.window_ratio);
+            ret = 1;
+        }
+    }
+    if (secs > 0)
+        fprintf(stderr, "%zu recordings, %llu events in %.3f s: %.0f flows/s, %.0f events/s\n", files.size(),
+                (unsigned long long)events, secs, files.size() / secs, events / secs);
+    return ret;
+}
@@ -3,12 +3,15 @@
 //
 
 #include <string>
+#include <vector>
 #include "udpsocket.h"
 //#include "icmpsocket.h" TODO: optimize MTU detection
 #include "app_stuff.h"
 #include "pkt_format.h"
-
-#define MAX_TIMEOUT      2    // Maximum number of timeouts before exiting
+#include "prague_replay.h"
+#include "file_transfer.h"
+#include "fec.h"
+#include "frame_deadline.h"
 
 int main(int argc, char **argv)
 {
@@ -20,38 +23,57 @@ int main(int argc, char **argv)
         us.Connect(app.rcv_addr, (uint16_t)app.rcv_port);
     else
         us.Bind(app.rcv_addr, (uint16_t)app.rcv_port);
+    // the payload is never changed, so its zero-copy sends need no release tracking
+    if (app.zerocopy)
+        app.ExitIf(!us.SetZeroCopy(app.zerocopy_min), "Zero-copy sends are not supported");
 
     char receivebuffer[BUFFER_SIZE];
-    uint32_t sendbuffer[BUFFER_SIZE/4];
-    // init payload with dummy data
-    for (int i = 0; i < BUFFER_SIZE/4; i++)
-        sendbuffer[i] = htonl(i);
+    // init payload with dummy data, the application memory that is sent after the packet headers without copying,
+    // as large as the largest packet (above BUFFER_SIZE for large zero-copy payloads)
+    std::vector<uint32_t> payload((app.max_pkt + 3) / 4);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = htonl(uint32_t(i));
 
     struct ackmessage_t& ack_msg = (struct ackmessage_t&)(receivebuffer);  // overlaying the receive buffer
-    struct datamessage_t& data_msg = (struct datamessage_t&)(sendbuffer);  // overlaying the send buffer
 
-    // Frame message
-    struct framemessage_t& frame_msg = (struct framemessage_t&)(sendbuffer);  // overlaying the send buffer
+    // the headers of a burst are built contiguously, one per packet, and sent scatter-gather with the payload
+    // (which starts after the header size, so the packets carry the same bytes as a header overlaying the payload)
+    std::vector<datamessage_t> data_hdrs(1);
+    std::vector<framemessage_t> frame_hdrs(1);
+    std::vector<filemessage_t> file_hdrs(1);
+    std::vector<fecmessage_t> fec_hdrs(1);
+
+    // with --file the chunks of a memory-mapped file are sent instead of the dummy payload, until all are delivered
+    FileSender file;
+    if (app.file_name) {
+        app.ExitIf(app.max_pkt < sizeof(filemessage_t) + 64, "Packet size too small for file chunks");
+        app.ExitIf(!file.Open(app.file_name, uint32_t(app.max_pkt - sizeof(filemessage_t))), "Could not open the file to send");
+        app.ExitIf(!file.Chunks(), "Empty file");
+    }
 
     // RFC8888 buffer
     struct rfc8888ack_t& rfc8888_ackmsg = (struct rfc8888ack_t&)(receivebuffer);  // overlaying the receive buffer
-    time_tp sendtime[PKT_BUFFER_SIZE] = {0};
-    pktsend_tp pkts_stat[PKT_BUFFER_SIZE] = {snd_init};
+    struct rleack_t& rle_ackmsg = (struct rleack_t&)(receivebuffer);  // overlaying the receive buffer (same begin_seq/num_reports as RFC8888)
+    Scoreboard scoreboard(app.rt_mode || app.file_name, SB_MAX_SIZE, app.rack); // per packet send time, state and frame (or file chunk) of the packets in flight
     time_tp pkts_rtt[REPORT_SIZE] = {0};
-    count_tp last_ackseq = 0;   // Last received ACK sequence
-    count_tp pkts_received = 0; // Receivd packets counter for RFC8888 feedback
-    count_tp pkts_CE = 0;       // CE packets counter for RFC8888 feedback
-    count_tp pkts_lost = 0;     // Lost packets counter for RFC8888 feedback
-    bool err_L4S = false;       // L4S error flag for RFC8888 feedback
+    count_tp pkts_received = 0; // Receivd packets counter for RFC8888 feedback (and the last ACK)
+    count_tp pkts_CE = 0;       // CE packets counter for RFC8888 feedback (and the last ACK)
+    count_tp pkts_lost = 0;     // Lost packets counter for RFC8888 feedback (echoed lost counter of the last ACK)
+    bool err_L4S = false;       // L4S error flag for RFC8888 feedback (and the last ACK)
+    time_tp lossTimeout = 0;    // time to run the reordering-tolerant loss detection if no feedback arrives
+    bool lossTimer = false;
 
     // create a PragueCC object. Using default parameters for the Prague CC in line with TCP_Prague
-    PragueCC pragueCC(app.max_pkt,
+    // (a PragueRecorder only writes its inputs when --record is given)
+    PragueRecorder pragueCC(app.max_pkt,
                       app.rt_mode ? app.rt_fps : 0,
                       app.rt_mode ? app.rt_frameduration : 0,
                       PRAGUE_INITRATE,
                       PRAGUE_INITWIN,
                       PRAGUE_MINRATE,
                       app.max_rate);
+    if (app.record_file)
+        pragueCC.Record(app.record_file);
 
     // outside PragueCC CC-loop state
     time_tp now = pragueCC.Now();
@@ -67,10 +89,14 @@ int main(int argc, char **argv)
     size_tp bytes_received = 0; // Received Bytes
     time_tp compRecv = 0;       // send time compensation
     time_tp waitTimeout = 0;    // time to wait for ACK receiving
+    time_tp recvTimeout = 0;    // waitTimeout, or earlier if the loss detection timer expires first
+    time_tp ackTimeout = 0;     // probe or retransmission timeout when window-limited
+    count_tp ack_window = 1;    // requested ACK frequency in packets (1 is ACK every packet)
+    time_tp ack_delay = 0;      // requested maximum ACK delay in us
 
     time_tp frame_timer = 0;    // frame timer for next frame
     count_tp frame_nr = 0;      // frame sequence number of last sent frame (first frame sequence number will be 1)
-    size_tp frame_size;         // frame size in Bytes
+    size_tp frame_size = 0;     // frame size in Bytes, 0 when the frame is sent (or dropped)
     size_tp frame_sent = 0;     // frame sent size in Bytes
     count_tp frame_window;      // frame window
     count_tp frame_inflight = 0;// frame inflight
@@ -79,17 +105,23 @@ int main(int argc, char **argv)
     count_tp sent_frame = 0;    // sent frame counter
     count_tp recv_frame = 0;    // received frame counter
     count_tp lost_frame = 0;    // lost frame counter
-    count_tp frame_idx[PKT_BUFFER_SIZE] = {0};
     count_tp frame_pktlost[FRM_BUFFER_SIZE] = {0};
     count_tp frame_pktsent[FRM_BUFFER_SIZE] = {0};
+    FecEncoder fec;             // with --fec, plans the data and parity packets of each frame
+    if (app.fec)
+        fec.Init(app.fec, app.fec_parity);
+    time_tp frame_deadline = 0; // with --deadline, the current frame must be complete at the receiver by then
+    frame_drop_stats_t frame_drops = frame_drop_stats_t();
 
-    uint8_t num_timeout = 0;
+    count_tp num_timeout = 0;   // consecutive timeouts without feedback
+    bool probe = false;         // send a probe packet beyond the window after a probe timeout
+    time_tp timeoutStart = now; // time of the last packet sent or feedback received
 
     // wait for a trigger packet, otherwise just start sending
     if (!app.connect) {
         do {
             bytes_received = us.Receive(receivebuffer, sizeof(receivebuffer), rcv_ecn, 0);
-        } while (bytes_received == 0);
+        } while (bytes_received == 0 && !app.Stopped());
         bytes_received = 0;
     }
 
@@ -100,31 +132,66 @@ int main(int argc, char **argv)
     // get initial CC state
     pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
 
-    while (true) {
+    while (!app.Stopped()) {
         count_tp inburst = 0;   // packets in-burst counter
         time_tp startSend = 0;  // next time to send
+        bool cc_updated = false;// PragueCC processed feedback or a timeout, log and publish its new state
         now = pragueCC.Now();
+        if (app.ack_freq)
+            pragueCC.GetACKFreqInfo(ack_window, ack_delay, app.acks_per_rtt);
         if (!app.rt_mode) {
             // if the window and pacing interval allows, send the next burst
-            while ((inflight < packet_window) && (inburst < packet_burst) && (nextSend - now <= 0)) {
-                pragueCC.GetTimeInfo(data_msg.timestamp, data_msg.echoed_timestamp, new_ecn);
+            if (data_hdrs.size() < size_t(packet_burst))
+                data_hdrs.resize(packet_burst);
+            if (app.file_name && file_hdrs.size() < size_t(packet_burst))
+                file_hdrs.resize(packet_burst);
+            size_tp burst_bytes = 0; // a file chunk can be larger than packet_size, and the last one smaller
+            count_tp chunk = 0;
+            while ((inflight < packet_window || probe) && (inburst < packet_burst) && (nextSend - now <= 0) &&
+                   (!app.file_name || file.NextChunk(chunk))) {
                 if (!startSend)
                     startSend = now;
-                data_msg.seq_nr = ++seqnr;
-                app.LogSendData(now, data_msg.timestamp, data_msg.echoed_timestamp, seqnr, packet_size,
-                    pacing_rate, packet_window, packet_burst, inflight, inburst, nextSend);
-                data_msg.hton();
-                app.ExitIf(us.Send((char*)(&data_msg), packet_size, new_ecn) != packet_size, "invalid data packet length sent");
-                sendtime[seqnr % PKT_BUFFER_SIZE] = startSend;
-                pkts_stat[seqnr % PKT_BUFFER_SIZE] = snd_sent;
+                ++seqnr;
+                if (!app.file_name) {
+                    datamessage_t &data_msg = data_hdrs[inburst];
+                    pragueCC.GetTimeInfo(data_msg.timestamp, data_msg.echoed_timestamp, new_ecn);
+                    data_msg.seq_nr = seqnr;
+                    data_msg.ack_window = ack_window;
+                    data_msg.ack_delay = ack_delay;
+                    app.LogSendData(now, data_msg.timestamp, data_msg.echoed_timestamp, seqnr, packet_size,
+                        pacing_rate, packet_window, packet_burst, inflight, inburst, nextSend);
+                    data_msg.hton();
+                    app.ExitIf(us.Send((char*)(&data_msg), sizeof(data_msg), (char*)(&payload[0]) + sizeof(data_msg),
+                                       packet_size - sizeof(data_msg), new_ecn) != packet_size, "invalid data packet length sent");
+                    scoreboard.Sent(seqnr, startSend);
+                    burst_bytes += packet_size;
+                } else {
+                    filemessage_t &file_msg = file_hdrs[inburst];
+                    size_tp len;
+                    const uint8_t *data = file.Chunk(chunk, file_msg, len);
+                    pragueCC.GetTimeInfo(file_msg.timestamp, file_msg.echoed_timestamp, new_ecn);
+                    file_msg.seq_nr = seqnr;
+                    file_msg.ack_window = ack_window;
+                    file_msg.ack_delay = ack_delay;
+                    app.LogSendData(now, file_msg.timestamp, file_msg.echoed_timestamp, seqnr, sizeof(file_msg) + len,
+                        pacing_rate, packet_window, packet_burst, inflight, inburst, nextSend);
+                    file_msg.hton();
+                    app.ExitIf(us.Send((char*)(&file_msg), sizeof(file_msg), (const char*)(data), len, new_ecn) !=
+                               sizeof(file_msg) + len, "invalid file packet length sent");
+                    scoreboard.Sent(seqnr, startSend, chunk);
+                    file.Sent(sizeof(file_msg) + len);
+                    burst_bytes += sizeof(file_msg) + len;
+                }
+                timeoutStart = now;
+                probe = false;
                 inburst++;
                 inflight++;
             }
             if (startSend != 0) {
-                if (compRecv + packet_size * inburst * 1000000 / pacing_rate <= 0)
+                if (compRecv + burst_bytes * 1000000 / pacing_rate <= 0)
                     nextSend = time_tp(startSend + 1);
                 else
-                    nextSend = time_tp(startSend + compRecv + packet_size * inburst * 1000000 / pacing_rate);
+                    nextSend = time_tp(startSend + compRecv + burst_bytes * 1000000 / pacing_rate);
                 compRecv = 0;
             }
         } else {
@@ -139,38 +206,90 @@ int main(int argc, char **argv)
                         frame_adv = 1 + (now - frame_timer) * app.rt_fps / 1000000;
                     frame_nr += frame_adv;
                     frame_timer += frame_adv * 1000000 / app.rt_fps;
+                    frame_drops.skipped += frame_adv - 1;
                 }
                 compRecv = 0;
+                // captured at the start of its frame interval
+                frame_deadline = frame_timer - 1000000 / app.rt_fps + app.rt_deadline;
 
                 // Get extra frame info from Prague CC and update frame sender info
                 pragueCC.GetCCInfoVideo(pacing_rate, frame_size, frame_window, packet_burst, packet_size);
+                if (app.fec)
+                    frame_size = fec.Plan(frame_size, packet_size, sizeof(fecmessage_t));  // parity included
                 //printf("[FRAME %d] now: %d, inflight: %d(%d/%d/%d/%d), frame_size: %ld, frame_window: %d, packet_size: %ld, pacing_rate: %ld\n",
                 //    frame_nr, now, frame_inflight, is_sending, sent_frame, lost_frame, recv_frame, frame_size, frame_window, packet_size, pacing_rate);
             }
-            while ((frame_inflight <= frame_window) && (frame_sent < frame_size) && (inburst < packet_burst) && (nextSend - now <= 0)) {
+            if (app.rt_deadline && frame_sent < frame_size &&
+                frame_late(now, frame_deadline, frame_size - frame_sent, pacing_rate, pragueCC.GetStatePtr()->m_srtt)) {
+                // the frame cannot be complete at the receiver in time, drop the packets not sent yet
+                if (frame_sent) {
+                    frame_stat_drop(frame_nr, lost_frame, frame_pktlost);
+                    is_sending = false;
+                    sent_frame++;
+                    frame_drops.partial++;
+                    frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
+                }
+                frame_drops.dropped++;
+                frame_sent = 0;
+                frame_size = 0;
+                nextSend = frame_timer;
+            }
+            if (frame_hdrs.size() < size_t(packet_burst))
+                frame_hdrs.resize(packet_burst);
+            if (app.fec && fec_hdrs.size() < size_t(packet_burst))
+                fec_hdrs.resize(packet_burst);
+            while ((frame_inflight <= frame_window || probe) && (frame_sent < frame_size) && (inburst < packet_burst) && (nextSend - now <= 0)) {
+                // the FEC header extends the frame header
+                framemessage_t &frame_msg = app.fec ? (framemessage_t&)(fec_hdrs[inburst]) : frame_hdrs[inburst];
                 pragueCC.GetTimeInfo(frame_msg.timestamp, frame_msg.echoed_timestamp, new_ecn);
                 if (!frame_sent) {
                     is_sending = true;
-                    frame_pktlost[frame_nr % FRM_BUFFER_SIZE] = 0;
+                    frame_pktlost[frame_nr % FRM_BUFFER_SIZE] = app.fec ? -fec.Tolerance() : 0;  // the losses FEC repairs
                     frame_pktsent[frame_nr % FRM_BUFFER_SIZE] = 0;
                 }
                 if (!startSend)
                     startSend = now;
                 frame_msg.seq_nr = ++seqnr;
+                frame_msg.ack_window = ack_window;
+                frame_msg.ack_delay = ack_delay;
                 frame_msg.frame_nr = frame_nr;
                 frame_msg.frame_sent = frame_sent;
                 frame_msg.frame_size = frame_size;
 
-                // Reduce packet size of the last packet
-                if (frame_sent + packet_size > frame_size)
+                size_tp hdr_size = sizeof(frame_msg);
+                const char *data = (char*)(&payload[0]) + sizeof(frame_msg);
+                if (app.fec) {
+                    // the next data or parity packet of the planned frame
+                    fec_pkt_t fp = fec.Next();
+                    fecmessage_t &fec_msg = fec_hdrs[inburst];
+                    fec_msg.fec_scheme = app.fec;
+                    fec_msg.fec_block = fp.block;
+                    fec_msg.fec_k = fp.k;
+                    fec_msg.fec_m = fp.m;
+                    fec_msg.fec_index = fp.index;
+                    fec_msg.fec_blocks = fp.blocks;
+                    packet_size = fp.size;
+                    hdr_size = sizeof(fec_msg);
+                    data = (char*)(&payload[0]) + sizeof(fec_msg);
+                    if (fp.index < fp.k)
+                        fec.Protect(data, packet_size - hdr_size);
+                    else
+                        data = fec.Parity();
+                } else if (frame_sent + packet_size > frame_size) {
+                    // Reduce packet size of the last packet
                     packet_size = (frame_sent + PRAGUE_MINMTU > frame_size) ? PRAGUE_MINMTU : (frame_size - frame_sent);
+                }
                 app.LogSendFrameData(now, frame_msg.timestamp, frame_msg.echoed_timestamp, seqnr, packet_size,
                     pacing_rate, frame_window, frame_window, packet_burst, frame_inflight, frame_sent, inburst, nextSend);
-                frame_msg.hton();
-                app.ExitIf(us.Send((char*)(&frame_msg), packet_size, new_ecn) != packet_size, "invalid frame packet length sent");
-                sendtime[seqnr % PKT_BUFFER_SIZE] = startSend;
-                pkts_stat[seqnr % PKT_BUFFER_SIZE] = snd_sent;
-                frame_idx[seqnr % PKT_BUFFER_SIZE] = frame_nr;
+                if (app.fec)
+                    fec_hdrs[inburst].hton();
+                else
+                    frame_msg.hton();
+                app.ExitIf(us.Send((char*)(&frame_msg), hdr_size, data, packet_size - hdr_size, new_ecn) != packet_size,
+                           "invalid frame packet length sent");
+                scoreboard.Sent(seqnr, startSend, frame_nr);
+                timeoutStart = now;
+                probe = false;
                 inburst++;
                 inflight++;
                 frame_sent += packet_size;
@@ -180,10 +299,12 @@ int main(int argc, char **argv)
                 if (frame_sent >= frame_size) {
                     nextSend = frame_timer;
                     frame_sent = 0;
+                    frame_size = 0;
 
                     is_sending = false;
                     sent_frame++;
-                    if (frame_pktlost[frame_nr % FRM_BUFFER_SIZE])
+                    frame_drops.sent++;
+                    if (frame_pktlost[frame_nr % FRM_BUFFER_SIZE] > 0)
                         lost_frame++;
                 } else {
                     // frame_pktsize might be different from packet_size
@@ -200,47 +321,98 @@ int main(int argc, char **argv)
 
         waitTimeout = nextSend;
         now = pragueCC.Now();
-        if (!app.rt_mode && inflight >= packet_window)
-            waitTimeout = now + SND_TIMEOUT;
+        // when window-limited, wait for feedback up to the probe timeout, or the backed-off timeout after a probe
+        pragueCC.GetTimeoutInfo(ackTimeout, num_timeout, (app.rfc8888_ack && !app.ack_freq) ? time_tp(app.rfc8888_ackperiod) : ack_delay);
+        // a file transfer without chunks left to send waits for feedback like a window-limited one
+        bool fb_limited = inflight >= packet_window || (app.file_name && !file.HasData());
+        if (!app.rt_mode && fb_limited)
+            waitTimeout = timeoutStart + ackTimeout;
         else if (app.rt_mode && frame_inflight >= frame_window)
-            waitTimeout = now + SND_TIMEOUT;
+            waitTimeout = timeoutStart + ackTimeout;
+        recvTimeout = waitTimeout;
+        lossTimer = app.rack && scoreboard.LossTimer(lossTimeout) && (waitTimeout - lossTimeout > 0);
+        if (lossTimer)
+            recvTimeout = lossTimeout;
+        // sleep until the absolute deadline, or until feedback arrives
         do {
-            bytes_received = us.Receive(receivebuffer, sizeof(receivebuffer), rcv_ecn, (waitTimeout - now > 0) ? (waitTimeout - now) : 1);
+            bytes_received = us.ReceiveUntil(receivebuffer, sizeof(receivebuffer), rcv_ecn, recvTimeout, now);
             now = pragueCC.Now();
-        } while ((bytes_received == 0) && (waitTimeout - now > 0));
+        } while ((bytes_received == 0) && (recvTimeout - now > 0) && !app.Stopped());
+        if (bytes_received == 0)
+            app.LogWake(now, recvTimeout);
         if (receivebuffer[0] == PKT_ACK_TYPE && bytes_received >= ssize_t(sizeof(ack_msg))) {
+            num_timeout = 0;
+            probe = false;
+            timeoutStart = now;
             if (!app.rt_mode) {
-                ack_msg.get_stat(pkts_stat, pkts_lost);
+                ack_msg.get_stat(scoreboard, pkts_lost);
             } else {
-                // Update frame_inflight
-                ack_msg.get_frame_stat(pkts_stat, pkts_lost, is_sending, frame_nr, recv_frame, lost_frame, frame_idx, frame_pktsent, frame_pktlost);
-                frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
+                ack_msg.get_frame_stat(scoreboard, pkts_lost, is_sending, frame_nr, recv_frame, lost_frame, frame_pktsent, frame_pktlost);
+            }
+            pkts_received = ack_msg.packets_received;
+            pkts_CE = ack_msg.packets_CE;
+            err_L4S = ack_msg.error_L4S;
+            // A per-packet ACK only carries counters, so PragueCC keeps the echoed lost count, consistent with the
+            // echoed received and CE counts; the reordering-tolerant loss detection only does the frame accounting
+            count_tp ack_lost = ack_msg.packets_lost;
+            if (app.rack) {
+                detect_lost(now, scoreboard, is_sending, frame_nr, recv_frame, lost_frame,
+                    app.rt_mode ? frame_pktsent : NULL, app.rt_mode ? frame_pktlost : NULL);
+                app.LogReordering(scoreboard.Reordered(), scoreboard.Spurious(), scoreboard.ReorderWindow());
             }
+            // Update frame_inflight
+            if (app.rt_mode)
+                frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
             pragueCC.PacketReceived(ack_msg.timestamp, ack_msg.echoed_timestamp);
-            pragueCC.ACKReceived(ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, seqnr, ack_msg.error_L4S, inflight);
+            app.LogRTT(*pragueCC.GetStatePtr());
+            pragueCC.ACKReceived(ack_msg.packets_received, ack_msg.packets_CE, ack_lost, seqnr, ack_msg.error_L4S, inflight);
+            cc_updated = true;
             if (!app.rt_mode) {
                 pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
                 app.LogRecvACK(now, ack_msg.timestamp, ack_msg.echoed_timestamp, seqnr, bytes_received,
-                    ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S, pacing_rate, packet_window, packet_burst,
+                    ack_msg.packets_received, ack_msg.packets_CE, ack_lost, ack_msg.error_L4S, pacing_rate, packet_window, packet_burst,
                     inflight, inburst, nextSend);
              } else {
                 app.LogRecvACK(now, ack_msg.timestamp, ack_msg.echoed_timestamp, seqnr, bytes_received,
-                    ack_msg.packets_received, ack_msg.packets_CE, ack_msg.packets_lost, ack_msg.error_L4S, pacing_rate, packet_window, packet_burst,
+                    ack_msg.packets_received, ack_msg.packets_CE, ack_lost, ack_msg.error_L4S, pacing_rate, packet_window, packet_burst,
                     inflight, inburst, nextSend, frame_window, frame_inflight, is_sending, sent_frame, lost_frame, recv_frame);
              }
-        } else if (receivebuffer[0] == RFC8888_ACK_TYPE && bytes_received >= rfc8888_ackmsg.get_size(0)) {
+        } else if ((receivebuffer[0] == RFC8888_ACK_TYPE && bytes_received >= rfc8888_ackmsg.get_size(0)) ||
+                   (receivebuffer[0] == RLE_ACK_TYPE && bytes_received >= rle_ackmsg.get_size(0))) {
             uint16_t num_rtt = 0;
-            if (!app.rt_mode) {
-                num_rtt = rfc8888_ackmsg.get_stat(now, sendtime, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S, pkts_stat, last_ackseq);
+            num_timeout = 0;
+            probe = false;
+            timeoutStart = now;
+            if (receivebuffer[0] == RLE_ACK_TYPE) {
+                if (!app.rt_mode) {
+                    num_rtt = rle_ackmsg.get_stat(now, scoreboard, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S, bytes_received);
+                } else {
+                    num_rtt = rle_ackmsg.get_frame_stat(now, scoreboard, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S, bytes_received,
+                        is_sending, frame_nr, recv_frame, lost_frame, frame_pktsent, frame_pktlost);
+                    frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
+                }
+            } else if (!app.rt_mode) {
+                num_rtt = rfc8888_ackmsg.get_stat(now, scoreboard, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S);
             } else {
                 // Update frame_inflight
-                num_rtt = rfc8888_ackmsg.get_frame_stat(now, sendtime, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S, pkts_stat, last_ackseq,
-                    is_sending, frame_nr, recv_frame, lost_frame, frame_idx, frame_pktsent, frame_pktlost);
+                num_rtt = rfc8888_ackmsg.get_frame_stat(now, scoreboard, pkts_rtt, pkts_received, pkts_lost, pkts_CE, err_L4S,
+                    is_sending, frame_nr, recv_frame, lost_frame, frame_pktsent, frame_pktlost);
                 frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
             }
-            if (num_rtt) {
+            count_tp newly_lost = 0;
+            if (app.rack) {
+                newly_lost = detect_lost(now, scoreboard, is_sending, frame_nr, recv_frame, lost_frame,
+                    app.rt_mode ? frame_pktsent : NULL, app.rt_mode ? frame_pktlost : NULL);
+                pkts_lost += newly_lost;
+                if (app.rt_mode)
+                    frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
+                app.LogReordering(scoreboard.Reordered(), scoreboard.Spurious(), scoreboard.ReorderWindow());
+            }
+            if (num_rtt || newly_lost) {
                 pragueCC.RFC8888Received(num_rtt, pkts_rtt);
+                app.LogRTT(*pragueCC.GetStatePtr());
                 pragueCC.ACKReceived(pkts_received, pkts_CE, pkts_lost, seqnr, err_L4S, inflight);
+                cc_updated = true;
                 if (!app.rt_mode)
                     pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
             }
@@ -253,26 +425,58 @@ int main(int argc, char **argv)
                     pkts_received, pkts_CE, pkts_lost, err_L4S, pacing_rate, packet_window, packet_burst,
                     inflight, inburst, nextSend, frame_window, frame_inflight, is_sending, sent_frame, lost_frame, recv_frame);
             }
-        } else {
-            if (!app.rt_mode && inflight >= packet_window) {
-                app.ExitIf(num_timeout > MAX_TIMEOUT, "stop prague sender due to consecutive timeout");
+        } else if (lossTimer && now - lossTimeout >= 0) {
+            // no feedback in time, but outstanding packets passed the reordering-tolerant loss detection deadline
+            count_tp newly_lost = detect_lost(now, scoreboard, is_sending, frame_nr, recv_frame, lost_frame,
+                app.rt_mode ? frame_pktsent : NULL, app.rt_mode ? frame_pktlost : NULL);
+            if (newly_lost && app.rfc8888_ack) {
+                pkts_lost += newly_lost;
+                pragueCC.ACKReceived(pkts_received, pkts_CE, pkts_lost, seqnr, err_L4S, inflight);
+                cc_updated = true;
+                if (!app.rt_mode)
+                    pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
+            }
+            if (newly_lost && app.rt_mode)
+                frame_inflight = is_sending + sent_frame - recv_frame - lost_frame;
+        } else if (waitTimeout - now <= 0) {
+            if (!num_timeout && ((!app.rt_mode && fb_limited) || (app.rt_mode && frame_inflight >= frame_window))) {
+                // probe timeout: send a probe packet beyond the window first, its feedback avoids collapsing the window
+                probe = true;
+                if (app.file_name)
+                    file.Probe(scoreboard, seqnr);
+                nextSend = now;
+                timeoutStart = now;
+                num_timeout++;
+            } else if (!app.rt_mode && fb_limited) {
+                // retransmission timeout: the probe was not answered either (the probe timeout is not counted)
+                app.ExitIf(app.max_timeouts && uint32_t(num_timeout - 1) > app.max_timeouts, "stop prague sender due to consecutive timeout");
+                if (app.file_name)
+                    file.Timeout(scoreboard, seqnr);
                 pragueCC.ResetCCInfo();
+                cc_updated = true;
                 inflight = 0;
                 perror("Reset PragueCC\n");
                 pragueCC.GetCCInfo(pacing_rate, packet_window, packet_burst, packet_size);
                 nextSend = now;
+                timeoutStart = now;
                 num_timeout++;
             } else if (app.rt_mode && frame_inflight >= frame_window) {
-                app.ExitIf(num_timeout > MAX_TIMEOUT, "stop prague sender due to consecutive timeout");
+                app.ExitIf(app.max_timeouts && uint32_t(num_timeout - 1) > app.max_timeouts, "stop prague sender due to consecutive timeout");
                 pragueCC.ResetCCInfo();
+                cc_updated = true;
                 frame_inflight = 0;
                 perror("Reset Real-Time PragueCC\n");
                 nextSend = now;
                 frame_sent = 0;
                 frame_timer = 0;
+                timeoutStart = now;
                 num_timeout++;
             }
         }
+        if (cc_updated)
+            app.LogCCState(now, *pragueCC.GetStatePtr());
+        if (app.file_name && file.Update(scoreboard, seqnr))
+            break;  // all chunks delivered
         // Exceed time will be compensated (except reset)
         now = pragueCC.Now();
         if (waitTimeout - now <= 0) {
@@ -283,4 +487,20 @@ int main(int argc, char **argv)
             }
         }
     }
+    app.PrintSummary(pragueCC.Now());
+    if (app.rt_deadline) {
+        frame_drops.frames = frame_nr;
+        app.PrintDeadline(frame_drops);
+    }
+    if (app.file_name)
+        app.PrintTransfer(file.FileSize(), file.Bytes(), file.Duration(), file.Chunks(), file.Retransmitted(), file.Done());
+    if (app.zerocopy) {
+        us.ZeroCopyFlush(1000000);
+        zerocopy_stats_t zs = us.ZeroCopyStats();
+        if (!app.quiet)
+            fprintf(stderr, "[SENDER ZEROCOPY]: sent %s, completed %s, copied by the kernel %s, copied on a full window %s%s\n",
+                    C_STR(zs.sent), C_STR(zs.completed), C_STR(zs.copied), C_STR(zs.fallback),
+                    zs.active ? "" : ", disabled (mostly copied)");
+    }
+    return 0;
 }
@@ -0,0 +1,145 @@
+// udp_prague_stream.cpp:
+// An example of embedding PragueSender: an application that produces messages (of dummy data) and streams them to a
+// udp_prague_receiver, producing only as fast as the PragueSender backpressure allows. Prints the send rate, the
+// queue and the PragueCC state every second.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include <vector>
+#include "prague_sender.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void stop_handler(int)
+{
+    stop = 1;
+}
+
+// a decimal option value of at most max, exits on anything else
+static uint64_t parse_uint(const char *arg, uint64_t max, const char *what)
+{
+    char *p;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &p, 10);
+    if (errno != 0 || p == arg || *p != '\0' || *arg == '-' || v > max) {
+        fprintf(stderr, "Error during converting %s: %s\n", what, arg);
+        exit(1);
+    }
+    return uint64_t(v);
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = "127.0.0.1";
+    uint16_t port = 8080;
+    size_tp max_pkt = PRAGUE_INITMTU;
+    rate_tp max_rate = PRAGUE_MAXRATE;
+    size_tp msg_size = 1000;
+    uint64_t total = 0;
+    time_tp queue_delay = SND_QUEUE_DELAY;
+    bool copy = true;
+    bool rack = false;
+    bool ack_freq = false;
+    bool quiet = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-a" && i + 1 < argc) {
+            addr = argv[++i];
+        } else if (arg == "-p" && i + 1 < argc) {
+            port = uint16_t(parse_uint(argv[++i], 65535, "port"));
+        } else if (arg == "-m" && i + 1 < argc) {
+            max_pkt = size_tp(parse_uint(argv[++i], BUFFER_SIZE, "max packet size"));
+        } else if (arg == "-b" && i + 1 < argc) {
+            max_rate = rate_tp(parse_uint(argv[++i], PRAGUE_MAXRATE / 125, "max bitrate")) * 125;
+        } else if (arg == "-s" && i + 1 < argc) {
+            msg_size = size_tp(parse_uint(argv[++i], 1 << 20, "message size"));
+        } else if (arg == "-n" && i + 1 < argc) {
+            total = parse_uint(argv[++i], UINT64_MAX, "bytes to send");
+        } else if (arg == "-d" && i + 1 < argc) {
+            queue_delay = time_tp(parse_uint(argv[++i], 0x7FFFFFFF, "queue delay target"));
+        } else if (arg == "--range") {
+            copy = false;
+        } else if (arg == "--rack") {
+            rack = true;
+        } else if (arg == "--ackfreq") {
+            ack_freq = true;
+        } else if (arg == "-q") {
+            quiet = true;
+        } else {
+            msg_size = 0;
+            break;
+        }
+    }
+    if (!msg_size || max_pkt < PRAGUE_MINMTU || max_rate < PRAGUE_MINRATE || queue_delay <= 0) {
+        printf("UDP Prague stream usage:\n"
+               "    -a <receiver IP address, def: 127.0.0.1>\n"
+               "    -p <receiver port, def: 8080>\n"
+               "    -m <max packet size, def: %s B>\n"
+               "    -b <max bitrate, def: %s kbps>\n"
+               "    -s <message size, def: 1000 B, max 1 MB>\n"
+               "    -n <bytes to send, def: until stopped>\n"
+               "    -d <queue delay target of the backpressure, def: %s us>\n"
+               "    --range (queue the messages as ranges of application memory instead of copies)\n"
+               "    --rack (reordering-tolerant loss detection)\n"
+               "    --ackfreq (request ACK thinning or an adaptive RFC8888 period)\n"
+               "    -q (quiet)\n",
+               std::to_string(PRAGUE_INITMTU).c_str(), std::to_string(PRAGUE_MAXRATE / 125).c_str(),
+               std::to_string(SND_QUEUE_DELAY).c_str());
+        exit(1);
+    }
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    UDPSocket us;
+    us.Connect(addr, port);
+    PragueSender sender(us, max_pkt, max_rate, SND_QUEUE_SIZE, queue_delay, rack, ack_freq);
+
+    // the application memory: a ring of whole messages, with --range reused once ReleasedOffset() passed them
+    size_tp ring = (SND_QUEUE_SIZE / msg_size) * msg_size;
+    std::vector<char> app_buf(ring);
+    for (size_t i = 0; i < app_buf.size(); i++)
+        app_buf[i] = char(i);
+
+    time_tp start = sender.CC().Now();
+    time_tp rept = start + 1000000;
+    uint64_t rept_sent = 0;
+    uint64_t produced = 0;
+    count_tp blocked = 0;       // times the backpressure held the producer back
+    while (!stop && (!total || sender.SentOffset() < total)) {
+        // produce while the sender accepts, a real application would back off its source here
+        while (!total || produced < total) {
+            size_tp len = (total && total - produced < msg_size) ? size_tp(total - produced) : msg_size;
+            const char *msg = &app_buf[produced % ring];
+            bool queued = copy ? sender.Enqueue(msg, len) :
+                                 (produced + len - sender.ReleasedOffset() <= ring) && sender.EnqueueRange(msg, len);
+            if (!queued) {
+                blocked++;
+                break;
+            }
+            produced += len;
+        }
+        sender.Step();
+        time_tp now = sender.CC().Now();
+        if (now - rept >= 0 && !quiet) {
+            const PragueState *st = sender.CC().GetStatePtr();
+            printf("[STREAM]: %.2f sec, Sent: %.3f Mbps, Pacing rate: %.3f Mbps, Window: %d, InFlight: %d, "
+                   "Queued: %s B, QueueDelay: %.3f ms, Oldest: %.3f ms, SRTT: %.3f ms, Blocked: %d, Timeouts: %d\n",
+                   (now - start) / 1000000.0, (sender.SentOffset() - rept_sent) * 8 / 1000000.0,
+                   st->m_pacing_rate * 8 / 1000000.0, st->m_packet_window, sender.Inflight(),
+                   std::to_string(sender.Queued()).c_str(), sender.QueueDelay() / 1000.0,
+                   sender.OldestDelay() / 1000.0, st->m_srtt / 1000.0, blocked, sender.Timeouts());
+            fflush(stdout);
+            rept += 1000000;
+            rept_sent = sender.SentOffset();
+            blocked = 0;
+        }
+    }
+    if (!quiet)
+        printf("[STREAM SUMMARY]: %.2f sec, sent %s B in %d packets\n", (sender.CC().Now() - start) / 1000000.0,
+               std::to_string(sender.SentOffset()).c_str(), sender.SentPackets());
+    return 0;
+}
@@ -0,0 +1,216 @@
+// udp_prague_trace.cpp:
+// Converts a binary per-packet trace (written by udp_prague_sender/receiver --trace <file>) to the verbose (-v) CSV
+// layout or to JSON lines, optionally keeping only 1 in N records of each type
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "prague_trace.h"
+#include "json_writer.h"
+
+// JSON field names of u and v[] per record type (NULL ends the list)
+static const char *const trace_fields[trc_types][TRACE_FIELDS + 2] = {
+    {NULL},
+    {"pacing_rate", "timestamp", "echoed_timestamp", "seqnr", "packet_size", "packet_window", "packet_burst",
+     "packet_inflight", "packet_inburst", "nextSend", NULL},
+    {"pacing_rate", "timestamp", "echoed_timestamp", "seqnr", "packet_size", "frame_window", "frame_size", "packet_burst",
+     "frame_inflight", "frame_sent", "packet_inburst", "nextSend", NULL},
+    {"bytes_received", "timestamp", "echoed_timestamp", "seqnr", "pkts_received", "pkts_CE", "pkts_lost", "error_L4S",
+     "packet_inflight", "packet_inburst", "nextSend", NULL},
+    {"bytes_received", "begin_seq", "num_reports", "seqnr", "pkts_received", "pkts_CE", "pkts_lost", "error_L4S",
+     "packet_inflight", "packet_inburst", "nextSend", NULL},
+    {"pacing_rate", "packet_window", "packet_burst", "packet_size", "srtt", "rttvar", "min_rtt", "qdelay", "alpha",
+     "cc_state", "cca_mode", "packets_sent", "packets_received", "packets_CE", "packets_lost", NULL},
+    {"bytes_received", "timestamp", "echoed_timestamp", "seqnr", NULL},
+    {"packet_size", "timestamp", "echoed_timestamp", "seqnr", "pkts_received", "pkts_CE", "pkts_lost", "error_L4S", NULL},
+    {"packet_size", "seqnr", "begin_seq", "num_reports", NULL},
+    {"packet_size", "seqnr", "begin_seq", "num_reports", "num_runs", NULL},
+};
+// RT mode feedback records continue differently after error_L4S
+static const char *const trace_rt_fields[] = {"frame_inflight", "frame_sending", "sent_frame", "lost_frame", "recv_frame", "nextSend", NULL};
+
+static const char *const trace_names[trc_types] = {
+    "", "send", "send_frame", "NORMAL_ACK", "RFC8888_ACK", "cc_state", "recv", "send_ACK", "send_RFC8888", "send_RLE"
+};
+
+static void print_header(const trace_hdr_t &hdr)
+{
+    // the same as AppStuff::printInfo in verbose mode, plus the PragueCC state records
+    if (hdr.sender) {
+        if (!hdr.rt_mode) {
+            printf("s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size,,,,, "
+                   "pacing_rate, packet_window, packet_burst, packet_inflight, packet_inburst, nextSend\n");
+            printf("NORMAL_ACK_r: time, timestamp, echoed_timestamp, time_diff, seqnr, bytes_received, pkts_received, "
+                   "pkts_CE, pkts_lost, error_L4S,,,,, packet_inflight, packet_inburst, nextSend\n");
+            printf("RFC8888_ACK_r: time, begin_seq, num_reports, time_diff, seqnr, bytes_received, pkts_received, "
+                   "pkts_CE, pkts_lost, error_L4S,,,,, packet_inflight, packet_inburst, nextSend\n");
+        } else {
+            printf("s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size,,,,, pacing_rate, "
+                   "frame_window, frame_size, packet_burst, frame_inflight, frame_sent, packet_inburst, nextSend\n");
+            printf("NORMAL_ACK_r: time, timestamp, echoed_timestamp, time_diff, seqnr, bytes_received, pkts_received, "
+                   "pkts_CE, pkts_lost, error_L4S,,,,, frame_inflight, frame_sending, sent_frame, lost_frame, "
+                   "recv_frame, nextSend\n");
+            printf("RFC8888_ACK_r: time, begin_seq, num_reports, time_diff, seqnr, bytes_received, pkts_received, "
+                   "pkts_CE, pkts_lost, error_L4S,,,,, frame_inflight, frame_sending, sent_frame, lost_frame, "
+                   "recv_frame, nextSend\n");
+        }
+    } else {
+        printf("r: time, timestamp, echoed_timestamp, time_diff, seqnr, bytes_received\n");
+        printf("s: time, timestamp, echoed_timestamp, time_diff, seqnr, packet_size, "
+               "pkts_received, pkts_CE, pkts_lost, error_L4S\n");
+    }
+    printf("cc: time, pacing_rate, packet_window, packet_burst, packet_size, srtt, rttvar, min_rtt, qdelay, alpha, "
+           "cc_state, cca_mode, packets_sent, packets_received, packets_CE, packets_lost\n");
+}
+
+// the same lines as the verbose prints of AppStuff
+static void print_csv(const trace_rec_t &r, time_tp diff)
+{
+    const int32_t *v = r.v;
+    unsigned long long u = r.u;
+    switch (r.type) {
+    case trc_send:
+        printf("s: %d, %d, %d, %d, %d, %d,,,,, %llu, %d, %d, %d, %d, %d\n",
+               r.now, v[0], v[1], diff, v[2], v[3], u, v[4], v[5], v[6], v[7], v[8]);
+        break;
+    case trc_send_frame:
+        printf("s: %d, %d, %d, %d, %d, %d,,,,, %llu, %d, %d, %d, %d, %d, %d, %d\n",
+               r.now, v[0], v[1], diff, v[2], v[3], u, v[4], v[5], v[6], v[7], v[8], v[9], v[10]);
+        break;
+    case trc_recv_ack:
+    case trc_recv_rfc8888:
+        printf("%s_r: %d, %d, %d, %d, %d, %llu, %d, %d, %d, %d,,,,, ", trace_names[r.type],
+               r.now, v[0], v[1], diff, v[2], u, v[3], v[4], v[5], v[6]);
+        if (!r.rt_mode)
+            printf("%d, %d, %d\n", v[7], v[8], v[9]);
+        else
+            printf("%d, %d, %d, %d, %d, %d\n", v[7], v[8], v[9], v[10], v[11], v[12]);
+        break;
+    case trc_cc_state:
+        printf("cc: %d, %llu, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d\n",
+               r.now, u, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11], v[12], v[13]);
+        break;
+    case trc_recv_data:
+        printf("r: %d, %d, %d, %d, %d, %llu\n", r.now, v[0], v[1], diff, v[2], u);
+        break;
+    case trc_send_ack:
+        printf("s: %d, %d, %d, %d, %d, %llu, %d, %d, %d, %d\n", r.now, v[0], v[1], diff, v[2], u, v[3], v[4], v[5], v[6]);
+        break;
+    case trc_send_rfc8888:
+        printf("s: %d, %d, %d, %llu, %d, %d, \n", r.now, diff, v[0], u, v[1], v[2]);
+        break;
+    case trc_send_rle:
+        printf("s: %d, %d, %d, %llu, %d, %d, %d\n", r.now, diff, v[0], u, v[1], v[2], v[3]);
+        break;
+    default:
+        break;
+    }
+}
+
+static void print_json(json_writer &jw, const trace_rec_t &r, time_tp diff)
+{
+    jw.reset();
+    jw.field("type", std::string(trace_names[r.type]));
+    jw.field("time", r.now);
+    if (r.type != trc_cc_state)
+        jw.field("time_diff", diff);
+    const char *const *names = trace_fields[r.type];
+    jw.field(names[0], uint64_t(r.u));
+    for (int i = 0; names[i + 1]; i++) {
+        if (r.rt_mode && (r.type == trc_recv_ack || r.type == trc_recv_rfc8888) && i == 7) {
+            for (int j = 0; trace_rt_fields[j]; j++)
+                jw.field(trace_rt_fields[j], r.v[i + j]);
+            break;
+        }
+        jw.field(names[i + 1], r.v[i]);
+    }
+    jw.finalize();
+    jw.dump(true);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    const char *json_file = NULL;
+    uint32_t sample = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "-s" && i + 1 < argc) {
+            sample = strtoul(argv[++i], NULL, 10);
+        } else if (arg[0] != '-' && !filename) {
+            filename = argv[i];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (!filename || !sample) {
+        printf("UDP Prague trace converter usage:\n"
+               "    udp_prague_trace <trace file written with --trace> [options]\n"
+               "    -j <json_filename, otherwise the verbose CSV layout on stdout>\n"
+               "    -s <keep 1 in N records of each type, def: 1 (all)>\n");
+        exit(1);
+    }
+
+    TraceRing trace;
+    const trace_hdr_t *hdr = trace.Open(filename);
+    json_writer jw;
+    if (json_file) {
+        if (jw.init(json_file, false) != 0) {
+            perror("Error opening json file");
+            exit(1);
+        }
+    } else {
+        print_header(*hdr);
+    }
+
+    // the time differences are taken between consecutive data packets and between consecutive feedback packets,
+    // as the verbose prints do (including the records that are not sampled)
+    time_tp data_tm = 1;
+    time_tp ack_tm = 1;
+    uint64_t counts[trc_types] = {0};
+    if (trace.First())
+        fprintf(stderr, "%llu oldest records were overwritten in the ring\n", (unsigned long long)trace.First());
+    for (uint64_t i = trace.First(); i != trace.Last(); i++) {
+        const trace_rec_t &r = trace.At(i);
+        if (r.type == trc_none || r.type >= trc_types)
+            continue;
+        time_tp diff = 0;
+        switch (r.type) {
+        case trc_send:
+        case trc_send_frame:
+        case trc_recv_data:
+            diff = r.v[0] - data_tm;
+            data_tm = r.v[0];
+            break;
+        case trc_recv_ack:
+        case trc_send_ack:
+            diff = r.v[0] - ack_tm;
+            ack_tm = r.v[0];
+            break;
+        case trc_recv_rfc8888:
+            diff = r.now - ack_tm;
+            if (!r.rt_mode)
+                ack_tm = r.now;
+            break;
+        case trc_send_rfc8888:
+        case trc_send_rle:
+            diff = r.now - ack_tm;
+            ack_tm = r.now;
+            break;
+        default:
+            break;
+        }
+        if (counts[r.type]++ % sample)
+            continue;
+        if (json_file)
+            print_json(jw, r, diff);
+        else
+            print_csv(r, diff);
+    }
+    jw.close();
+    return 0;
+}
@@ -2,6 +2,18 @@
 #include <cassert>
 #include <cstring>
 #include <system_error>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
 
 #ifndef _WIN32
 constexpr int SOCKET_ERROR = -1;
@@ -81,6 +93,11 @@ bool wait_for_readable(SocketHandle s, time_tp timeout) {
 
   int r = select((int)s + 1, &recvsds, NULL, NULL, &tv);
 
+#ifndef _WIN32
+  // Interrupted by a signal (e.g. to stop the app), handled as a timeout
+  if (r < 0 && errno == EINTR)
+    return false;
+#endif
   if (r == SOCKET_ERROR)
     throw std::system_error(last_error_code(), std::system_category(),
                             "select");
@@ -88,6 +105,44 @@ bool wait_for_readable(SocketHandle s, time_tp timeout) {
   return r > 0;
 }
 
+#ifdef __linux__
+// Wait for a socket to become readable until an absolute deadline timeout us from now, on the monotonic clock of
+// PragueCC::Now(). The deadline is aligned to the us tick that Now() reaches it, so the wait never ends early, and
+// a timerfd is not extended by the timer slack as a relative select timeout is. A timeout of 0 only polls.
+// Returns the poll events of the socket, 0 at the deadline.
+short wait_until_readable(SocketHandle s, int timer, time_tp timeout) {
+  assert(is_socket_valid(s));
+  assert(timeout >= 0);
+
+  pollfd fds[2] = {{s, POLLIN, 0}, {timer, POLLIN, 0}};
+  if (!timeout) {
+    int r = poll(fds, 1, 0);
+    if (r < 0 && errno != EINTR)
+      throw std::system_error(errno, std::system_category(), "poll");
+    return (r > 0) ? fds[0].revents : 0;
+  }
+
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t deadline = (int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 + timeout) * 1000;
+  itimerspec its{};
+  its.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000);
+  its.it_value.tv_nsec = static_cast<long>(deadline % 1000000000);
+  if (timerfd_settime(timer, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    throw std::system_error(errno, std::system_category(), "timerfd_settime");
+
+  // re-arming resets an expiration that was not read, so the timerfd is never read
+  int r = poll(fds, 2, -1);
+  // Interrupted by a signal (e.g. to stop the app), handled as a timeout
+  if (r < 0 && errno == EINTR)
+    return 0;
+  if (r < 0)
+    throw std::system_error(errno, std::system_category(), "poll");
+
+  return fds[0].revents;
+}
+#endif
+
 // Create an IPv4 or IPv6 datagram socket
 SocketHandle make_socket(int family) {
   if (!(family == AF_INET || family == AF_INET6)) {
@@ -286,6 +341,12 @@ UDPSocket::UDPSocket()
 
   set_max_priority();
 
+#ifdef __linux__
+  timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (timer < 0)
+    throw std::system_error(errno, std::system_category(), "timerfd_create");
+#endif
+
 #ifdef _WIN32
   // Initialize Winsock
   WORD versionRequested = MAKEWORD(2, 2);
@@ -298,6 +359,9 @@ UDPSocket::UDPSocket()
 
 UDPSocket::~UDPSocket() {
   close_socket(socket);
+#ifdef __linux__
+  ::close(timer);
+#endif
 #ifdef _WIN32
   WSACleanup();
 #endif
@@ -329,7 +393,7 @@ void UDPSocket::init_io() {
 
   sendControlBuf.buf = sendControl;
   sendControlBuf.len = sizeof(sendControl);
-  sendMsg.lpBuffers = &dataBuf;
+  sendMsg.lpBuffers = sendBufs;
   sendMsg.dwBufferCount = 1;
   sendMsg.Control = sendControlBuf;
   sendMsg.dwFlags = 0;
@@ -342,7 +406,7 @@ void UDPSocket::init_io() {
   recvMsg.dwFlags = 0;
 
 #else
-  send_msg.msg_iov = &send_iov;
+  send_msg.msg_iov = send_iov;
   send_msg.msg_iovlen = 1;
   send_msg.msg_control = send_ctrl;
   send_msg.msg_controllen = sizeof(send_ctrl);
@@ -450,7 +514,9 @@ size_tp UDPSocket::Receive(char *buf, size_tp len, ecn_tp &ecn,
     recv_msg.msg_namelen = sizeof(peer.sa);
   }
 
-  if ((r = recvmsg(socket, &recv_msg, 0)) < 0)
+  if ((r = recvmsg(socket, &recv_msg, 0)) < 0 && errno == EINTR)
+    return 0;  // interrupted by a signal, handled as a timeout
+  if (r < 0)
     throw std::system_error(last_error_code(), std::system_category(),
                             "Fail to recv UDP message from socket");
 
@@ -472,7 +538,153 @@ size_tp UDPSocket::Receive(char *buf, size_tp len, ecn_tp &ecn,
 #endif
 }
 
+size_tp UDPSocket::ReceiveUntil(char *buf, size_tp len, ecn_tp &ecn,
+                                time_tp deadline, time_tp now) {
+#ifdef __linux__
+  // past the deadline, only take what already arrived
+  short revents = wait_until_readable(socket, timer, (deadline - now > 0) ? (deadline - now) : 0);
+  // zero-copy completions in the error queue also wake up, they are reaped and the caller waits again
+  if (zc.sent && (revents & POLLERR)) {
+    reap_zerocopy();
+    revents &= ~POLLERR;
+  }
+  if (!revents)
+    return 0;
+  return Receive(buf, len, ecn, 0);
+#else
+  return Receive(buf, len, ecn, (deadline - now > 0) ? (deadline - now) : 1);
+#endif
+}
+
 size_tp UDPSocket::Send(char *buf, size_tp len, ecn_tp ecn) {
+#ifdef _WIN32
+  sendBufs[0].buf = buf;
+  sendBufs[0].len = ULONG(len);
+#else
+  send_iov[0].iov_base = buf;
+  send_iov[0].iov_len = len;
+#endif
+  return send_buffers(1, ecn);
+}
+
+size_tp UDPSocket::Send(const char *hdr, size_tp hdr_len, const char *payload,
+                        size_tp payload_len, ecn_tp ecn) {
+  assert(hdr != nullptr);
+  assert(payload != nullptr || payload_len == 0);
+
+  // the socket only reads the buffers, the casts are for the iovec types
+#ifdef _WIN32
+  sendBufs[0].buf = const_cast<char *>(hdr);
+  sendBufs[0].len = ULONG(hdr_len);
+  sendBufs[1].buf = const_cast<char *>(payload);
+  sendBufs[1].len = ULONG(payload_len);
+#else
+  send_iov[0].iov_base = const_cast<char *>(hdr);
+  send_iov[0].iov_len = hdr_len;
+  send_iov[1].iov_base = const_cast<char *>(payload);
+  send_iov[1].iov_len = payload_len;
+#endif
+#ifdef __linux__
+  zc.last_id = 0;
+  if (zc.min_size && payload_len >= zc.min_size && hdr_len <= ZEROCOPY_HDR) {
+    if (zc.next - zc.done >= ZEROCOPY_WINDOW)
+      reap_zerocopy();
+    if (zc.next - zc.done < ZEROCOPY_WINDOW) {
+      // the header is pinned as well, so it is copied to the slot of this id,
+      // which the id a window earlier has released
+      char *slot = &zc.hdrs[(zc.next % ZEROCOPY_WINDOW) * ZEROCOPY_HDR];
+      memcpy(slot, hdr, hdr_len);
+      send_iov[0].iov_base = slot;
+      size_tp r = send_buffers(2, ecn, MSG_ZEROCOPY);
+      if (r) {
+        zc.last_id = ++zc.next;  // the kernel numbers the zero-copy sends from 0
+        zc.sent++;
+        return r;
+      }
+    }
+    zc.fallback++;  // too many payloads pending or no buffer space, copied
+    send_iov[0].iov_base = const_cast<char *>(hdr);
+  }
+#endif
+  return send_buffers(payload_len ? 2 : 1, ecn);
+}
+
+#ifdef __linux__
+bool UDPSocket::SetZeroCopy(size_tp min_size) {
+  int one = 1;
+  if (!min_size || setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+    return false;
+  zc = zerocopy_t();
+  zc.min_size = min_size;
+  zc.hdrs.resize(ZEROCOPY_WINDOW * ZEROCOPY_HDR);
+  return true;
+}
+
+bool UDPSocket::ZeroCopyReleased(uint32_t id) {
+  if (!id || id - 1 - zc.done >= ZEROCOPY_WINDOW)
+    return true;  // copied, or completed longer ago
+  if (!zc.completed[(id - 1) % ZEROCOPY_WINDOW])
+    reap_zerocopy();
+  return zc.completed[(id - 1) % ZEROCOPY_WINDOW];
+}
+
+void UDPSocket::ZeroCopyFlush(time_tp timeout) {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t end = int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 + timeout;
+  while (zc.next != zc.done) {
+    reap_zerocopy();
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t left = end - (int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+    if (zc.next == zc.done || left <= 0)
+      break;
+    pollfd fd = {socket, 0, 0};  // POLLERR is always reported
+    poll(&fd, 1, int(left / 1000) + 1);
+  }
+}
+
+// Read the completion notifications of the zero-copy sends from the error queue: each one covers a range of send ids
+// whose payloads the kernel no longer references. Zero-copy is turned off when the kernel had to copy most payloads
+// anyway (e.g. on loopback or without scatter-gather support of the device), where it only adds overhead.
+void UDPSocket::reap_zerocopy() {
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+  msghdr msg{};
+  for (;;) {
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (recvmsg(socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      break;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (!((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) ||
+            (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)))
+        continue;
+      sock_extended_err serr;
+      memcpy(&serr, CMSG_DATA(c), sizeof(serr));
+      if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      uint32_t n = serr.ee_data - serr.ee_info + 1;  // ids ee_info..ee_data, inclusive
+      zc.done_count += n;
+      if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        zc.copied += n;
+      for (uint32_t id = serr.ee_info; id != serr.ee_data + 1; id++)
+        if (id - zc.done < ZEROCOPY_WINDOW)
+          zc.completed[id % ZEROCOPY_WINDOW] = true;
+    }
+  }
+  while (zc.done != zc.next && zc.completed[zc.done % ZEROCOPY_WINDOW]) {
+    zc.completed[zc.done % ZEROCOPY_WINDOW] = false;
+    zc.done++;
+  }
+  if (zc.done_count >= ZEROCOPY_PROBE && zc.copied * 2 > zc.done_count)
+    zc.min_size = 0;  // new sends copy, the pending completions are still reaped
+}
+#else
+bool UDPSocket::SetZeroCopy(size_tp) { return false; }
+bool UDPSocket::ZeroCopyReleased(uint32_t) { return true; }
+void UDPSocket::ZeroCopyFlush(time_tp) {}
+#endif
+
+size_tp UDPSocket::send_buffers(int count, ecn_tp ecn, int flags) {
   assert(ecn == ecn_not_ect || ecn == ecn_ect0 || ecn == ecn_l4s_id ||
          ecn == ecn_ce);
 
@@ -482,8 +694,7 @@ size_tp UDPSocket::Send(char *buf, size_tp len, ecn_tp ecn) {
 
   PCMSGHDR cmsg;
 
-  dataBuf.buf = buf;
-  dataBuf.len = ULONG(len);
+  sendMsg.dwBufferCount = DWORD(count);
 
   if (connected) { // Used only with unconnected sockets
     sendMsg.name = nullptr;
@@ -496,7 +707,7 @@ size_tp UDPSocket::Send(char *buf, size_tp len, ecn_tp ecn) {
   cmsg = WSA_CMSG_FIRSTHDR(&sendMsg);
   fill_ecn_cmsg(cmsg, peer.family(), ecn);
 
-  error = WSASendMsg(socket, &sendMsg, 0, &numBytes, NULL, NULL);
+  error = WSASendMsg(socket, &sendMsg, DWORD(flags), &numBytes, NULL, NULL);
 
   if (error == SOCKET_ERROR)
     throw std::system_error(last_error_code(), std::system_category(),
@@ -504,8 +715,7 @@ size_tp UDPSocket::Send(char *buf, size_tp len, ecn_tp ecn) {
 
   return static_cast<size_t>(numBytes);
 #else
-  send_iov.iov_base = buf;
-  send_iov.iov_len = len;
+  send_msg.msg_iovlen = count;
 
   // On unconnected UDP sockets, sendmsg() requires a destination address
   // in msg_name. On connected sockets, this must be NULL.
@@ -517,8 +727,10 @@ size_tp UDPSocket::Send(char *buf, size_tp len, ecn_tp ecn) {
   cmsghdr *cmsg = CMSG_FIRSTHDR(&send_msg);
   fill_ecn_cmsg(cmsg, peer.family(), ecn);
 
-  ssize_t rc = sendmsg(socket, &send_msg, 0);
+  ssize_t rc = sendmsg(socket, &send_msg, flags);
 
+  if (rc < 0 && (flags & MSG_ZEROCOPY) && errno == ENOBUFS)
+    return 0;  // over the locked memory limit of zero-copy, the caller copies
   if (rc < 0)
     throw std::system_error(errno, std::system_category(), "sendmsg");
 
@@ -34,12 +34,17 @@
 #include <pthread.h>
 #include <sys/time.h>
 #endif
+#include <vector>
 #include "prague_cc.h"
 
 #ifdef _WIN32
 typedef int ssize_t;
 #endif
 
+#define ZEROCOPY_WINDOW 1024 // max zero-copy sends waiting for completion
+#define ZEROCOPY_PROBE 256   // completions before deciding zero-copy is copied
+#define ZEROCOPY_HDR 64      // max header size of a zero-copy send
+
 // Holds a resolved socket address (IPv4 or IPv6) and its length.
 struct Endpoint {
   sockaddr_storage sa{};
@@ -50,6 +55,15 @@ struct Endpoint {
   int family() const { return sa.ss_family; }
 };
 
+// Counters of the zero-copy sends of a socket.
+struct zerocopy_stats_t {
+  uint64_t sent{0};      // sent with MSG_ZEROCOPY
+  uint64_t completed{0}; // of which the payload is released
+  uint64_t copied{0};    // of which the kernel copied the payload anyway
+  uint64_t fallback{0};  // copied sends above the threshold (window full)
+  bool active{false};    // zero-copy still enabled
+};
+
 // Platform-abstracted socket type (SOCKET on Windows, else int).
 using SocketHandle =
 #ifdef _WIN32
@@ -67,10 +81,52 @@ public:
   void Connect(const char *addr, uint16_t port);
 
   size_tp Receive(char *buf, size_tp len, ecn_tp &ecn, time_tp timeout);
+  // Receive before an absolute PragueCC::Now() deadline, given the current
+  // now, returns 0 at the deadline or right away if it has passed
+  size_tp ReceiveUntil(char *buf, size_tp len, ecn_tp &ecn, time_tp deadline,
+                       time_tp now);
   size_tp Send(char *buf, size_tp len, ecn_tp ecn);
+  // Send a header and a payload in application memory as one datagram
+  // (scatter-gather), the payload is not copied
+  size_tp Send(const char *hdr, size_tp hdr_len, const char *payload,
+               size_tp payload_len, ecn_tp ecn);
+
+  // Send payloads of at least min_size with MSG_ZEROCOPY (Linux only, returns
+  // false if unsupported). Such a payload must not be changed until released,
+  // the header is copied.
+  bool SetZeroCopy(size_tp min_size);
+  // Id of the last Send to check its release, 0 if the payload was copied
+  uint32_t ZeroCopyId() const { return zc.last_id; }
+  bool ZeroCopyReleased(uint32_t id);
+  // Wait up to timeout us until all zero-copy payloads are released
+  void ZeroCopyFlush(time_tp timeout);
+  zerocopy_stats_t ZeroCopyStats() const {
+    zerocopy_stats_t st;
+    st.sent = zc.sent;
+    st.completed = zc.done_count;
+    st.copied = zc.copied;
+    st.fallback = zc.fallback;
+    st.active = zc.min_size != 0;
+    return st;
+  }
 
 private:
   void init_io();
+  size_tp send_buffers(int count, ecn_tp ecn, int flags = 0);
+  void reap_zerocopy();
+
+  struct zerocopy_t {
+    size_tp min_size{0};    // 0 if disabled
+    uint32_t next{0};       // ids of the sent, and completed in order payloads
+    uint32_t done{0};
+    uint32_t last_id{0};
+    uint64_t sent{0};
+    uint64_t done_count{0};
+    uint64_t copied{0};
+    uint64_t fallback{0};
+    bool completed[ZEROCOPY_WINDOW]{}; // completed after done, by id
+    std::vector<char> hdrs;            // header copies, by id
+  };
 
 private:
 #ifdef _WIN32
@@ -79,6 +135,7 @@ private:
   LPFN_WSASENDMSG WSASendMsg; // Pointer to WSASendMsg extension function
 
   WSABUF dataBuf;
+  WSABUF sendBufs[2]; // header and payload
 
   CHAR sendControl[WSA_CMSG_SPACE(sizeof(INT))] = {0};
   WSABUF sendControlBuf;
@@ -89,7 +146,7 @@ private:
   WSAMSG recvMsg;
 #else
   msghdr send_msg{};
-  iovec send_iov{};
+  iovec send_iov[2]{}; // header and payload
   alignas(cmsghdr) char send_ctrl[CMSG_SPACE(sizeof(int))];
 
   msghdr recv_msg{};
@@ -98,6 +155,10 @@ private:
 #endif
   SocketHandle socket;
   Endpoint peer;
+#ifdef __linux__
+  int timer; // timerfd for the absolute deadlines of ReceiveUntil
+#endif
+  zerocopy_t zc;
 
   bool connected;
 };
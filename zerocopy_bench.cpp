@@ -0,0 +1,123 @@
+// zerocopy_bench.cpp:
+// CPU cost of copied against MSG_ZEROCOPY sends of the UDPSocket scatter-gather path over a range of payload sizes,
+// to find the payload size above which zero-copy pays off (the sender's --zerocopymin). By default the datagrams go
+// to a sink socket on loopback, where the kernel always copies the payload; pass the address of a
+// udp_prague_receiver (or any other UDP sink) behind a real NIC to measure the crossover of that path.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "udpsocket.h"
+#include "app_stuff.h"
+#include "pkt_format.h"
+
+#define BENCH_BYTES    (256 << 20) // bytes sent per size and mode
+#define BENCH_MIN_SENDS 20000
+#define BENCH_MAX_SENDS 500000
+#define BENCH_PORT     9199
+
+struct result_t {
+    uint64_t sends;
+    double cpu_ns;            // CPU time per send
+    double wall_ns;           // wall time per send
+    double gbps_core;         // sent payload rate per core of CPU time
+    double copied;            // fraction of the zero-copy sends the kernel copied anyway
+    bool zerocopy;            // zero-copy stayed enabled
+};
+
+static uint8_t payload[65536];
+
+static result_t run(UDPSocket &us, size_tp size, bool zerocopy)
+{
+    result_t res = result_t();
+    datamessage_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    uint64_t sends = BENCH_BYTES / size;
+    sends = (sends < BENCH_MIN_SENDS) ? BENCH_MIN_SENDS : (sends > BENCH_MAX_SENDS) ? BENCH_MAX_SENDS : sends;
+    zerocopy_stats_t before = us.ZeroCopyStats();
+
+    int64_t cpu0, wall0, cpu1, wall1;
+    AppStuff::CpuClock(cpu0, wall0);
+    for (uint64_t i = 0; i < sends; i++) {
+        hdr.seq_nr = count_tp(i + 1);
+        hdr.hton();
+        us.Send((char*)(&hdr), sizeof(hdr), (char*)(payload), size - sizeof(hdr), ecn_l4s_id);
+    }
+    if (zerocopy)
+        us.ZeroCopyFlush(1000000);  // releasing the payloads is part of the cost
+    AppStuff::CpuClock(cpu1, wall1);
+
+    zerocopy_stats_t after = us.ZeroCopyStats();
+    uint64_t completed = after.completed - before.completed;
+    res.sends = sends;
+    res.cpu_ns = (cpu1 - cpu0) * 1000.0 / sends;
+    res.wall_ns = (wall1 - wall0) * 1000.0 / sends;
+    res.gbps_core = (cpu1 > cpu0) ? double(size) * sends * 8 / ((cpu1 - cpu0) * 1000.0) : 0;
+    res.copied = completed ? double(after.copied - before.copied) / completed : 0;
+    res.zerocopy = zerocopy && after.active && after.sent > before.sent;
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *addr = NULL;
+    uint16_t port = BENCH_PORT;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-a" && i + 1 < argc) {
+            addr = argv[++i];
+        } else if (arg == "-p" && i + 1 < argc) {
+            port = uint16_t(strtoul(argv[++i], NULL, 10));
+        } else {
+            printf("Zero-copy send benchmark usage:\n"
+                   "    zerocopy_bench [-a <receiver IP address, def: a sink on loopback>] [-p <port, def: %d>]\n",
+                   BENCH_PORT);
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = uint8_t(i);
+
+    UDPSocket sink;
+    if (!addr) {
+        sink.Bind("127.0.0.1", port);  // never read, the datagrams that do not fit are dropped
+        addr = "127.0.0.1";
+    }
+    const size_tp sizes[] = {256, 512, 1024, 1472, 2048, 4096, 8192, 16384, 32768, 65000};
+    printf("Copied vs zero-copy sends to %s:%d, %d MB per size (%d..%d sends)\n", addr, port, BENCH_BYTES >> 20,
+           BENCH_MIN_SENDS, BENCH_MAX_SENDS);
+    printf("%8s %12s %12s %10s %12s %12s %10s %8s\n", "size", "copy_ns", "copy_wall", "copy_Gbps", "zc_ns", "zc_wall",
+           "zc_Gbps", "copied");
+    size_tp crossover = 0;
+    bool supported = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        // a fresh socket per mode, so zero-copy is not already disabled by the copies of a previous size
+        UDPSocket copy_us, zc_us;
+        copy_us.Connect(addr, port);
+        zc_us.Connect(addr, port);
+        supported = zc_us.SetZeroCopy(1) && supported;
+        result_t c = run(copy_us, sizes[s], false);
+        result_t z = run(zc_us, sizes[s], supported);
+        if (supported)
+            printf("%8llu %12.0f %12.0f %10.2f %12.0f %12.0f %10.2f %7.1f%%\n", (unsigned long long)sizes[s], c.cpu_ns,
+                   c.wall_ns, c.gbps_core, z.cpu_ns, z.wall_ns, z.gbps_core, z.copied * 100);
+        else
+            printf("%8llu %12.0f %12.0f %10.2f %12s %12s %10s %8s\n", (unsigned long long)sizes[s], c.cpu_ns,
+                   c.wall_ns, c.gbps_core, "-", "-", "-", "-");
+        if (z.zerocopy && z.copied < 0.5 && z.cpu_ns < c.cpu_ns) {
+            if (!crossover)
+                crossover = sizes[s];
+        } else {
+            crossover = 0;  // the smallest size above which zero-copy keeps winning
+        }
+    }
+    if (!supported)
+        printf("Zero-copy sends are not supported here (Linux 4.14 or later)\n");
+    else if (crossover)
+        printf("Zero-copy uses less CPU from %llu B payloads: run the sender with --zerocopy --zerocopymin %llu\n",
+               (unsigned long long)crossover, (unsigned long long)crossover);
+    else
+        printf("No crossover: zero-copy did not use less CPU on this path (loopback and veth always copy the payload)\n");
+    return 0;
+}